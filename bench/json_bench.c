@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_ascii_utils.h"
+#include "json_binary.h"
+#include "json_context.h"
+#include "json_corpus.h"
+#include "json_intern.h"
+#include "json_lazy.h"
+#include "json_ndjson.h"
+#include "json_packed.h"
+#include "json_parallel.h"
+#include "json_tape.h"
+
+/* The size of each corpus, in MiB, and the number of times that each
+   benchmark is run, unless others are given.  The fastest run is
+   reported. */
+#define JSON_BENCH_SIZE_MB 8
+#define JSON_BENCH_REPEATS 5
+
+/* The corpora that a benchmark applies to. */
+#define JSON_BENCH_ALL ((1U << JSON_CORPUS_N) - 1)
+#define JSON_BENCH_NDJSON (1U << JSON_CORPUS_NDJSON)
+
+/* The state of one benchmark.  The corpus, its UBJSON form and the
+   tree read from it are prepared once for each corpus, and only the
+   time between json_bench_start and json_bench_stop is counted. */
+struct json_bench_run {
+  const struct char_buffer *corpus;
+  const struct char_buffer *ubjson;
+  const struct json_data *json; /* The tree read from the corpus */
+  FILE *null_file; /* /dev/null, for the writers that take a FILE */
+  size_t text_size; /* The size of the tree once written as ASCII json */
+
+  struct timespec start;
+  size_t allocations_start;
+  double seconds; /* The time of the last run */
+  size_t allocations; /* The allocations of the last run */
+  size_t bytes; /* The characters read or written by the last run */
+};
+
+/* A benchmark.  The function does one run, and returns zero on
+   success. */
+struct json_bench_case {
+  const char *name;
+  unsigned int corpora; /* The corpora that the benchmark applies to */
+  int (*run)(struct json_bench_run *run);
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+void json_bench_start(struct json_bench_run *run);
+void json_bench_stop(struct json_bench_run *run);
+size_t json_bench_allocations_count(void);
+long json_bench_rss_kb(void);
+int json_bench_corpus(unsigned int kind, size_t size, unsigned int repeats, const char *bench_name,
+		      const char *dir);
+void json_bench_case_run(const struct json_bench_case *bench, struct json_bench_run *run,
+			 const char *corpus_name, size_t nodes, unsigned int repeats);
+int json_bench_read(struct json_bench_run *run);
+int json_bench_read_arena(struct json_bench_run *run);
+int json_bench_read_context(struct json_bench_run *run);
+int json_bench_read_insitu(struct json_bench_run *run);
+int json_bench_read_lazy(struct json_bench_run *run);
+int json_bench_read_parallel(struct json_bench_run *run);
+int json_bench_read_packed(struct json_bench_run *run);
+int json_bench_read_intern(struct json_bench_run *run);
+int json_bench_read_tape(struct json_bench_run *run);
+int json_bench_read_ndjson(struct json_bench_run *run);
+int json_bench_read_ubjson(struct json_bench_run *run);
+int json_bench_write_tree(struct json_bench_run *run);
+int json_bench_write_compact(struct json_bench_run *run);
+int json_bench_write_ubjson(struct json_bench_run *run);
+int json_bench_read_data(struct json_bench_run *run, struct json_data *json);
+
+static const struct json_bench_case json_bench_cases[] = {
+  {"read", JSON_BENCH_ALL, json_bench_read},
+  {"read_arena", JSON_BENCH_ALL, json_bench_read_arena},
+  {"read_context", JSON_BENCH_ALL, json_bench_read_context},
+  {"read_insitu", JSON_BENCH_ALL, json_bench_read_insitu},
+  {"read_lazy", JSON_BENCH_ALL, json_bench_read_lazy},
+  {"read_parallel", JSON_BENCH_ALL, json_bench_read_parallel},
+  {"read_packed", JSON_BENCH_ALL, json_bench_read_packed},
+  {"read_intern", JSON_BENCH_ALL, json_bench_read_intern},
+  {"read_tape", JSON_BENCH_ALL, json_bench_read_tape},
+  {"read_ndjson", JSON_BENCH_NDJSON, json_bench_read_ndjson},
+  {"read_ubjson", JSON_BENCH_ALL, json_bench_read_ubjson},
+  {"write_tree", JSON_BENCH_ALL, json_bench_write_tree},
+  {"write_compact", JSON_BENCH_ALL, json_bench_write_compact},
+  {"write_ubjson", JSON_BENCH_ALL, json_bench_write_ubjson},
+  {0, 0, 0}
+};
+
+/* The allocations are counted by replacing malloc, calloc and realloc
+   for the whole process, which glibc allows.  Elsewhere they are not
+   counted, and are reported as -1. */
+#ifdef __GLIBC__
+#define JSON_BENCH_COUNT_ALLOCATIONS 1
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void *ptr, size_t size);
+
+static size_t json_bench_allocations = 0;
+
+void* malloc(size_t size) {
+  __atomic_add_fetch(&json_bench_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  __atomic_add_fetch(&json_bench_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&json_bench_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+/* Run the benchmarks, and print one line of json for each benchmark
+   of each corpus, as newline delimited json. */
+int main(int argc, char **argv) {
+  const char *corpus_name = 0, *bench_name = 0, *dir = 0;
+  unsigned long size_mb = JSON_BENCH_SIZE_MB, repeats = JSON_BENCH_REPEATS;
+  unsigned int kind;
+  int c, status = 0;
+
+  while((c = getopt(argc, argv, "s:r:c:b:o:h")) != -1) {
+    switch(c) {
+    case 's':
+      size_mb = strtoul(optarg, 0, 10);
+      break;
+    case 'r':
+      repeats = strtoul(optarg, 0, 10);
+      break;
+    case 'c':
+      corpus_name = optarg;
+      break;
+    case 'b':
+      bench_name = optarg;
+      break;
+    case 'o':
+      dir = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-s corpus size in MiB] [-r repeats] [-c corpus] [-b benchmark] "
+	      "[-o directory to save the corpora in]\n", argv[0]);
+      return c == 'h' ? 0 : 1;
+    }
+  }
+  if(!size_mb || !repeats) {
+    fprintf(stderr, "Error: the size and the number of repeats must be positive.\n");
+    return 1;
+  }
+  if(corpus_name && json_corpus_find(corpus_name) < 0) {
+    fprintf(stderr, "Error: there is no corpus called %s.\n", corpus_name);
+    return 1;
+  }
+
+  for(kind=0;kind<JSON_CORPUS_N;kind++) {
+    if(corpus_name && strcmp(corpus_name, json_corpus_name(kind))) continue;
+    if(json_bench_corpus(kind, size_mb << 20, (unsigned int)repeats, bench_name, dir)) status = 1;
+  }
+  return status;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+void json_bench_start(struct json_bench_run *run) {
+  run->allocations_start = json_bench_allocations_count();
+  clock_gettime(CLOCK_MONOTONIC, &run->start);
+}
+
+void json_bench_stop(struct json_bench_run *run) {
+  struct timespec stop;
+
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  run->seconds = (double)(stop.tv_sec - run->start.tv_sec) + 1e-9*(double)(stop.tv_nsec - run->start.tv_nsec);
+  run->allocations = json_bench_allocations_count() - run->allocations_start;
+}
+
+size_t json_bench_allocations_count(void) {
+#ifdef JSON_BENCH_COUNT_ALLOCATIONS
+  return __atomic_load_n(&json_bench_allocations, __ATOMIC_RELAXED);
+#else
+  return 0;
+#endif
+}
+
+/* The resident set size of the process, in KiB, or zero if it is not
+   known. */
+long json_bench_rss_kb(void) {
+  FILE *fptr = fopen("/proc/self/statm", "r");
+  long size = 0, resident = 0;
+
+  if(!fptr) return 0;
+  if(fscanf(fptr, "%ld %ld", &size, &resident) != 2) resident = 0;
+  fclose(fptr);
+  return resident*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+/* A function to generate a corpus and run the benchmarks on it.  Each
+   benchmark runs in a child process, such that its peak resident set
+   size is its own.  The arguments are (kind, size, repeats, name of
+   the only benchmark to run or null, directory to save the corpus in
+   or null).  Returns zero on success. */
+int json_bench_corpus(unsigned int kind, size_t size, unsigned int repeats, const char *bench_name,
+		      const char *dir) {
+  struct char_buffer corpus, ubjson;
+  struct json_data json;
+  struct json_bench_run run;
+  const struct json_bench_case *bench = 0;
+  FILE *fptr = 0;
+  char path[4096];
+  pid_t pid;
+  int status = 0, child_status = 0;
+
+  char_buffer_clear(&corpus);
+  char_buffer_clear(&ubjson);
+  json_data_clear(&json);
+
+  if(json_corpus_generate(&corpus, kind, size, JSON_CORPUS_SEED)) return 1;
+  if(dir) {
+    snprintf(path, sizeof(path), "%s/%s.json", dir, json_corpus_name(kind));
+    fptr = fopen(path, "w");
+    if(!fptr || fwrite(corpus.buffer, 1, corpus.size, fptr) != corpus.size) {
+      fprintf(stderr, "Error: could not write the corpus to %s.\n", path);
+      status = 2;
+    }
+    if(fptr) fclose(fptr);
+  }
+
+  /* The tree is read once for the writers, and written once as UBJSON
+     for the UBJSON reader.  The size of the ASCII json is measured
+     here too, since the position of /dev/null is always zero. */
+  if(!status && (!json_read_ascii_buffer(&json, &corpus) || !json_write_to_buffer(&ubjson, "u", &json))) {
+    fprintf(stderr, "Error: could not read the %s corpus.\n", json_corpus_name(kind));
+    status = 3;
+  }
+  ubjson.size = ubjson.position;
+  run.text_size = 0;
+  if(!status) {
+    struct char_buffer text;
+    char_buffer_clear(&text);
+    if(json_write_to_buffer(&text, "", &json)) run.text_size = text.position;
+    char_buffer_free(&text);
+  }
+
+  run.corpus = &corpus;
+  run.ubjson = &ubjson;
+  run.json = &json;
+  run.null_file = fopen("/dev/null", "w");
+  if(!run.null_file) {
+    fprintf(stderr, "Error: could not open /dev/null.\n");
+    status = 4;
+  }
+
+  for(bench=json_bench_cases;bench->name && !status;bench++) {
+    if(bench_name && strcmp(bench_name, bench->name)) continue;
+    if(!(bench->corpora & (1U << kind))) continue;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0) {
+      json_bench_case_run(bench, &run, json_corpus_name(kind), json.n_json_values, repeats);
+      fflush(stdout);
+      _exit(0);
+    }
+    if(pid < 0 || waitpid(pid, &child_status, 0) < 0 || !WIFEXITED(child_status) || WEXITSTATUS(child_status)) {
+      printf("{\"corpus\":\"%s\",\"bench\":\"%s\",\"status\":\"crashed\"}\n", json_corpus_name(kind), bench->name);
+    }
+  }
+
+  if(run.null_file) fclose(run.null_file);
+  json_free_value_array(&json);
+  char_buffer_free(&ubjson);
+  char_buffer_free(&corpus);
+  return status;
+}
+
+/* A function to run one benchmark a number of times, and print the
+   fastest run. */
+void json_bench_case_run(const struct json_bench_case *bench, struct json_bench_run *run,
+			 const char *corpus_name, size_t nodes, unsigned int repeats) {
+  long rss_base = json_bench_rss_kb();
+  double seconds = 0;
+  size_t allocations = 0, bytes = 0;
+  struct rusage usage;
+  unsigned int i;
+
+  for(i=0;i<repeats;i++) {
+    run->seconds = 0;
+    run->allocations = 0;
+    run->bytes = 0;
+    if(bench->run(run)) {
+      printf("{\"corpus\":\"%s\",\"bench\":\"%s\",\"status\":\"failed\"}\n", corpus_name, bench->name);
+      return;
+    }
+    if(i == 0 || run->seconds < seconds) {
+      seconds = run->seconds;
+      allocations = run->allocations;
+      bytes = run->bytes;
+    }
+  }
+  getrusage(RUSAGE_SELF, &usage);
+  if(seconds <= 0) seconds = 1e-9;
+
+  printf("{\"corpus\":\"%s\",\"bench\":\"%s\",\"status\":\"ok\",\"bytes\":%lu,\"nodes\":%lu,"
+	 "\"repeats\":%u,\"seconds\":%.6f,\"mb_per_s\":%.1f,\"ns_per_node\":%.2f,\"allocations\":%ld,"
+	 "\"rss_base_kb\":%ld,\"rss_peak_kb\":%ld}\n",
+	 corpus_name, bench->name, (unsigned long)bytes, (unsigned long)nodes, repeats, seconds,
+	 (double)bytes/seconds/1048576.0, nodes ? 1e9*seconds/(double)nodes : 0.0,
+#ifdef JSON_BENCH_COUNT_ALLOCATIONS
+	 (long)allocations,
+#else
+	 -1L,
+#endif
+	 rss_base, (long)usage.ru_maxrss);
+}
+
+/* The benchmarks of the readers.  The time to free what was read is
+   not counted. */
+int json_bench_read(struct json_bench_run *run) {
+  struct json_data json;
+  json_data_clear(&json);
+  return json_bench_read_data(run, &json);
+}
+
+int json_bench_read_arena(struct json_bench_run *run) {
+  struct json_data json;
+  json_data_clear(&json);
+  if(json_data_use_arena(&json, 0)) return 1;
+  return json_bench_read_data(run, &json);
+}
+
+/* A context that has already read the corpus once, such that the run
+   measures the steady state of a program that reads many documents. */
+int json_bench_read_context(struct json_bench_run *run) {
+  struct json_context ctx;
+  size_t n = 0;
+
+  if(json_context_init(&ctx, 0)) return 1;
+  if(!json_context_read(&ctx, run->corpus)) {
+    json_context_free(&ctx);
+    return 2;
+  }
+
+  json_bench_start(run);
+  n = json_context_read(&ctx, run->corpus);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_context_free(&ctx);
+  return n ? 0 : 3;
+}
+
+int json_bench_read_insitu(struct json_bench_run *run) {
+  struct char_buffer copy;
+  struct json_data json;
+  size_t n = 0;
+
+  /* The buffer is changed by the reader, so each run reads a fresh
+     copy. */
+  char_buffer_clear(&copy);
+  if(char_buffer_append_n(&copy, run->corpus->buffer, run->corpus->size)) return 1;
+  copy.size = copy.position;
+  json_data_clear(&json);
+
+  json_bench_start(run);
+  n = json_read_ascii_buffer_insitu(&json, &copy);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_free_value_array(&json);
+  char_buffer_free(&copy);
+  return n ? 0 : 2;
+}
+
+int json_bench_read_lazy(struct json_bench_run *run) {
+  struct json_data json;
+  size_t n = 0;
+
+  json_data_clear(&json);
+  json_bench_start(run);
+  n = json_read_ascii_buffer_lazy(&json, run->corpus);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_free_value_array(&json);
+  return n ? 0 : 1;
+}
+
+int json_bench_read_parallel(struct json_bench_run *run) {
+  struct json_data json;
+  size_t n = 0;
+
+  json_data_clear(&json);
+  json_bench_start(run);
+  n = json_read_ascii_buffer_parallel(&json, run->corpus, 0);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_free_value_array(&json);
+  return n ? 0 : 1;
+}
+
+int json_bench_read_packed(struct json_bench_run *run) {
+  struct json_data json;
+  json_data_clear(&json);
+  json_data_use_packed_arrays(&json);
+  return json_bench_read_data(run, &json);
+}
+
+int json_bench_read_intern(struct json_bench_run *run) {
+  struct json_intern table;
+  struct json_data json;
+  int status = 0;
+
+  if(json_intern_init(&table)) return 1;
+  json_data_clear(&json);
+  json_data_use_intern(&json, &table);
+  status = json_bench_read_data(run, &json);
+  json_intern_free(&table);
+  return status;
+}
+
+int json_bench_read_tape(struct json_bench_run *run) {
+  struct json_tape tape;
+  size_t n = 0;
+
+  json_tape_clear(&tape);
+  json_bench_start(run);
+  n = json_read_ascii_buffer_tape(&tape, run->corpus);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_tape_free(&tape);
+  return n ? 0 : 1;
+}
+
+int json_bench_read_ndjson(struct json_bench_run *run) {
+  struct json_data *records = 0;
+  size_t n = 0;
+
+  json_bench_start(run);
+  n = json_read_ndjson_buffer(&records, run->corpus, 0);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  if(records) json_free_ndjson(records, n);
+  return n ? 0 : 1;
+}
+
+int json_bench_read_ubjson(struct json_bench_run *run) {
+  struct json_data json;
+  size_t n = 0;
+
+  json_data_clear(&json);
+  json_bench_start(run);
+  n = json_read_ubjson_buffer(&json, run->ubjson);
+  json_bench_stop(run);
+  run->bytes = run->ubjson->size;
+
+  json_free_value_array(&json);
+  return n ? 0 : 1;
+}
+
+/* The benchmarks of the writers.  Each top-level value is written to
+   /dev/null with json_write_tree, as json_write would write it. */
+int json_bench_write_tree(struct json_bench_run *run) {
+  unsigned int i;
+
+  json_bench_start(run);
+  for(i=0;i<run->json->n_json_values;i++) {
+    if(run->json->json_values[i]->parent) continue;
+    if(!json_write_tree(run->null_file, "", run->json->json_values[i], 0)) return 1;
+  }
+  fflush(run->null_file);
+  json_bench_stop(run);
+  run->bytes = run->text_size;
+  return 0;
+}
+
+int json_bench_write_compact(struct json_bench_run *run) {
+  struct char_buffer out;
+  size_t n = 0;
+
+  char_buffer_clear(&out);
+  json_bench_start(run);
+  n = json_write_to_buffer(&out, "c", run->json);
+  json_bench_stop(run);
+  run->bytes = out.position;
+
+  char_buffer_free(&out);
+  return n ? 0 : 1;
+}
+
+int json_bench_write_ubjson(struct json_bench_run *run) {
+  struct char_buffer out;
+  size_t n = 0;
+
+  char_buffer_clear(&out);
+  json_bench_start(run);
+  n = json_write_to_buffer(&out, "u", run->json);
+  json_bench_stop(run);
+  run->bytes = out.position;
+
+  char_buffer_free(&out);
+  return n ? 0 : 1;
+}
+
+/* A function to time json_read_ascii_buffer, into a json_data that
+   has been set up by the caller and is freed here. */
+int json_bench_read_data(struct json_bench_run *run, struct json_data *json) {
+  size_t n = 0;
+
+  json_bench_start(run);
+  n = json_read_ascii_buffer(json, run->corpus);
+  json_bench_stop(run);
+  run->bytes = run->corpus->size;
+
+  json_free_value_array(json);
+  return n ? 0 : 1;
+}
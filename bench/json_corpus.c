@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_ascii_utils.h"
+#include "json_corpus.h"
+
+/* The number of numbers in each inner array of the numbers corpus. */
+#define JSON_CORPUS_ROW_SZ 256
+
+/* The depth of each value of the deep corpus. */
+#define JSON_CORPUS_DEPTH 384
+
+/* The state of a generator.  The pseudo-random numbers are from a
+   xorshift64* generator, so the corpora are the same on every
+   platform. */
+struct json_corpus_gen {
+  struct char_buffer *buffer;
+  uint64_t state;
+  int status; /* Non-zero once an append has failed */
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+uint64_t json_corpus_random(struct json_corpus_gen *gen);
+unsigned int json_corpus_below(struct json_corpus_gen *gen, unsigned int n);
+void json_corpus_put(struct json_corpus_gen *gen, const char *str);
+void json_corpus_putc(struct json_corpus_gen *gen, char c);
+void json_corpus_int(struct json_corpus_gen *gen, long l);
+void json_corpus_float(struct json_corpus_gen *gen, double d);
+void json_corpus_word(struct json_corpus_gen *gen);
+void json_corpus_numbers(struct json_corpus_gen *gen);
+void json_corpus_record(struct json_corpus_gen *gen, unsigned long id);
+void json_corpus_string(struct json_corpus_gen *gen);
+void json_corpus_deep(struct json_corpus_gen *gen);
+
+static const char *json_corpus_names[JSON_CORPUS_N] = {
+  "numbers",
+  "records",
+  "strings",
+  "deep",
+  "ndjson"
+};
+
+const char* json_corpus_name(unsigned int kind) {
+  if(kind >= JSON_CORPUS_N) return 0;
+  return json_corpus_names[kind];
+}
+
+int json_corpus_find(const char *name) {
+  int i;
+  for(i=0;i<JSON_CORPUS_N;i++) {
+    if(!strcmp(name, json_corpus_names[i])) return i;
+  }
+  return -1;
+}
+
+int json_corpus_generate(struct char_buffer *buffer, unsigned int kind, size_t size, uint64_t seed) {
+  struct json_corpus_gen gen;
+  size_t start = buffer->position;
+  unsigned long n = 0;
+
+  if(kind >= JSON_CORPUS_N) {
+    fprintf(stderr, "Error: there is no corpus of kind %u.\n", kind);
+    return 1;
+  }
+
+  gen.buffer = buffer;
+  gen.state = seed ? seed : JSON_CORPUS_SEED;
+  gen.status = char_buffer_reserve(buffer, start + size + size/8);
+
+  /* Every kind but ndjson is one top-level array, whose elements are
+     added until the document is big enough. */
+  if(kind != JSON_CORPUS_NDJSON) json_corpus_putc(&gen, '[');
+  while(!gen.status && buffer->position - start < size) {
+    if(kind != JSON_CORPUS_NDJSON && n) json_corpus_putc(&gen, ',');
+    switch(kind) {
+    case JSON_CORPUS_NUMBERS:
+      json_corpus_numbers(&gen);
+      break;
+    case JSON_CORPUS_RECORDS:
+      json_corpus_record(&gen, n);
+      break;
+    case JSON_CORPUS_STRINGS:
+      json_corpus_string(&gen);
+      break;
+    case JSON_CORPUS_DEEP:
+      json_corpus_deep(&gen);
+      break;
+    case JSON_CORPUS_NDJSON:
+      json_corpus_record(&gen, n);
+      json_corpus_putc(&gen, '\n');
+      break;
+    }
+    n++;
+  }
+  if(kind != JSON_CORPUS_NDJSON) json_corpus_put(&gen, "]\n");
+
+  if(gen.status || char_buffer_shrink_to_fit(buffer)) {
+    fprintf(stderr, "Error: could not allocate memory for the %s corpus.\n", json_corpus_names[kind]);
+    return 2;
+  }
+  return 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+uint64_t json_corpus_random(struct json_corpus_gen *gen) {
+  gen->state ^= gen->state >> 12;
+  gen->state ^= gen->state << 25;
+  gen->state ^= gen->state >> 27;
+  return gen->state * 2685821657736338717ULL;
+}
+
+/* A pseudo-random number from zero to n - 1. */
+unsigned int json_corpus_below(struct json_corpus_gen *gen, unsigned int n) {
+  return (unsigned int)((json_corpus_random(gen) >> 32) % n);
+}
+
+void json_corpus_put(struct json_corpus_gen *gen, const char *str) {
+  if(!gen->status) gen->status = char_buffer_append_n(gen->buffer, str, strlen(str));
+}
+
+void json_corpus_putc(struct json_corpus_gen *gen, char c) {
+  if(!gen->status) gen->status = char_buffer_append(gen->buffer, c);
+}
+
+void json_corpus_int(struct json_corpus_gen *gen, long l) {
+  char str[32];
+  snprintf(str, sizeof(str), "%ld", l);
+  json_corpus_put(gen, str);
+}
+
+/* Floats are written with six significant digits, as many documents
+   hold them. */
+void json_corpus_float(struct json_corpus_gen *gen, double d) {
+  char str[32];
+  snprintf(str, sizeof(str), "%.6g", d);
+  json_corpus_put(gen, str);
+}
+
+/* A quoted word of two to four syllables. */
+void json_corpus_word(struct json_corpus_gen *gen) {
+  static const char *syllables[16] = {
+    "ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo",
+    "ber", "dan", "gel", "hor", "lin", "mar", "son", "wen"
+  };
+  unsigned int n = 2 + json_corpus_below(gen, 3), i;
+
+  json_corpus_putc(gen, '"');
+  for(i=0;i<n;i++) json_corpus_put(gen, syllables[json_corpus_below(gen, 16)]);
+  json_corpus_putc(gen, '"');
+}
+
+/* An array of integers, of floats, or of both, which are the arrays
+   that can and cannot be packed. */
+void json_corpus_numbers(struct json_corpus_gen *gen) {
+  unsigned int kind = json_corpus_below(gen, 4), i;
+
+  json_corpus_putc(gen, '[');
+  for(i=0;i<JSON_CORPUS_ROW_SZ;i++) {
+    if(i) json_corpus_putc(gen, ',');
+    if(kind == 0 || (kind == 2 && (i & 1))) {
+      json_corpus_int(gen, (long)json_corpus_below(gen, 2000001) - 1000000);
+    }
+    else {
+      json_corpus_float(gen, ((double)json_corpus_below(gen, 2000001) - 1000000.0)/997.0);
+    }
+  }
+  json_corpus_putc(gen, ']');
+}
+
+/* An object with the same keys as every other record, and values of
+   every type. */
+void json_corpus_record(struct json_corpus_gen *gen, unsigned long id) {
+  unsigned int n, i;
+
+  json_corpus_put(gen, "{\"id\":");
+  json_corpus_int(gen, (long)id);
+  json_corpus_put(gen, ",\"name\":");
+  json_corpus_word(gen);
+  json_corpus_put(gen, ",\"email\":\"user");
+  json_corpus_int(gen, (long)json_corpus_below(gen, 100000));
+  json_corpus_put(gen, "@example.com\",\"active\":");
+  json_corpus_put(gen, json_corpus_below(gen, 2) ? "true" : "false");
+  json_corpus_put(gen, ",\"score\":");
+  json_corpus_float(gen, json_corpus_below(gen, 100000)/1000.0);
+  json_corpus_put(gen, ",\"age\":");
+  json_corpus_int(gen, 18 + json_corpus_below(gen, 70));
+  json_corpus_put(gen, ",\"manager\":");
+  if(json_corpus_below(gen, 4)) json_corpus_int(gen, json_corpus_below(gen, 1000));
+  else json_corpus_put(gen, "null");
+
+  json_corpus_put(gen, ",\"tags\":[");
+  n = json_corpus_below(gen, 5);
+  for(i=0;i<n;i++) {
+    if(i) json_corpus_putc(gen, ',');
+    json_corpus_word(gen);
+  }
+  json_corpus_put(gen, "],\"address\":{\"street\":");
+  json_corpus_word(gen);
+  json_corpus_put(gen, ",\"city\":");
+  json_corpus_word(gen);
+  json_corpus_put(gen, ",\"zip\":\"");
+  json_corpus_int(gen, 10000 + json_corpus_below(gen, 90000));
+  json_corpus_put(gen, "\",\"latitude\":");
+  json_corpus_float(gen, json_corpus_below(gen, 180000)/1000.0 - 90.0);
+  json_corpus_put(gen, ",\"longitude\":");
+  json_corpus_float(gen, json_corpus_below(gen, 360000)/1000.0 - 180.0);
+
+  json_corpus_put(gen, "},\"friends\":[");
+  n = json_corpus_below(gen, 8);
+  for(i=0;i<n;i++) {
+    if(i) json_corpus_putc(gen, ',');
+    json_corpus_int(gen, json_corpus_below(gen, 1000000));
+  }
+  json_corpus_put(gen, "]}");
+}
+
+/* A string of up to 4096 characters, mostly short, with an escape
+   sequence or a multi-byte character now and then. */
+void json_corpus_string(struct json_corpus_gen *gen) {
+  static const char *escapes[8] = {
+    "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\u00e9", "\\ud83d\\ude00", "\xc3\xa9"
+  };
+  unsigned int n = 16u << json_corpus_below(gen, 9), i;
+  char c;
+
+  n += json_corpus_below(gen, n);
+  json_corpus_putc(gen, '"');
+  for(i=0;i<n;i++) {
+    if(!json_corpus_below(gen, 64)) {
+      json_corpus_put(gen, escapes[json_corpus_below(gen, 8)]);
+      continue;
+    }
+    c = (char)json_corpus_below(gen, 32);
+    json_corpus_putc(gen, c < 26 ? 'a' + c : ' ');
+  }
+  json_corpus_putc(gen, '"');
+}
+
+/* A value nested JSON_CORPUS_DEPTH levels deep, in objects and arrays
+   by turns. */
+void json_corpus_deep(struct json_corpus_gen *gen) {
+  unsigned int i;
+
+  for(i=0;i<JSON_CORPUS_DEPTH;i++) json_corpus_put(gen, (i & 1) ? "[" : "{\"level\":");
+  json_corpus_int(gen, json_corpus_below(gen, 1000));
+  for(i=JSON_CORPUS_DEPTH;i>0;i--) json_corpus_putc(gen, ((i - 1) & 1) ? ']' : '}');
+}
@@ -0,0 +1,35 @@
+#ifndef JSON_CORPUS_H
+#define JSON_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+/* The seed of the corpora, unless another is given.  The same kind,
+   size and seed always give the same document. */
+#define JSON_CORPUS_SEED 0x6a736f6eU
+
+/* The kinds of synthetic document. */
+#define JSON_CORPUS_NUMBERS 0 /* An array of arrays of integers, of floats, and of both */
+#define JSON_CORPUS_RECORDS 1 /* An array of objects with the same keys */
+#define JSON_CORPUS_STRINGS 2 /* An array of long strings, some with escape sequences */
+#define JSON_CORPUS_DEEP 3 /* An array of values nested hundreds of levels deep */
+#define JSON_CORPUS_NDJSON 4 /* Objects with the same keys, one per line */
+#define JSON_CORPUS_N 5
+
+/* The name of a kind of corpus, or null if there is no such kind. */
+const char* json_corpus_name(unsigned int kind);
+
+/* The kind of corpus with a name, or -1 if there is none. */
+int json_corpus_find(const char *name);
+
+/* A function to generate a synthetic document.  The document is
+   appended to the buffer, and the size of the buffer is then set to
+   its position, as the readers expect.  The arguments are (buffer,
+   kind, approximate number of characters, seed).  The document is
+   complete and valid, so it may be a little longer than the size.
+   Returns zero on success. */
+int json_corpus_generate(struct char_buffer *buffer, unsigned int kind, size_t size, uint64_t seed);
+
+#endif
@@ -13,6 +13,14 @@
 #define JSON_FLOAT 6
 #define JSON_BOOLEAN 7
 #define JSON_NULL 8
+#define JSON_PACKED_INT 9 /* An array of integers, stored contiguously */
+#define JSON_PACKED_FLOAT 10 /* An array of floats, stored contiguously */
+
+struct json_object_index;
+struct json_lazy;
+struct json_lazy_ref;
+struct json_intern;
+struct json_stats;
 
 /* A data struct to contain json data values.  The struct is used to
    store the json file as a tree, where the nodes are object, arrays
@@ -22,9 +30,14 @@ struct json_value {
   /* object, array, pair, string, int, float, boolean (int) */ 
   unsigned int json_type;
 
+  /* The number of characters in str_value, without the terminator,
+     or the number of elements of a packed array. */
+  unsigned int str_len;
+
   /* Either null or an array of children. */  
   struct json_value **children;
   unsigned int nchildren;
+  unsigned int nchildren_alloc; /* Number of child slots, or packed elements, allocated */
   
   /* Either null or the address of a parent */
   struct json_value *parent;
@@ -35,14 +48,63 @@ struct json_value {
     long l_value;
     double d_value;
     char *str_value;
+    long *l_values; /* The elements of a JSON_PACKED_INT */
+    double *d_values; /* The elements of a JSON_PACKED_FLOAT */
+    struct json_object_index *index; /* Objects: either null or the index of the keys */
+    struct json_lazy_ref *lazy; /* Objects and arrays that have not been read yet */
   } value;
 };
 
+/* A block of memory owned by an arena.  The usable memory follows
+   the block header. */
+struct json_arena_block {
+  struct json_arena_block *next; /* Either null or the previous block */
+  size_t size; /* The number of usable bytes in this block */
+  size_t used; /* The number of bytes already handed out */
+};
+
+/* A bump allocator, used to carve json_values, child arrays and
+   strings from a small number of large blocks.  All of the memory is
+   released in one go, when the arena is freed, or kept for the next
+   document when the arena is reset. */
+struct json_arena {
+  struct json_arena_block *blocks; /* The current block is first */
+  struct json_arena_block *spare; /* Empty blocks kept by json_arena_reset */
+  size_t block_size; /* The default size of a new block */
+};
+
 /* A data structure to contain an array of pointers and the associated
    size of the pointer array. */
 struct json_data {
   struct json_value **json_values;
   unsigned int n_json_values;
+  unsigned int json_values_alloc; /* Number of pointer slots allocated */
+
+  /* Either null, or the arena that owns all of the json_values, child
+     arrays and strings of this json_data. */
+  struct json_arena *arena;
+
+  /* Non-zero if the strings point into the buffer that was read, by
+     json_read_ascii_buffer_insitu, rather than being allocated. */
+  int insitu;
+
+  /* Either null, or the structure of a document that was read by
+     json_read_ascii_buffer_lazy. */
+  struct json_lazy *lazy;
+
+  /* Non-zero if arrays of numbers are read as packed arrays, as set by
+     json_data_use_packed_arrays. */
+  int pack_arrays;
+
+  /* Either null, or the table that holds the keys of the objects, as
+     set by json_data_use_intern.  The table is not owned by the
+     json_data. */
+  struct json_intern *intern;
+
+  /* Either null, or the counters that the readers and writers update,
+     as set by json_data_use_stats.  The counters are not owned by the
+     json_data. */
+  struct json_stats *stats;
 };
 
 struct char_buffer {
@@ -56,6 +118,17 @@ struct char_buffer {
 /* A function to clear a json_value struct */
 void json_clear_value(struct json_value *);
 
+/* A function to clear a json_data struct.  This must be called before
+   a json_data struct is first used. */
+void json_data_clear(struct json_data *);
+
+/* Preallocate space for a number of json_values, for callers that know
+   roughly how many values a document contains.  The arguments are
+   (json_data, number of json_values).  When the json_data uses an
+   arena, space for the json_values themselves is reserved too.
+   Returns zero on success. */
+int json_data_reserve(struct json_data *, unsigned int);
+
 /* Returns a string representation of the given json_type. */
 const char* json_type_to_string(const unsigned int);
 
@@ -67,6 +140,14 @@ long json_find_child_index(const struct json_value *, const struct json_value *)
    json_value instances.  The arguments are (child, parent).*/
 int json_is_last_child(const struct json_value *, const struct json_value *);
 
+/* Functions to access the children of an object, array or pair.
+   These read the children of a container from a lazy json_data when
+   they are needed, and find none if they could not be read for want
+   of memory.  json_value_child returns null if the index is out of
+   range. */
+unsigned int json_value_nchildren(struct json_value *);
+struct json_value* json_value_child(struct json_value *, unsigned int);
+
 /* Print the json_value instance. */
 void json_print_value(const struct json_value *);
 
@@ -88,14 +169,66 @@ int json_check_type(const struct json_value *, const unsigned int);
    returns the number of json_values read. */
 size_t json_read_ascii_buffer(struct json_data *, const struct char_buffer *);
 
-
+/* A function to read a buffer that contains json in situ.  The
+   str_value of each string and key points into the buffer, rather
+   than to a copy, and is terminated by overwriting the closing quote.
+   The strings are kept as they appear in the buffer, with any escape
+   sequences, as for json_read_ascii_buffer.  The buffer therefore no
+   longer contains valid json, and must not be freed or changed before
+   the json_data is freed.  The json_data must be empty, or have been
+   read in situ.  The function returns the number of json_values
+   read. */
+size_t json_read_ascii_buffer_insitu(struct json_data *, struct char_buffer *);
+
+/* A function to read a file that contains json.  The arguments are
+   (json_data, path).  Regular files are memory mapped and parsed in
+   place, without copying them into a char_buffer.  Pipes and other
+   files that cannot be mapped are read in large blocks.  The function
+   returns the number of json_values read. */
+size_t json_read_ascii_file(struct json_data *, const char *);
+
+
+/* The flag in the mode of a writer that selects compact output, with
+   no white space between the tokens.  Each top-level value is still
+   followed by a newline.  The characters of the mode other than the
+   flags are passed on to fopen by json_write_file. */
+#define JSON_WRITE_COMPACT 'c'
+
+/* The flag in the mode of a writer that selects UBJSON rather than
+   ASCII json.  The values are written one after the other, with no
+   newlines, and the indent of json_write_tree is ignored. */
+#define JSON_WRITE_UBJSON 'u'
+
+/* Functions to write the json_data as ASCII json, or as UBJSON.  The
+   output is collected in large blocks, rather than written token by
+   token.  The mode selects the format and layout, and for
+   json_write_file it is also the mode of fopen, for example "w", "wc"
+   or "wu".  A json_data that was read with json_read_ascii_buffer_lazy
+   must first be read with json_lazy_expand_all.  The functions return
+   the number of json_values written, or zero if the output could not
+   be written. */
 size_t json_write_file(const char *filename, const char *mode, const struct json_data *);
 size_t json_write(FILE *, const char *mode, const struct json_data *);
+size_t json_write_fd(int fd, const char *mode, const struct json_data *);
 size_t json_write_tree(FILE *, const char *mode, const struct json_value *json_value, long indent);
 void json_print(const struct json_data *data);
 
+/* A function to write the json_data into memory.  The text is
+   appended to the char_buffer, which grows as needed, and is not
+   terminated.  The arguments are (char_buffer, mode, json_data). */
+size_t json_write_to_buffer(struct char_buffer *, const char *mode, const struct json_data *);
+
 /* Free all of the dynamically allocated memory associated with the
-   json_value tree.  The argument is an array of json values. */
+   json_value tree.  The argument is an array of json values.  If the
+   json_data uses an arena, then the blocks of the arena are freed
+   without visiting the individual json_values. */
 void json_free_value_array(struct json_data *);
 
+/* Remove all of the json_values, such that another document can be
+   read into the json_data.  The settings of the json_data are kept,
+   and so are its array of json_values and the blocks of its arena.  A
+   document that is no larger than the ones before it is then read
+   into an arena without calling malloc. */
+void json_data_reset(struct json_data *);
+
 #endif
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_stats.h"
+
+/* All allocations are aligned to this number of bytes, which is enough
+   for the pointers, longs and doubles stored in a json_value. */
+#define JSON_ARENA_ALIGN 8
+
+/* The size of the block header, rounded up to keep the data aligned. */
+#define JSON_ARENA_HEADER_SZ \
+  ((sizeof(struct json_arena_block) + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1))
+
+/* Functions that are used in this file, but are not declared in the header files. */
+struct json_arena_block* json_arena_new_block(size_t size);
+struct json_arena_block* json_arena_next_block(struct json_arena *arena, size_t size);
+void json_arena_free_blocks(struct json_arena_block *block);
+
+void json_arena_clear(struct json_arena *arena, size_t block_size) {
+  arena->blocks = 0;
+  arena->spare = 0;
+  arena->block_size = block_size ? block_size : JSON_ARENA_BLK_SZ;
+}
+
+void json_arena_free(struct json_arena *arena) {
+  json_arena_free_blocks(arena->blocks);
+  json_arena_free_blocks(arena->spare);
+  arena->blocks = 0;
+  arena->spare = 0;
+}
+
+void json_arena_reset(struct json_arena *arena) {
+  struct json_arena_block *block = arena->blocks;
+  struct json_arena_block *next = 0;
+  while(block) {
+    next = block->next;
+    block->used = 0;
+    block->next = arena->spare;
+    arena->spare = block;
+    block = next;
+  }
+  arena->blocks = 0;
+}
+
+void* json_arena_alloc(struct json_arena *arena, size_t size) {
+  struct json_arena_block *block = 0;
+  char *ptr = 0;
+
+  /* Round the request up, such that the next allocation is aligned. */
+  size = (size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+  if(!size) size = JSON_ARENA_ALIGN;
+
+  /* The fast path: bump the pointer within the current block. */
+  block = arena->blocks;
+  if(block && block->size - block->used >= size) {
+    ptr = (char*)block + JSON_ARENA_HEADER_SZ + block->used;
+    block->used += size;
+    return ptr;
+  }
+
+  /* Large allocations are given a block of their own.  The block is
+     linked in behind the current block, such that the free space in
+     the current block can still be used. */
+  if(size > arena->block_size/4) {
+    block = json_arena_next_block(arena, size);
+    if(!block) return 0;
+    block->used = size;
+    if(arena->blocks) {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    }
+    else {
+      arena->blocks = block;
+    }
+    return (char*)block + JSON_ARENA_HEADER_SZ;
+  }
+
+  /* Start a new block. */
+  block = json_arena_next_block(arena, arena->block_size);
+  if(!block) return 0;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  block->used = size;
+  return (char*)block + JSON_ARENA_HEADER_SZ;
+}
+
+int json_arena_reserve(struct json_arena *arena, size_t size) {
+  struct json_arena_block *block = arena->blocks;
+
+  if(block && block->size - block->used >= size) return 0;
+
+  block = json_arena_next_block(arena, size > arena->block_size ? size : arena->block_size);
+  if(!block) return 1;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  return 0;
+}
+
+void* json_arena_grow(struct json_arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  struct json_arena_block *block = arena->blocks;
+  char *new_ptr = 0;
+  size_t old_rounded = (old_size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+  size_t new_rounded = (new_size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+
+  if(!ptr) return json_arena_alloc(arena, new_size);
+  if(new_size <= old_size) return ptr;
+
+  /* If this was the last allocation in the current block, then try to
+     extend it in place. */
+  if(block && 
+     (char*)ptr + old_rounded == (char*)block + JSON_ARENA_HEADER_SZ + block->used &&
+     block->size - block->used >= new_rounded - old_rounded) {
+    block->used += new_rounded - old_rounded;
+    return ptr;
+  }
+
+  /* Otherwise copy the contents.  The old memory is released with the
+     rest of the arena. */
+  new_ptr = (char*)json_arena_alloc(arena, new_size);
+  if(!new_ptr) return 0;
+  memcpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+void json_arena_take(struct json_arena *arena, struct json_arena *other) {
+  struct json_arena_block *last = other->blocks;
+
+  if(!last) return;
+  if(!arena->blocks) {
+    arena->blocks = other->blocks;
+    other->blocks = 0;
+    return;
+  }
+
+  /* Link the other blocks in behind the current block. */
+  while(last->next) last = last->next;
+  last->next = arena->blocks->next;
+  arena->blocks->next = other->blocks;
+  other->blocks = 0;
+}
+
+int json_data_use_arena(struct json_data *json, size_t block_size) {
+  if(json->n_json_values || json->arena) {
+    fprintf(stderr, "Error: an arena must be selected before the json_data is used.\n");
+    return 1;
+  }
+  json->arena = (struct json_arena*)malloc(sizeof(struct json_arena));
+  if(!json->arena) {
+    fprintf(stderr, "Error: could not allocate a json_arena.\n");
+    return 2;
+  }
+  json_arena_clear(json->arena, block_size);
+  return 0;
+}
+
+void* json_data_alloc(struct json_data *json, size_t size) {
+  JSON_STATS_ADD(json->stats, allocations, 1);
+  JSON_STATS_ADD(json->stats, bytes_allocated, size);
+  if(json->arena) return json_arena_alloc(json->arena, size);
+  return malloc(size);
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to allocate a block with size usable bytes. */
+struct json_arena_block* json_arena_new_block(size_t size) {
+  struct json_arena_block *block = 0;
+  block = (struct json_arena_block*)malloc(JSON_ARENA_HEADER_SZ + size);
+  if(!block) {
+    fprintf(stderr, "Error: could not allocate an arena block of %lu bytes.\n", (unsigned long)size);
+    return 0;
+  }
+  block->next = 0;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+/* A function to find a block with at least size usable bytes, which
+   is a spare block if there is one that is large enough, or otherwise
+   a new block.  The block is not linked into the arena. */
+struct json_arena_block* json_arena_next_block(struct json_arena *arena, size_t size) {
+  struct json_arena_block **link = &arena->spare;
+  struct json_arena_block *block = 0;
+
+  while(*link) {
+    if((*link)->size >= size) {
+      block = *link;
+      *link = block->next;
+      block->next = 0;
+      return block;
+    }
+    link = &(*link)->next;
+  }
+  return json_arena_new_block(size);
+}
+
+/* A function to free a list of blocks. */
+void json_arena_free_blocks(struct json_arena_block *block) {
+  struct json_arena_block *next = 0;
+  while(block) {
+    next = block->next;
+    free(block);
+    block = next;
+  }
+}
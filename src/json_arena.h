@@ -0,0 +1,52 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include "json.h"
+
+/* The default size of an arena block.  Allocations that are larger
+   than a quarter of the block size are given a block of their own. */
+#define JSON_ARENA_BLK_SZ 1048576
+
+/* Zero all variables.  The arguments are (arena, block size).  A block
+   size of zero selects JSON_ARENA_BLK_SZ. */
+void json_arena_clear(struct json_arena *arena, size_t block_size);
+
+/* Free all of the blocks that belong to the arena. */
+void json_arena_free(struct json_arena *arena);
+
+/* Release all of the allocations at once, but keep the blocks, which
+   are handed out again before any new block is allocated.  The memory
+   of the arena stays at its peak until it is freed. */
+void json_arena_reset(struct json_arena *arena);
+
+/* Return a pointer to size bytes, carved from the current block.
+   Returns null if the memory could not be allocated. */
+void* json_arena_alloc(struct json_arena *arena, size_t size);
+
+/* Make sure that the current block has at least size free bytes, by
+   starting a larger block if necessary.  Returns zero on success. */
+int json_arena_reserve(struct json_arena *arena, size_t size);
+
+/* Grow an allocation that was returned by json_arena_alloc.  The
+   arguments are (arena, pointer, old size, new size).  The allocation
+   is extended in place when it is the last one in the current block,
+   otherwise the contents are copied to a new allocation. */
+void* json_arena_grow(struct json_arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/* Move all of the blocks of one arena into another, such that they
+   are freed with it.  The arguments are (arena, other arena).  The
+   other arena is left empty.  The current block of the arena stays
+   the current block. */
+void json_arena_take(struct json_arena *arena, struct json_arena *other);
+
+/* Switch a json_data into arena mode.  This must be called before
+   anything is read into the json_data.  The arguments are (json_data,
+   block size), where a block size of zero selects JSON_ARENA_BLK_SZ.
+   Returns zero on success. */
+int json_data_use_arena(struct json_data *json, size_t block_size);
+
+/* Allocate memory that is owned by the json_data.  This uses the
+   arena if there is one, or malloc otherwise. */
+void* json_data_alloc(struct json_data *json, size_t size);
+
+#endif
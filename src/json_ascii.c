@@ -3,29 +3,89 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "json.h"
 #include "json_ascii_utils.h"
-
-#ifdef DEBUG
+#include "json_arena.h"
+#include "json_binary.h"
+#include "json_intern.h"
+#include "json_scan.h"
+#include "json_lazy.h"
+#include "json_number.h"
+#include "json_object.h"
+#include "json_packed.h"
+#include "json_sink.h"
+#include "json_parser.h"
+#include "json_stats.h"
+
+/* Debugging output is compiled in with -DDEBUG or -DDEBUG=1. */
+#ifndef DEBUG
+#define DEBUG 0
+#endif
+#if DEBUG
 #define DEBUG_PRINT(x) fprintf(stderr, x)
 #else
 #define DEBUG_PRINT(x) do {} while (0)
 #endif
 
+/* The number of spaces per level of indent. */
+#define JSON_WRITE_INDENT 2
+
+/* The depth of nesting that the writer handles without allocating. */
+#define JSON_WRITE_STACK_SZ 64
+
+/* An object, array or pair that is being written, and the index of its
+   next child. */
+struct json_write_frame {
+  const struct json_value *jv;
+  unsigned int next_child;
+  long indent; /* The indent of the line on which the value starts */
+};
+
 /* Functions that are used in this file, but are not declared in the header files. */
 int test_buffer_size(unsigned int size_of_buffer, unsigned int index_within_buffer);
-struct json_value* json_string_value(char *tmp_buffer);
+size_t json_write_value(struct json_sink *sink, int compact, const struct json_value *jv, long indent);
+void json_write_token(struct json_sink *sink, int compact, const struct json_value *jv, long indent);
+void json_write_indent(struct json_sink *sink, long indent);
+struct json_value* json_string_value(struct json_data *json, const char *str, size_t str_len);
+struct json_value* json_insitu_string_value(struct json_data *json, const char *str, size_t str_len);
+struct json_value* json_key_value(struct json_data *json, const char *str, size_t str_len);
 int json_append_value(struct json_data *json, struct json_value *json_value);
 struct json_value* json_add_structure(struct json_data *json, int json_type);
-int json_add_element(struct json_value *jv_parent, struct json_value *jv);
-struct json_value* json_parse_value(struct json_data *json, const char *buffer);
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv);
+int json_parser_init_tree(struct json_parser *parser, struct json_data *json);
+int json_build_object_begin(void *ctx);
+int json_build_array_begin(void *ctx);
+int json_build_end(void *ctx);
+int json_build_key(void *ctx, const char *str, size_t n);
+int json_build_string(void *ctx, const char *str, size_t n);
+int json_build_int(void *ctx, long l);
+int json_build_float(void *ctx, double d);
+int json_build_bool(void *ctx, int b);
+int json_build_null(void *ctx);
+int json_build_structure(struct json_parser *parser, int json_type);
+int json_build_value(struct json_parser *parser, struct json_value *jv);
+int json_build_packs(const struct json_parser *parser, unsigned int json_type);
+void json_write_packed(struct json_sink *sink, int compact, const struct json_value *jv, long indent);
 
 /* Public functions. */
 size_t json_write_file(const char *path, const char *mode, const struct json_data *json) {
   FILE *fptr = 0;
   size_t values_written = 0;
-  fptr = fopen(path, mode);
+  char fopen_mode[16];
+  size_t i = 0, n = 0;
+
+  /* The mode is passed on to fopen, without the flags of the writer. */
+  for(i=0;mode[i] && n<sizeof(fopen_mode)-1;i++) {
+    if(mode[i] != JSON_WRITE_COMPACT && mode[i] != JSON_WRITE_UBJSON) fopen_mode[n++] = mode[i];
+  }
+  fopen_mode[n] = '\0';
+
+  fptr = fopen(path, fopen_mode);
   if(!fptr) return 0;
   values_written = json_write(fptr, mode, json);
   fclose(fptr);
@@ -37,12 +97,51 @@ void json_print(const struct json_data *json) {
 }
 
 size_t json_write(FILE *fptr, const char *mode, const struct json_data *json) {
+  struct json_sink sink;
+  size_t values_written = 0;
+  if(json_sink_init_file(&sink, fptr)) return 0;
+  values_written = json_write_sink(&sink, mode, json);
+  if(json_sink_finish(&sink)) return 0;
+  return values_written;
+}
+
+size_t json_write_fd(int fd, const char *mode, const struct json_data *json) {
+  struct json_sink sink;
+  size_t values_written = 0;
+  if(json_sink_init_fd(&sink, fd)) return 0;
+  values_written = json_write_sink(&sink, mode, json);
+  if(json_sink_finish(&sink)) return 0;
+  return values_written;
+}
+
+size_t json_write_to_buffer(struct char_buffer *buffer, const char *mode, const struct json_data *json) {
+  struct json_sink sink;
+  size_t values_written = 0;
+  if(json_sink_init_buffer(&sink, buffer)) return 0;
+  values_written = json_write_sink(&sink, mode, json);
+  if(json_sink_finish(&sink)) return 0;
+  return values_written;
+}
+
+size_t json_write_sink(struct json_sink *sink, const char *mode, const struct json_data *json) {
   unsigned int i = 0;
   size_t values_written = 0;
+  int compact = mode && strchr(mode, JSON_WRITE_COMPACT);
+  int ubjson = mode && strchr(mode, JSON_WRITE_UBJSON);
+#ifdef JSON_STATS
+  double write_start = 0;
+  size_t sink_start = 0;
+#endif
   if(!json) {
     fprintf(stderr, "Error: json_data pointer is a null.  No data written.\n");
     return 0;
   }
+#ifdef JSON_STATS
+  if(json->stats) {
+    write_start = json_stats_now();
+    sink_start = json_sink_tell(sink);
+  }
+#endif
   for(i=0;i<json->n_json_values;i++) {
     if(!(json->json_values[i])) {
       fprintf(stderr, "Warning: json_value[%u] is a null pointer.\n",i);
@@ -51,361 +150,493 @@ size_t json_write(FILE *fptr, const char *mode, const struct json_data *json) {
 
     /* Only write the trees for json_values that do not have a parent. */
     if(!(json->json_values[i]->parent)) {
-      values_written += json_write_tree(fptr, mode, json->json_values[i], 0);
+      if(ubjson) values_written += json_write_ubjson_value(sink, json->json_values[i]);
+      else values_written += json_write_value(sink, compact, json->json_values[i], 0);
     }
   }
+#ifdef JSON_STATS
+  if(json->stats) {
+    json->stats->write_seconds += json_stats_now() - write_start;
+    json->stats->bytes_written += json_sink_tell(sink) - sink_start;
+  }
+#endif
   return values_written;
 }
 
-
 size_t json_write_tree(FILE *fptr, const char *mode, const struct json_value *jv, long indent){
+  struct json_sink sink;
   size_t json_values_written = 0;
-  long i;
-  long indent_next = indent;
-  long indent_reduction = 0;
-  const struct json_value *jv_parent_tmp = 0;
-  const struct json_value *jv_child_tmp = 0;
+  if(json_sink_init_file(&sink, fptr)) return 0;
+  if(mode && strchr(mode, JSON_WRITE_UBJSON)) json_values_written = json_write_ubjson_value(&sink, jv);
+  else json_values_written = json_write_value(&sink, mode && strchr(mode, JSON_WRITE_COMPACT), jv, indent);
+  if(json_sink_finish(&sink)) return 0;
+  return json_values_written;
+}
 
-  int print_indent = 0, print_newline = 0;
+/* A function to parse an ASCII buffer that contains json.  The whole
+   buffer is fed to a parser as a single chunk. */
+size_t json_read_ascii_buffer(struct json_data *json, const struct char_buffer *buffer) {
+  struct json_parser parser;
+  size_t json_values_read = 0;
 
-  const long indent_step = 2;
+  if(json_parser_init(&parser, json)) return 0;
+  json_parser_feed(&parser, buffer->buffer, buffer->size);
+  json_values_read = json_parser_finish(&parser);
+  json_parser_free(&parser);
 
-  /* The pointer must not be null */
-  if(!jv) return 0;
+  /* Return the number of json_values read */
+  return json_values_read;
+}
 
-  /* Check if a newline should be printed or not */
-  if((jv->json_type == JSON_OBJECT ||
-      jv->json_type == JSON_ARRAY))
-    indent_next += indent_step;
+/* The tree is built from the events of the parser. */
+static const struct json_callbacks json_build_callbacks = {
+  json_build_object_begin,
+  json_build_end,
+  json_build_array_begin,
+  json_build_end,
+  json_build_key,
+  json_build_string,
+  json_build_int,
+  json_build_float,
+  json_build_bool,
+  json_build_null
+};
+
+int json_parser_init(struct json_parser *parser, struct json_data *json) {
+  if(json->insitu) {
+    fprintf(stderr, "Error: a json_data that was read in situ can only be read in situ.\n");
+    return 1;
+  }
+  return json_parser_init_tree(parser, json);
+}
 
-  /* Check if an indent should be printed or not */
-  if(jv->parent) {
-    if((jv->parent->json_type == JSON_OBJECT || 
-	jv->parent->json_type == JSON_ARRAY)){
-      print_indent = 1;
-      print_newline = 1;
+size_t json_parser_finish(struct json_parser *parser) {
+#ifdef JSON_STATS
+  unsigned int i = 0;
+#endif
+  if(json_parser_end(parser)) return 0;
+
+#ifdef JSON_STATS
+  /* Count the json_values that were read, by type. */
+  if(parser->stats) {
+    for(i=parser->first_value;i<parser->json->n_json_values;i++) {
+      if(parser->json->json_values[i]->json_type < JSON_STATS_N_TYPES) {
+	parser->stats->nodes[parser->json->json_values[i]->json_type]++;
+      }
     }
   }
+#endif
 
-  if(print_newline) fprintf(fptr, "\n");
+  /* Return the number of json_values read */
+  return parser->json->n_json_values;
+}
 
-  /* Print the indent if needed. */
-  if(print_indent) {
-    for(i=0;i<indent;i++) {
-      fprintf(fptr, " ");
-    }
+/* A function to parse an ASCII buffer in situ.  The buffer is fed as a
+   single chunk, such that every string is reported where it lies in
+   the buffer rather than from the temporary buffer of the parser. */
+size_t json_read_ascii_buffer_insitu(struct json_data *json, struct char_buffer *buffer) {
+  struct json_parser parser;
+  size_t json_values_read = 0;
+  int was_insitu = json->insitu;
+
+  if(json->n_json_values && !json->insitu) {
+    fprintf(stderr, "Error: a json_data that contains copied strings cannot be read in situ.\n");
+    return 0;
   }
 
-  /* Print the values */
-  if(jv->json_type == JSON_OBJECT) fprintf(fptr, "{");
-  else if(jv->json_type == JSON_ARRAY) fprintf(fptr, "[");
-  else if(jv->json_type == JSON_PAIR) fprintf(fptr, "\"%s\": ", jv->value.str_value);
-  else if(jv->json_type == JSON_STRING) fprintf(fptr, "\"%s\"", jv->value.str_value);
-  else if(jv->json_type == JSON_INT) fprintf(fptr, "%ld", jv->value.l_value);
-  else if(jv->json_type == JSON_FLOAT) fprintf(fptr, "%lf", jv->value.d_value);
-  else if(jv->json_type == JSON_BOOLEAN) {
-    if(jv->value.b_value) fprintf(fptr, "true");
-    else fprintf(fptr, "false");
+  if(json_parser_init_tree(&parser, json)) return 0;
+  json->insitu = 1;
+  json_parser_feed(&parser, buffer->buffer, buffer->size);
+  json_values_read = json_parser_finish(&parser);
+  json_parser_free(&parser);
+
+  /* A json_data that was empty is emptied again if the read failed,
+     such that it is no longer marked as read in situ.  The strings are
+     not freed, as the flag is still set. */
+  if(!json_values_read && !was_insitu) json_data_reset(json);
+
+  /* Return the number of json_values read */
+  return json_values_read;
+}
+
+/* A function to read a file that contains json. */
+size_t json_read_ascii_file(struct json_data *json, const char *path) {
+  struct char_buffer buffer;
+  struct stat file_stat;
+  void *mapping = MAP_FAILED;
+  size_t json_values_read = 0;
+  int fd = -1;
+
+  char_buffer_clear(&buffer);
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    fprintf(stderr, "Error: could not open %s\n", path);
+    return 0;
   }
-  else if(jv->json_type == JSON_NULL) fprintf(fptr, "null");
-  else { 
-    fprintf(fptr, "Error: json_type=%u is out of range", jv->json_type);
-    assert(0);
+  if(fstat(fd, &file_stat)) {
+    fprintf(stderr, "Error: could not stat %s\n", path);
+    close(fd);
+    return 0;
   }
 
-  /* Print all of the children of this json_value */
-  for(i=0;i<jv->nchildren;i++) {
-    json_values_written += json_write_tree(fptr, mode, jv->children[i], indent_next);
-  }
-
-  /* Handle the trailing characters, if this is the end of an array or
-     object.  Only start appending trailing characters when the bottom
-     of the tree has been reached. */
-  if(jv->nchildren == 0) {
-    indent_reduction = 0;
-    jv_parent_tmp = jv->parent;
-    jv_child_tmp = jv;
-    while(jv_parent_tmp && jv_child_tmp) {
-      
-      if(!json_is_last_child(jv_child_tmp, jv_parent_tmp)) {
-	if(jv_parent_tmp->json_type == JSON_OBJECT ||
-	   jv_parent_tmp->json_type == JSON_ARRAY) {
-	  fprintf(fptr, ",");
-	}
-	break;
-      }
-      
-      if(jv_parent_tmp->json_type == JSON_OBJECT ||
-	 jv_parent_tmp->json_type == JSON_ARRAY) {
-	
-	fprintf(fptr, "\n");
-	/* Using longs, to catch a potential error where the indent
-	   becomes negative. */
-	for(i=0;i<(indent-indent_reduction);i++) {
-	  fprintf(fptr, " ");
-	}
-	if(jv_parent_tmp->json_type == JSON_OBJECT) {
-	  fprintf(fptr, "}");
-	}
-	else if(jv_parent_tmp->json_type == JSON_ARRAY) {
-	  fprintf(fptr, "]");
-	}
-      }
-      
-      /* Reduce the indent */
-      indent_reduction += indent_step;
-      
-      /* Navigate back up the tree */
-      jv_child_tmp = jv_parent_tmp;
-      jv_parent_tmp = jv_parent_tmp->parent;
+  /* Map regular files, and tell the kernel that the mapping will be
+     read from beginning to end. */
+  if(S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+    mapping = mmap(0, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+      madvise(mapping, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+#endif
+      close(fd);
+
+      /* The parser does not write to the buffer. */
+      buffer.buffer = (char*)mapping;
+      buffer.size = (unsigned long)file_stat.st_size;
+      buffer.position = buffer.size;
+      json_values_read = json_read_ascii_buffer(json, &buffer);
+      munmap(mapping, (size_t)file_stat.st_size);
+      return json_values_read;
     }
   }
 
-  /* Print the final newline */
-  if(!jv->parent) {
-    fprintf(fptr, "\n");
+  /* Otherwise, read the file in large blocks. */
+  if(char_buffer_read_fd(&buffer, fd) || char_buffer_shrink_to_fit(&buffer)) {
+    char_buffer_free(&buffer);
+    close(fd);
+    return 0;
   }
+  close(fd);
 
-  /* Add one for this json_value */
-  json_values_written++;
+  json_values_read = json_read_ascii_buffer(json, &buffer);
+  char_buffer_free(&buffer);
+  return json_values_read;
+}
 
-  return json_values_written;
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to prepare a parser to build a tree in a json_data,
+   which both the copying and the in situ readers use. */
+int json_parser_init_tree(struct json_parser *parser, struct json_data *json) {
+  if(json_parser_init_callbacks(parser, &json_build_callbacks, parser)) return 1;
+  parser->json = json;
+  parser->jv_parent = 0;
+  parser->first_value = json->n_json_values;
+  parser->stats = json->stats;
+  return 0;
 }
 
-/* A function to parse an ASCII buffer that contains json. */
-size_t json_read_ascii_buffer(struct json_data *json, const struct char_buffer *buffer) {
-  char* tmp_buffer = 0;
-  unsigned int size_of_tmp_buffer = 0;
-  unsigned int i = 0;
-  unsigned int i_tmp = 0;
-  int quote;
-  int reading_str;
-  
-  struct json_value *jv_parent = 0;
-  struct json_value *jv = 0;
+/* A function to write a tree, without recursion.  The stack holds the
+   objects, arrays and pairs that are being written, with the index of
+   the next child of each, such that a comma or a closing bracket
+   follows without searching the children of the parent.  The argument
+   indent is the indent of the line on which the tree starts.  Returns
+   the number of json_values written. */
+size_t json_write_value(struct json_sink *sink, int compact, const struct json_value *jv, long indent){
+  struct json_write_frame stack_buffer[JSON_WRITE_STACK_SZ];
+  struct json_write_frame *stack = stack_buffer;
+  struct json_write_frame *realloc_stack = 0;
+  struct json_write_frame *top = 0;
+  size_t depth = 0, size_of_stack = JSON_WRITE_STACK_SZ;
+  size_t json_values_written = 0;
+  const struct json_value *child = 0;
+  long child_indent = 0;
 
-  /* Create a buffer to collect string components.  In the case where
-     the file contains one long string, this will be the same size as
-     the file buffer.  The buffer needs to be one character bigger, to
-     allow for a string terminator to be added. */
-  size_of_tmp_buffer = buffer->size+1;
-  tmp_buffer = (char*)malloc(size_of_tmp_buffer*sizeof(char));
-  if(!tmp_buffer) {
-    printf("Error: could not allocate temporary buffer to parse this file.");
-    return 0;
+  /* The pointer must not be null */
+  if(!jv) return 0;
+
+  json_write_token(sink, compact, jv, indent);
+  json_values_written++;
+  if(jv->nchildren) {
+    stack[0].jv = jv;
+    stack[0].next_child = 0;
+    stack[0].indent = indent;
+    depth = 1;
   }
-  
-  /* Reset the flags. */
-  reading_str = 0;
-  quote = 0;
-  for(i=0;i<buffer->size;i++) {
-    
-    /* First check to see if a string has been reached.  The
-       punctuation that describes a json file can be inside a string.
-       Therefore, the string case needs to be dealt with first. */
-    quote = 0;
-    if(buffer->buffer[i] == '"') {
-      quote = 1;
-      
-      /* Check if this is an escaped " character or not. */
-      if((i-1) > 0) {
-	if(buffer->buffer[i-1] == '\\') {
-	  quote = 0;
+
+  while(depth && !sink->status) {
+    top = &stack[depth-1];
+
+    /* All of the children have been written, so close the object or
+       array.  A pair has nothing to close. */
+    if(top->next_child == top->jv->nchildren) {
+      if(top->jv->json_type == JSON_OBJECT || top->jv->json_type == JSON_ARRAY) {
+	if(!compact) {
+	  json_sink_putc(sink, '\n');
+	  json_write_indent(sink, top->indent);
 	}
+	json_sink_putc(sink, top->jv->json_type == JSON_OBJECT ? '}' : ']');
       }
-    }
-    
-    /* If this is a string quote, then either close or open the string. */
-    if(quote) {
-      
-      /* If a string is being read, then finish the string. */
-      if(reading_str) {
-	assert(!test_buffer_size(size_of_tmp_buffer, i_tmp));
-	
-	/* Add the string terminator */
-	tmp_buffer[i_tmp] = '\0';
-	
-	DEBUG_PRINT("Creating a string: ");
-	jv = json_string_value(tmp_buffer);
-	if(DEBUG) json_print_value(jv);
-	assert(jv);
-
-	/* Add the json_value to the json_data json, since the
-	   top-level json value will not have a parent. */
-	assert(!json_append_value(json, jv));
-	
-	/* Set the reading string flag to zero. */
-	reading_str = 0;
-	
-	/* Set the temporary string index to zero. */
-	i_tmp = 0;
-      }
-      else {
-	/* Set the reading string flag. */
-	reading_str = 1;
-      }
-      continue; /* Skip this " character */
-    }
-    
-    
-    /* If a string is being read */
-    if(reading_str) {
-      assert(!test_buffer_size(size_of_tmp_buffer, i_tmp));
-      
-      /* Store this character in the temporary buffer. */
-      tmp_buffer[i_tmp] = buffer->buffer[i];
-      
-      /* Increment the temporary buffer. */
-      i_tmp++;
-      
-      /* This is a string.  Therefore, do not check for json punctuation. */
+      depth--;
       continue;
     }
 
-    /* Check for the beginning of an object. */
-    if(buffer->buffer[i] == '{'){
-      DEBUG_PRINT("Creating an object: ");
-      jv = json_add_structure(json, JSON_OBJECT);
-      if(DEBUG) json_print_value(jv);
-      assert(!json_add_element(jv_parent, jv));
-      jv_parent = jv; /* Prepare to collect elements. */
-      jv = 0; /* Clear to prevent it being reused. */
-    }
-
-    /* Check for the beginning of an array. */
-    else if(buffer->buffer[i] == '['){
-      DEBUG_PRINT("Creating an array: ");
-      jv = json_add_structure(json, JSON_ARRAY);
-      if(DEBUG) json_print_value(jv);
-      assert(!json_add_element(jv_parent, jv));
-      jv_parent = jv; /* Prepare to collect elements. */
-      jv = 0; /* Clear to prevent it being reused. */
-    }
-    
-    /* Check for the end of a json value, which can be triggered by:
-       the end of an object,
-       the end of an array,
-       the separator in a pair,
-       the end of an element of an array,
-       or a white space character or new line */
-    else if(buffer->buffer[i] == '}' ||
-	    buffer->buffer[i] == ']' ||
-	    buffer->buffer[i] == ',' ||
-	    buffer->buffer[i] == ':' ||
-	    buffer->buffer[i] == ' ' ||
-	    buffer->buffer[i] == '\t' ||
-	    buffer->buffer[i] == '\n'){
-      
-      /* If the tmp string has a non-zero length, create a new json
-	 value. */
-      if(i_tmp > 0) {
-	
-	/* Check to make sure that the next index is not outside the
-	   temporary buffer. */
-	assert(!test_buffer_size(size_of_tmp_buffer, i_tmp));
-	
-	/* Add the string terminator */
-	tmp_buffer[i_tmp] = '\0';
-	
-	/* Parse the string */
-	jv = json_parse_value(json, tmp_buffer);
-	assert(jv);
-	
-	/* Set the temporary string index to zero. */
-	i_tmp = 0;
-      }
-     
-      /* A colon indicates that this is a pair */
-      if(buffer->buffer[i] == ':'){
-	DEBUG_PRINT("Creating a pair: ");
-	jv->json_type = JSON_PAIR; /* Change the type to a pair. */
-	if(DEBUG) json_print_value(jv);
-	assert(!json_add_element(jv_parent, jv));
-	jv_parent = jv; /* Prepare to collect an element. */
-	jv = 0; /* Clear to prevent it being reused. */
+    /* The children of an object or an array are separated by commas,
+       and start on lines of their own.  The value of a pair follows
+       the key. */
+    child = top->jv->children[top->next_child];
+    child_indent = top->indent;
+    if(top->jv->json_type == JSON_OBJECT || top->jv->json_type == JSON_ARRAY) {
+      if(top->next_child) json_sink_putc(sink, ',');
+      child_indent += JSON_WRITE_INDENT;
+      if(!compact) {
+	json_sink_putc(sink, '\n');
+	json_write_indent(sink, child_indent);
       }
-      
-      /* A comma is used to separate elements within arrays and
-	 objects. */
-      else if(buffer->buffer[i] == ','){
-
-	/* In the case of an array or an object, the object is added
-	   to the parent when it is first opened.  Therefore, the jv
-	   value will be null here.  For other values, the jv value
-	   should not be null. */
-	if(jv) {
-	  DEBUG_PRINT("Adding an element to current parent\n");
-	  assert(!json_add_element(jv_parent, jv));
-	  jv = 0; /* Clear to prevent it being reused. */
-	}
-
-	/* If this is an element of a pair, then go back to the
-	   parent of the pair. */
-	if(jv_parent) {
-	  if(jv_parent->json_type == JSON_PAIR) {
-	    jv_parent = jv_parent->parent;
-	  }
-	}
-      }
-      else if(buffer->buffer[i] == ']' ||
-	      buffer->buffer[i] == '}'){
-
-	/* If there is a current json_value that has not been added,
-	   then add it to the tree.  When a json array or object is
-	   empty, the jv will be null since it will be set to null
-	   after the array or object is added. */
-	if(jv) {
-	  assert(!json_add_element(jv_parent, jv));
-	  jv = 0; /* Clear to prevent it being reused. */
-	}
+    }
+    top->next_child++;
 
-	/* If this is an element of a pair, then go back to the
-	   parent of the pair. */
-	if(jv_parent) {
-	  if(jv_parent->json_type == JSON_PAIR) {
-	    jv_parent = jv_parent->parent;
-	  }
-	}
-	
-	/* A ']' character closes an array */
-	if(buffer->buffer[i] == ']'){
-	  DEBUG_PRINT("Array completed.  Going back to the parent.\n");
-	  assert(!json_check_type(jv_parent, JSON_ARRAY));
-	  jv_parent = jv_parent->parent; /* Navigate back up the tree */
-	}
+    json_write_token(sink, compact, child, child_indent);
+    json_values_written++;
+    if(!child->nchildren) continue;
 
-	/* A '}' character closes an object */
-	else if(buffer->buffer[i] == '}'){
-	  DEBUG_PRINT("Object completed. Going back to the parent.\n");
-	  assert(!json_check_type(jv_parent, JSON_OBJECT));
-	  jv_parent = jv_parent->parent; /* Navigate back up the tree */
-	}
+    /* Descend into the child. */
+    if(depth == size_of_stack) {
+      if(stack == stack_buffer) {
+	realloc_stack = (struct json_write_frame*)malloc(2*size_of_stack*sizeof(struct json_write_frame));
+	if(realloc_stack) memcpy(realloc_stack, stack, depth*sizeof(struct json_write_frame));
       }
       else {
-	/* Skip the white space characters */
-	continue;
+	realloc_stack = (struct json_write_frame*)realloc(stack, 2*size_of_stack*sizeof(struct json_write_frame));
+      }
+      if(!realloc_stack) {
+	fprintf(stderr, "Error: could not allocate memory for the stack of the writer.\n");
+	if(stack != stack_buffer) free(stack);
+	return 0;
       }
+      stack = realloc_stack;
+      size_of_stack *= 2;
     }
-    else {
-      assert(!test_buffer_size(size_of_tmp_buffer, i_tmp));
-      
-      /* Store this character in the temporary buffer. */
-      tmp_buffer[i_tmp] = buffer->buffer[i];
-      
-      /* Increment the temporary buffer. */
-      i_tmp++;
+    stack[depth].jv = child;
+    stack[depth].next_child = 0;
+    stack[depth].indent = child_indent;
+    depth++;
+  }
+  if(stack != stack_buffer) free(stack);
+
+  /* Print the final newline */
+  if(!jv->parent) {
+    json_sink_putc(sink, '\n');
+  }
+
+  return json_values_written;
+}
+
+/* A function to write the text of one json_value: a scalar, a key
+   with its colon, or the opening bracket of an object or array.  An
+   empty object or array is closed straight away.  An object or array
+   that is read on demand, and has not been read yet, stops the
+   writer.  A packed array is written whole, with its elements laid
+   out as those of an array that starts at the indent. */
+void json_write_token(struct json_sink *sink, int compact, const struct json_value *jv, long indent) {
+  char *number_buffer = 0;
+
+  if(json_lazy_pending(jv)) {
+    if(!sink->status) fprintf(stderr, "Error: an object or array that is read on demand must be read with json_lazy_expand_all before it is written.\n");
+    sink->status = 1;
+  }
+
+  if(jv->json_type == JSON_OBJECT) json_sink_write(sink, "{}", jv->nchildren ? 1 : 2);
+  else if(jv->json_type == JSON_ARRAY) json_sink_write(sink, "[]", jv->nchildren ? 1 : 2);
+  else if(jv->json_type == JSON_PAIR || jv->json_type == JSON_STRING) {
+    json_sink_putc(sink, '"');
+    json_sink_write(sink, jv->value.str_value, jv->str_len);
+    if(jv->json_type == JSON_PAIR) json_sink_write(sink, "\": ", compact ? 2 : 3);
+    else json_sink_putc(sink, '"');
+  }
+  else if(jv->json_type == JSON_INT) {
+    number_buffer = json_sink_reserve(sink, JSON_NUMBER_MAX_SZ);
+    if(number_buffer) sink->position += json_format_int(jv->value.l_value, number_buffer);
+  }
+  else if(jv->json_type == JSON_FLOAT) {
+    number_buffer = json_sink_reserve(sink, JSON_NUMBER_MAX_SZ);
+    if(number_buffer) sink->position += json_format_double(jv->value.d_value, number_buffer);
+  }
+  else if(jv->json_type == JSON_BOOLEAN) {
+    if(jv->value.b_value) json_sink_write(sink, "true", 4);
+    else json_sink_write(sink, "false", 5);
+  }
+  else if(jv->json_type == JSON_NULL) json_sink_write(sink, "null", 4);
+  else if(json_is_packed(jv)) json_write_packed(sink, compact, jv, indent);
+  else { 
+    fprintf(stderr, "Error: json_type=%u is out of range", jv->json_type);
+    assert(0);
+  }
+}
+
+/* A function to write the elements of a packed array. */
+void json_write_packed(struct json_sink *sink, int compact, const struct json_value *jv, long indent) {
+  char *number_buffer = 0;
+  unsigned int i;
+
+  if(!jv->str_len) {
+    json_sink_write(sink, "[]", 2);
+    return;
+  }
+
+  json_sink_putc(sink, '[');
+  for(i=0;i<jv->str_len;i++) {
+    if(i) json_sink_putc(sink, ',');
+    if(!compact) {
+      json_sink_putc(sink, '\n');
+      json_write_indent(sink, indent + JSON_WRITE_INDENT);
     }
+    number_buffer = json_sink_reserve(sink, JSON_NUMBER_MAX_SZ);
+    if(!number_buffer) return;
+    if(jv->json_type == JSON_PACKED_INT) sink->position += json_format_int(jv->value.l_values[i], number_buffer);
+    else sink->position += json_format_double(jv->value.d_values[i], number_buffer);
+  }
+  if(!compact) {
+    json_sink_putc(sink, '\n');
+    json_write_indent(sink, indent);
+  }
+  json_sink_putc(sink, ']');
+}
+
+/* A function to write a number of spaces.  A negative number writes
+   nothing. */
+void json_write_indent(struct json_sink *sink, long indent) {
+  static const char spaces[] = "                                                                ";
+  long n = 0;
+  while(indent > 0) {
+    n = indent < (long)(sizeof(spaces)-1) ? indent : (long)(sizeof(spaces)-1);
+    json_sink_write(sink, spaces, (size_t)n);
+    indent -= n;
   }
+}
 
-  /* Free the memory associated with the temporary buffer */
-  free(tmp_buffer);
 
-  /* Return the number of json_values read */
-  return json->n_json_values;
+/* Functions that build the tree from the events of the parser.  The
+   context pointer is the parser. */
+int json_build_object_begin(void *ctx) {
+  return json_build_structure((struct json_parser*)ctx, JSON_OBJECT);
 }
 
-/*======================================================*/
-/* Functions that are not declared in the header files. */
+int json_build_array_begin(void *ctx) {
+  return json_build_structure((struct json_parser*)ctx, JSON_ARRAY);
+}
+
+int json_build_end(void *ctx) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  DEBUG_PRINT("Array or object completed.  Going back to the parent.\n");
+  if(json_is_packed(parser->jv_parent)) json_packed_shrink(parser->json, parser->jv_parent);
+  parser->jv_parent = parser->jv_parent->parent; /* Navigate back up the tree */
+
+  /* If this is the value of a pair, then go back to the parent of the
+     pair. */
+  if(parser->jv_parent && parser->jv_parent->json_type == JSON_PAIR) {
+    parser->jv_parent = parser->jv_parent->parent;
+  }
+  return 0;
+}
+
+int json_build_key(void *ctx, const char *str, size_t n) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = 0;
+
+  DEBUG_PRINT("Creating a pair: ");
+  if(parser->json->insitu && !parser->json->intern) jv = json_insitu_string_value(parser->json, str, n);
+  else jv = json_key_value(parser->json, str, n);
+  if(!jv || json_append_value(parser->json, jv)) return 1;
+  jv->json_type = JSON_PAIR; /* Change the type to a pair. */
+  if(DEBUG) json_print_value(jv);
+  if(json_add_element(parser->json, parser->jv_parent, jv)) return 1;
+  parser->jv_parent = jv; /* Prepare to collect an element. */
+  return 0;
+}
+
+int json_build_string(void *ctx, const char *str, size_t n) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = 0;
+
+  DEBUG_PRINT("Creating a string: ");
+  if(parser->json->insitu) jv = json_insitu_string_value(parser->json, str, n);
+  else jv = json_string_value(parser->json, str, n);
+  if(DEBUG) json_print_value(jv);
+
+  /* Add the json_value to the json_data json, since the top-level
+     json value will not have a parent. */
+  if(!jv || json_append_value(parser->json, jv)) return 1;
+  return json_build_value(parser, jv);
+}
+
+int json_build_int(void *ctx, long l) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = 0;
+  if(json_build_packs(parser, JSON_PACKED_INT)) return json_packed_append_int(parser->json, parser->jv_parent, l);
+  jv = json_add_structure(parser->json, JSON_INT);
+  if(!jv) return 1;
+  jv->value.l_value = l;
+  return json_build_value(parser, jv);
+}
+
+int json_build_float(void *ctx, double d) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = 0;
+  if(json_build_packs(parser, JSON_PACKED_FLOAT)) return json_packed_append_float(parser->json, parser->jv_parent, d);
+  jv = json_add_structure(parser->json, JSON_FLOAT);
+  if(!jv) return 1;
+  jv->value.d_value = d;
+  return json_build_value(parser, jv);
+}
+
+int json_build_bool(void *ctx, int b) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = json_add_structure(parser->json, JSON_BOOLEAN);
+  if(!jv) return 1;
+  jv->value.b_value = b;
+  return json_build_value(parser, jv);
+}
+
+int json_build_null(void *ctx) {
+  struct json_parser *parser = (struct json_parser*)ctx;
+  struct json_value *jv = json_add_structure(parser->json, JSON_NULL);
+  if(!jv) return 1;
+  return json_build_value(parser, jv);
+}
+
+/* A function to add an object or an array to the tree, and collect its
+   elements. */
+int json_build_structure(struct json_parser *parser, int json_type) {
+  struct json_value *jv = 0;
+
+  DEBUG_PRINT("Creating an object or array: ");
+  if(parser->jv_parent && json_is_packed(parser->jv_parent) &&
+     json_unpack_array(parser->json, parser->jv_parent)) return 1;
+  jv = json_add_structure(parser->json, json_type);
+  if(DEBUG) json_print_value(jv);
+  if(!jv || json_add_element(parser->json, parser->jv_parent, jv)) return 1;
+  parser->jv_parent = jv; /* Prepare to collect elements. */
+  return 0;
+}
+
+/* A function to add a string, number, true, false or null to the
+   tree. */
+int json_build_value(struct json_parser *parser, struct json_value *jv) {
+  /* A packed array that meets any other value becomes an ordinary
+     array. */
+  if(parser->jv_parent && json_is_packed(parser->jv_parent) &&
+     json_unpack_array(parser->json, parser->jv_parent)) return 1;
+  if(json_add_element(parser->json, parser->jv_parent, jv)) return 1;
+
+  /* If this is the value of a pair, then go back to the parent of the
+     pair. */
+  if(parser->jv_parent && parser->jv_parent->json_type == JSON_PAIR) {
+    parser->jv_parent = parser->jv_parent->parent;
+  }
+  return 0;
+}
+
+/* A function to check whether a number is appended to a packed array,
+   which is either the packed array being filled or an array that has
+   no elements yet.  The arguments are (parser, json_type of the packed
+   array).  Returns non-zero if the number is packed. */
+int json_build_packs(const struct json_parser *parser, unsigned int json_type) {
+  const struct json_value *jv = parser->jv_parent;
+  if(!parser->json->pack_arrays || !jv) return 0;
+  return jv->json_type == json_type || (jv->json_type == JSON_ARRAY && !jv->nchildren && !jv->children);
+}
 
 /* A function to check if an index is smaller than another index. */
 int test_buffer_size(unsigned int size_of_buffer,
@@ -427,13 +658,13 @@ void clean_escaped_quote(char *str) {
   memmove(pos, pos+1, strlen(str)-1);
 }
 
-/* A function to create a json_value that contains a string. */
-struct json_value* json_string_value(char *tmp_buffer){
+/* A function to create a json_value that contains a string.  The
+   arguments are (json_data, first character, number of characters). */
+struct json_value* json_string_value(struct json_data *json, const char *str, size_t str_len){
   struct json_value *jv = 0;
-  unsigned int str_len;
 
   /* Create a pointer to hold the dynamically allocated json_value */
-  jv = (struct json_value*)malloc(sizeof (struct json_value));
+  jv = (struct json_value*)json_data_alloc(json, sizeof (struct json_value));
   if(!jv) {
     printf("Error: could not allocate a json_value.");
     return jv;
@@ -441,83 +672,81 @@ struct json_value* json_string_value(char *tmp_buffer){
   json_clear_value(jv);
 
   jv->json_type = JSON_STRING;
-  str_len = strlen(tmp_buffer); /* The length of the string */
 
   /* Create a character array that is just big enough to hold the string. */
-  jv->value.str_value = (char *)malloc((str_len+1)*sizeof(char));
+  jv->value.str_value = (char *)json_data_alloc(json, (str_len+1)*sizeof(char));
   if(!jv->value.str_value) {
     printf("Error: could not allocate memory for json_value string.\n");
+    if(!json->arena) free(jv);
     return 0;
   }
   
   /* Copy the string value into place. */
-  strcpy(jv->value.str_value, tmp_buffer);
+  memcpy(jv->value.str_value, str, str_len);
+  jv->value.str_value[str_len] = '\0';
+  jv->str_len = (unsigned int)str_len;
 
   return jv;
 }
 
-/* A function to parse a piece of ascii text and create a
-   json_value */
-struct json_value* json_parse_value(struct json_data *json, const char *buffer){
-  int base = 0;  
+/* A function to create a json_value that refers to a string in the
+   buffer that is being read in situ.  The closing quote follows the
+   string, and is replaced by the terminator.  The parser has already
+   classified the characters of the current window, so it does not
+   read the quote again. */
+struct json_value* json_insitu_string_value(struct json_data *json, const char *str, size_t str_len){
   struct json_value *jv = 0;
 
-  jv = (struct json_value*)malloc(sizeof(struct json_value));
+  jv = (struct json_value*)json_data_alloc(json, sizeof (struct json_value));
   if(!jv) {
-    printf("Error: could not allocate a json_value\n");
-    return 0;
+    printf("Error: could not allocate a json_value.");
+    return jv;
   }
   json_clear_value(jv);
 
-  /* Check if this is a null */
-  if(!strcmp(buffer, "null")) {
-    jv->json_type = JSON_NULL;
-  }
+  jv->json_type = JSON_STRING;
+  jv->value.str_value = (char*)str;
+  jv->value.str_value[str_len] = '\0';
+  jv->str_len = (unsigned int)str_len;
 
-  /* Check if this is true */
-  else if(!strcmp(buffer, "true")) {
-    jv->value.b_value = 1;
-    jv->json_type = JSON_BOOLEAN;
-  }
+  return jv;
+}
 
-  /* Check if this is false */
-  else if(!strcmp(buffer, "false")) {
-    jv->value.b_value = 0;
-    jv->json_type = JSON_BOOLEAN;
-  }
+/* A function to create a json_value for the key of a pair.  If the
+   json_data uses an interning table, the str_value is the canonical
+   copy of the key in the table, and otherwise it is a copy of its
+   own.  The arguments are (json_data, first character, number of
+   characters). */
+struct json_value* json_key_value(struct json_data *json, const char *str, size_t str_len){
+  struct json_value *jv = 0;
 
-  /* Search for a floating point */
-  else if(strstr(buffer, ".")) {
-    errno = 0;
-    jv->value.d_value = strtod(buffer, 0);
-    if(errno != 0) {
-      printf("Error: could not convert string to double\n");
-      return 0;
-    }
-    jv->json_type = JSON_FLOAT;
+  if(!json->intern) {
+    jv = json_string_value(json, str, str_len);
+    if(jv) jv->json_type = JSON_PAIR;
+    return jv;
   }
 
-  /* Assume that this must be a long. */
-  else {
-    base = 10;
-    errno = 0;
-    jv->value.l_value = strtol(buffer, 0, base);
-    if(errno != 0) {
-      printf("Error: could not convert string to long\n");
-      return 0;
-    }
-    jv->json_type = JSON_INT;
+  jv = (struct json_value*)json_data_alloc(json, sizeof (struct json_value));
+  if(!jv) {
+    printf("Error: could not allocate a json_value.");
+    return jv;
   }
+  json_clear_value(jv);
 
-  /* Add the json_value to the array of all json_values, since the
-     top-level json value will not have a parent. */
-  assert(!json_append_value(json, jv));
+  jv->json_type = JSON_PAIR;
+  jv->value.str_value = (char*)json_intern_key(json->intern, str, str_len);
+  if(!jv->value.str_value) {
+    if(!json->arena) free(jv);
+    return 0;
+  }
+  jv->str_len = (unsigned int)str_len;
 
   return jv;
 }
 
-int json_add_element(struct json_value *jv_parent, struct json_value *jv) {
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv) {
   struct json_value **realloc_children = 0;
+  unsigned int nchildren_alloc = 0;
   unsigned int i;
 
   if(!jv) {
@@ -545,18 +774,36 @@ int json_add_element(struct json_value *jv_parent, struct json_value *jv) {
     else printf("null\n");
   }
 
-  /* Now reallocate space in the array of children pointers. */
-  realloc_children = (struct json_value**)realloc(jv_parent->children,
-						  (jv_parent->nchildren+1)*sizeof(struct json_value*));
+  /* An index of the keys of the parent no longer matches its pairs. */
+  json_object_index_free(json, jv_parent);
+
+  /* Now reallocate space in the array of children pointers.  The
+     array is doubled in size when it is full, such that appending N
+     children costs O(N) in total. */
+  if(jv_parent->nchildren >= jv_parent->nchildren_alloc) {
+    nchildren_alloc = jv_parent->nchildren_alloc ? 2*jv_parent->nchildren_alloc : 4;
+    if(json->arena) {
+      realloc_children = (struct json_value**)json_arena_grow(json->arena, jv_parent->children,
+							      jv_parent->nchildren_alloc*sizeof(struct json_value*),
+							      nchildren_alloc*sizeof(struct json_value*));
+    }
+    else {
+      realloc_children = (struct json_value**)realloc(jv_parent->children,
+						      nchildren_alloc*sizeof(struct json_value*));
+    }
 
-  /* If the reallocation failed. */
-  if(!realloc_children) {
-    fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
-    return 3;
-  }
+    /* If the reallocation failed. */
+    if(!realloc_children) {
+      fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
+      return 3;
+    }
 
-  /* Update the children buffer */
-  jv_parent->children = realloc_children;
+    JSON_STATS_ADD(json->stats, reallocations, 1);
+
+    /* Update the children buffer */
+    jv_parent->children = realloc_children;
+    jv_parent->nchildren_alloc = nchildren_alloc;
+  }
 
   /* Append this jv to the list of children of the parent. */
   jv_parent->children[jv_parent->nchildren] = jv;
@@ -584,25 +831,37 @@ int json_add_element(struct json_value *jv_parent, struct json_value *jv) {
 
 int json_append_value(struct json_data *json, struct json_value *jv) {
   struct json_value **realloc_all_json_values = 0;
-  realloc_all_json_values = (struct json_value**)realloc(json->json_values,
-							 ((json->n_json_values)+1)*sizeof(struct json_value*));
-  if(!realloc_all_json_values) {
-    printf("Error: could not allocate memory for json pointer array.\n");
-    assert(realloc_all_json_values);
-    return 1;
+  unsigned int json_values_alloc = 0;
+
+  /* Double the size of the pointer array when it is full. */
+  if(json->n_json_values >= json->json_values_alloc) {
+    json_values_alloc = json->json_values_alloc ? 2*json->json_values_alloc : 64;
+    realloc_all_json_values = (struct json_value**)realloc(json->json_values,
+							   json_values_alloc*sizeof(struct json_value*));
+    if(!realloc_all_json_values) {
+      printf("Error: could not allocate memory for json pointer array.\n");
+      assert(realloc_all_json_values);
+      return 1;
+    }
+    json->json_values = realloc_all_json_values;
+    json->json_values_alloc = json_values_alloc;
+    JSON_STATS_ADD(json->stats, reallocations, 1);
   }
-  json->json_values = realloc_all_json_values;
   json->json_values[json->n_json_values] = jv;
   json->n_json_values++;
 
   return 0;
 }
 
-/* This is common functionality to objects and arrays. */
+/* This is common functionality to objects, arrays, numbers, true,
+   false and null. */
 struct json_value* json_add_structure(struct json_data *json, int json_type) {
   struct json_value *jv = 0;
-  jv = (struct json_value*)malloc(sizeof(struct json_value));
-  assert(jv);
+  jv = (struct json_value*)json_data_alloc(json, sizeof(struct json_value));
+  if(!jv) {
+    printf("Error: could not allocate a json_value.\n");
+    return 0;
+  }
   json_clear_value(jv);
   jv->json_type = json_type;
 
@@ -1,14 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "json.h"
 #include "json_ascii_utils.h"
 
-#ifdef DEBUG
+/* Debugging output is compiled in with -DDEBUG or -DDEBUG=1. */
+#ifndef DEBUG
+#define DEBUG 0
+#endif
+#if DEBUG
 #define DEBUG_PRINT(x) fprintf(stderr, x)
 #else
 #define DEBUG_PRINT(x) do {} while (0)
 #endif
 
+/* Functions that are used in this file, but are not declared in the header files. */
+long json_unescape_hex(const char *str);
+size_t json_unescape_utf8(unsigned long code, char *out);
+
 void char_buffer_clear(struct char_buffer *buffer) {
   buffer->blocks = 0;
   buffer->position = 0;
@@ -29,53 +40,256 @@ void char_buffer_free(struct char_buffer *buffer) {
    by the number of reallocation requests.  One allocation of the
    amount of memory corresponding to a given fixed size large ASCII
    file, was found to use the same amount of CPU time as 6000 requests
-   with a 100kByte additional memory request each time. */
+   with a 100kByte additional memory request each time.  The buffer
+   grows by a whole number of these blocks, although
+   char_buffer_shrink_to_fit may then leave it at any size. */
 #define BUFFER_MEM_BLK_SZ 102400
 
+/* The number of characters requested from a file at a time. */
+#define BUFFER_READ_SZ 1048576
+
+/* Function to make sure that the buffer has room for size characters.
+   The buffer at least doubles in size each time it is reallocated,
+   such that filling a buffer one character at a time costs linear
+   time in total. */
+int char_buffer_reserve(struct char_buffer *buffer, unsigned long size) {
+  unsigned long new_blocks = 0;
+  char *reallocated_buffer = 0;
+
+  if(size <= buffer->size) return 0;
+
+  DEBUG_PRINT("realloc\n");
+  new_blocks = buffer->blocks ? 2*buffer->blocks : 1;
+  if(new_blocks*BUFFER_MEM_BLK_SZ < size) {
+    new_blocks = (size + BUFFER_MEM_BLK_SZ - 1)/BUFFER_MEM_BLK_SZ;
+  }
+  reallocated_buffer = (char*)realloc(buffer->buffer, new_blocks*BUFFER_MEM_BLK_SZ*sizeof(char));
+    
+  /* If the reallocation fails, then return an error code and the
+     original buffer. */
+  if(!reallocated_buffer){
+    fprintf(stderr, "Error: could not allocate memory for file buffer (1).\n");
+    return 1;
+  }
+
+  /* If the reallocation is successful, then update the buffer
+     pointer.  The size of the buffer is now the new size. */
+  buffer->buffer = reallocated_buffer;
+  buffer->blocks = new_blocks;
+  buffer->size = new_blocks*BUFFER_MEM_BLK_SZ;
+  return 0;
+}
+
 /* Function to append a character to a character array.  The character
    array grows in large chunks, to reduce the number of reallocation
    calls. */
 int char_buffer_append(struct char_buffer *buffer, char c){
-  unsigned long new_size = 0;
-  char *reallocated_buffer = 0;
 
   /* If the buffer position is greater than the size of the buffer,
      try to increase the buffer size. */
   if(buffer->position >= buffer->size) {
+    if(char_buffer_reserve(buffer, buffer->position+1)) return 1;
+  }
 
-    /* If the current buffer is too small, then try to make the buffer
-       bigger. */
-    DEBUG_PRINT("realloc\n");
+  /* Assign the character */
+  buffer->buffer[buffer->position] = c;
+  buffer->position++; /* Increment the buffer position for next time.*/
+  return 0;
+}
 
-    /* Increase the memory allocation by one memory block. */
-    buffer->blocks++;
-    new_size = buffer->blocks * BUFFER_MEM_BLK_SZ;
-    reallocated_buffer = (char*)realloc(buffer->buffer, new_size*sizeof(char));
-    
-    /* If the reallocation fails, then return an error code and the
-       original buffer. */
-    if(!reallocated_buffer){
-      fprintf(stderr, "Error: could not allocate memory for file buffer (1).\n");
-      return 1;
+int char_buffer_append_n(struct char_buffer *buffer, const char *str, unsigned long n) {
+  /* An empty buffer has no memory to copy into. */
+  if(!n) return 0;
+  if(buffer->position + n > buffer->size) {
+    if(char_buffer_reserve(buffer, buffer->position+n)) return 1;
+  }
+  memcpy(buffer->buffer + buffer->position, str, n);
+  buffer->position += n;
+  return 0;
+}
+
+int char_buffer_read_file(struct char_buffer *buffer, FILE *fptr) {
+  size_t n_read = 0;
+  do {
+    if(char_buffer_reserve(buffer, buffer->position+BUFFER_READ_SZ)) return 1;
+    n_read = fread(buffer->buffer + buffer->position, sizeof(char),
+		   buffer->size - buffer->position, fptr);
+    buffer->position += n_read;
+  } while(n_read > 0);
+  if(ferror(fptr)) {
+    fprintf(stderr, "Error: could not read the file into the buffer.\n");
+    return 2;
+  }
+  return 0;
+}
+
+int char_buffer_read_fd(struct char_buffer *buffer, int fd) {
+  ssize_t n_read = 0;
+  for(;;) {
+    if(char_buffer_reserve(buffer, buffer->position+BUFFER_READ_SZ)) return 1;
+    n_read = read(fd, buffer->buffer + buffer->position, buffer->size - buffer->position);
+    if(n_read < 0 && errno == EINTR) continue;
+    if(n_read < 0) {
+      fprintf(stderr, "Error: could not read the file into the buffer.\n");
+      return 2;
     }
+    if(n_read == 0) break;
+    buffer->position += (unsigned long)n_read;
+  }
+  return 0;
+}
 
-    /* If the reallocation is successful, then update the buffer
-       pointer. */
-    buffer->buffer = reallocated_buffer;
+int char_buffer_shrink_to_fit(struct char_buffer *buffer) {
+  char *reallocated_buffer = 0;
+  if(buffer->position == buffer->size) return 0;
+  if(buffer->position == 0) {
+    char_buffer_free(buffer);
+    return 0;
+  }
+  reallocated_buffer = (char*)realloc(buffer->buffer, buffer->position*sizeof(char));
+  if(!reallocated_buffer) {
+    fprintf(stderr, "Error: could not shrink the file buffer.\n");
+    return 1;
+  }
+  buffer->buffer = reallocated_buffer;
+  buffer->size = buffer->position;
+  buffer->blocks = (buffer->size + BUFFER_MEM_BLK_SZ - 1)/BUFFER_MEM_BLK_SZ;
+  return 0;
+}
 
-    /* The size of the buffer is now the new size. */
-    buffer->size = new_size;
+size_t json_escaped_size(const char *str, size_t n) {
+  size_t i, size = n;
+  unsigned char c;
+
+  for(i=0;i<n;i++) {
+    c = (unsigned char)str[i];
+    if(c == '"' || c == '\\') size++;
+    else if(c < 0x20) {
+      if(c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') size++;
+      else size += 5;
+    }
   }
+  return size;
+}
 
+size_t json_escape(const char *str, size_t n, char *out) {
+  static const char hex[] = "0123456789abcdef";
+  size_t i, size = 0;
+  unsigned char c;
 
-  /* This should not happen, if the allocation is successful. */
-  if(buffer->position >= buffer->size) {
-    fprintf(stderr, "Error: could not allocate memory for file buffer (2).\n");
-    return 2;
+  for(i=0;i<n;i++) {
+    c = (unsigned char)str[i];
+    if(c == '"' || c == '\\') {
+      out[size++] = '\\';
+      out[size++] = (char)c;
+    }
+    else if(c < 0x20) {
+      out[size++] = '\\';
+      switch(c) {
+      case '\b': out[size++] = 'b'; break;
+      case '\f': out[size++] = 'f'; break;
+      case '\n': out[size++] = 'n'; break;
+      case '\r': out[size++] = 'r'; break;
+      case '\t': out[size++] = 't'; break;
+      default:
+	out[size++] = 'u';
+	out[size++] = '0';
+	out[size++] = '0';
+	out[size++] = hex[c >> 4];
+	out[size++] = hex[c & 0xf];
+      }
+    }
+    else {
+      out[size++] = (char)c;
+    }
   }
+  return size;
+}
 
-  /* Assign the character */
-  buffer->buffer[buffer->position] = c;
-  buffer->position++; /* Increment the buffer position for next time.*/
-  return 0;
+size_t json_unescape(const char *str, size_t n, char *out) {
+  size_t i = 0, size = 0;
+  long code = 0, low = 0;
+
+  while(i < n) {
+    if(str[i] != '\\' || i + 1 == n) {
+      out[size++] = str[i++];
+      continue;
+    }
+
+    switch(str[i+1]) {
+    case '"': case '\\': case '/': out[size++] = str[i+1]; i += 2; continue;
+    case 'b': out[size++] = '\b'; i += 2; continue;
+    case 'f': out[size++] = '\f'; i += 2; continue;
+    case 'n': out[size++] = '\n'; i += 2; continue;
+    case 'r': out[size++] = '\r'; i += 2; continue;
+    case 't': out[size++] = '\t'; i += 2; continue;
+    case 'u':
+      code = i + 6 <= n ? json_unescape_hex(str + i + 2) : -1;
+      if(code >= 0) break;
+      /* fall through */
+    default:
+      out[size++] = str[i++];
+      continue;
+    }
+
+    /* A high surrogate that is followed by a low surrogate is one
+       character.  A surrogate on its own is still written, as three
+       bytes. */
+    i += 6;
+    if(code >= 0xd800 && code < 0xdc00 && i + 6 <= n && str[i] == '\\' && str[i+1] == 'u') {
+      low = json_unescape_hex(str + i + 2);
+      if(low >= 0xdc00 && low < 0xe000) {
+	code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+	i += 6;
+      }
+    }
+    size += json_unescape_utf8((unsigned long)code, out + size);
+  }
+  return size;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to read the four hex digits of a \u sequence.  Returns
+   the code, or -1 if a digit is not valid. */
+long json_unescape_hex(const char *str) {
+  long code = 0;
+  int i;
+  char c;
+
+  for(i=0;i<4;i++) {
+    c = str[i];
+    if(c >= '0' && c <= '9') code = 16*code + (c - '0');
+    else if(c >= 'a' && c <= 'f') code = 16*code + (c - 'a' + 10);
+    else if(c >= 'A' && c <= 'F') code = 16*code + (c - 'A' + 10);
+    else return -1;
+  }
+  return code;
+}
+
+/* A function to write a code point as UTF-8.  Returns the number of
+   bytes written, which is never more than the six characters of the
+   escape sequence that it replaces. */
+size_t json_unescape_utf8(unsigned long code, char *out) {
+  if(code < 0x80) {
+    out[0] = (char)code;
+    return 1;
+  }
+  if(code < 0x800) {
+    out[0] = (char)(0xc0 | (code >> 6));
+    out[1] = (char)(0x80 | (code & 0x3f));
+    return 2;
+  }
+  if(code < 0x10000) {
+    out[0] = (char)(0xe0 | (code >> 12));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+    out[2] = (char)(0x80 | (code & 0x3f));
+    return 3;
+  }
+  out[0] = (char)(0xf0 | (code >> 18));
+  out[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+  out[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+  out[3] = (char)(0x80 | (code & 0x3f));
+  return 4;
 }
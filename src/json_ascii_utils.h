@@ -5,3 +5,40 @@ void char_buffer_free(struct char_buffer *buffer); /* Zero variables and free al
    if necessary. */
 int char_buffer_append(struct char_buffer *buffer, char c);
 
+/* Append n characters to the buffer, increasing the size of the buffer
+   if necessary.  The arguments are (buffer, characters, n). */
+int char_buffer_append_n(struct char_buffer *buffer, const char *str, unsigned long n);
+
+/* Make sure that the buffer can hold at least size characters, without
+   changing the position. */
+int char_buffer_reserve(struct char_buffer *buffer, unsigned long size);
+
+/* Append the rest of a file to the buffer, reading it in large
+   blocks.  The file is given as a FILE pointer or a file descriptor. */
+int char_buffer_read_file(struct char_buffer *buffer, FILE *fptr);
+int char_buffer_read_fd(struct char_buffer *buffer, int fd);
+
+/* Release the memory beyond the position, such that the size of the
+   buffer is the number of characters it contains. */
+int char_buffer_shrink_to_fit(struct char_buffer *buffer);
+
+/* The number of characters that a string takes once the quotes,
+   backslashes and control characters in it are escaped, as they must
+   be in a json document.  The arguments are (string, number of
+   characters). */
+size_t json_escaped_size(const char *str, size_t n);
+
+/* Escape a string, as it must be in a json document.  The arguments
+   are (string, number of characters, output), where the output has
+   room for json_escaped_size characters.  Returns the number of
+   characters written, which are not terminated. */
+size_t json_escape(const char *str, size_t n, char *out);
+
+/* Undo the escape sequences of a string from a json document.  A
+   \u sequence is written as UTF-8, and a pair of surrogates as one
+   character.  The arguments are (string, number of characters,
+   output), where the output has room for n characters, since no
+   sequence grows when it is unescaped.  A backslash that does not
+   start a valid sequence is copied as it is.  Returns the number of
+   characters written, which are not terminated. */
+size_t json_unescape(const char *str, size_t n, char *out);
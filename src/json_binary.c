@@ -1,5 +1,97 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_ascii_utils.h"
 #include "json_binary.h"
+#include "json_intern.h"
+#include "json_lazy.h"
+#include "json_number.h"
+#include "json_packed.h"
+#include "json_sink.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UBJSON_SWAP_X86 1
+#include <immintrin.h>
+#endif
+
+/* The depth of nesting that the UBJSON reader handles without
+   allocating. */
+#define UBJSON_READ_STACK_SZ 64
+
+/* The depth of nesting that the UBJSON writer handles without
+   allocating. */
+#define UBJSON_WRITE_STACK_SZ 64
+
+/* The state of a UBJSON reader. */
+struct ubjson_reader {
+  const unsigned char *buffer;
+  size_t size;
+  size_t position; /* The next byte to read */
+  char *insitu; /* Either null or the buffer, when strings are moved in place */
+  struct json_data *json;
+};
+
+/* An object or array that is being read.  The count is -1 if the
+   container ends with a marker. */
+struct ubjson_read_frame {
+  struct json_value *jv;
+  long remaining; /* The number of values still to read */
+  unsigned char type; /* The marker of every value, or zero */
+};
+
+/* An object, array or pair that is being written, and the index of
+   its next child. */
+struct ubjson_write_frame {
+  const struct json_value *jv;
+  unsigned int next_child;
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+size_t ubjson_read(struct json_data *json, const char *buffer, size_t size, char *insitu);
+int ubjson_read_int(struct ubjson_reader *reader, unsigned char marker, long *l);
+int ubjson_read_length(struct ubjson_reader *reader, long *l);
+int ubjson_read_header(struct ubjson_reader *reader, unsigned char *type, long *count);
+struct json_value* ubjson_read_scalar(struct ubjson_reader *reader, unsigned char marker, int has_marker);
+struct json_value* ubjson_read_string(struct ubjson_reader *reader, int json_type, int has_length,
+				      int has_room);
+char* ubjson_intern_key(struct ubjson_reader *reader, const char *str, size_t n, size_t escaped_size);
+int ubjson_read_typed_array(struct ubjson_reader *reader, struct json_value *jv, unsigned char type,
+			    long count);
+int ubjson_reserve_children(struct ubjson_reader *reader, struct json_value *jv, long count);
+int ubjson_error(const struct ubjson_reader *reader, const char *msg);
+int ubjson_write_token(struct json_sink *sink, const struct json_value *jv);
+int ubjson_write_typed_array(struct json_sink *sink, const struct json_value *jv);
+void ubjson_write_packed(struct json_sink *sink, const struct json_value *jv);
+unsigned char ubjson_typed_marker(long min, long max, size_t *size);
+void ubjson_write_int(struct json_sink *sink, long l);
+void ubjson_write_text(struct json_sink *sink, const char *str, size_t n, int has_marker);
+size_t ubjson_int_size(long l);
+unsigned char ubjson_int_marker(long l);
+void ubjson_put(char *out, uint64_t v, size_t size);
+struct json_value* json_add_structure(struct json_data *json, int json_type);
+int json_append_value(struct json_data *json, struct json_value *json_value);
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv);
+int json_packed_reserve(struct json_data *json, struct json_value *jv, unsigned int size);
+#ifdef UBJSON_SWAP_X86
+void swap_block_select(void);
+size_t swap_block_ssse3(unsigned char *dst, const unsigned char *src, size_t n_bytes, size_t size);
+size_t swap_block_avx2(unsigned char *dst, const unsigned char *src, size_t n_bytes, size_t size);
+
+/* The vector implementation of swap_block, which is chosen once for
+   the processor, or null if it has none.  It returns the number of
+   bytes that it swapped. */
+static int swap_block_selected = 0;
+static size_t (*swap_block_impl)(unsigned char *, const unsigned char *, size_t, size_t) = 0;
+
+/* The byte shuffles that reverse values of 2, 4 and 8 bytes. */
+static const unsigned char swap_block_masks[3][16] = {
+  {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+  {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+  {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}};
+#endif
 
 uint32_t swap_uint32(uint32_t v) {
   v = ((v << 8) & 0xff00ff00 ) | ((v >> 8) & 0xff00ff ); 
@@ -34,24 +126,72 @@ int little_endian() {
   return 0;
 }
 
+void swap_block(void *dst, const void *src, size_t n, size_t size) {
+  const unsigned char *s = (const unsigned char*)src;
+  unsigned char *d = (unsigned char*)dst;
+  uint16_t v16;
+  uint32_t v32;
+  uint64_t v64;
+  size_t i = 0;
+
+  if(size == 1 || !little_endian()) {
+    memcpy(dst, src, n*size);
+    return;
+  }
+
+  /* Whole vectors of values are swapped with a byte shuffle, and the
+     rest one value at a time.  The values are loaded and stored with
+     memcpy, since neither side need be aligned. */
+#ifdef UBJSON_SWAP_X86
+  if(!swap_block_selected) swap_block_select();
+  if(swap_block_impl) i = swap_block_impl(d, s, n*size, size)/size;
+#endif
+  if(size == 2) {
+    for(;i<n;i++) {
+      memcpy(&v16, s + 2*i, 2);
+      v16 = (uint16_t)((v16 << 8) | (v16 >> 8));
+      memcpy(d + 2*i, &v16, 2);
+    }
+  }
+  else if(size == 4) {
+    for(;i<n;i++) {
+      memcpy(&v32, s + 4*i, 4);
+      v32 = swap_uint32(v32);
+      memcpy(d + 4*i, &v32, 4);
+    }
+  }
+  else {
+    for(;i<n;i++) {
+      memcpy(&v64, s + 8*i, 8);
+      v64 = swap_uint64(v64);
+      memcpy(d + 8*i, &v64, 8);
+    }
+  }
+}
+
 int ubjson_write_object_begin(FILE *ptr){
   fwrite("{", sizeof(char),1,ptr);
+  return 0;
 }
 
 int ubjson_write_object_end(FILE *ptr) {
   fwrite("}", sizeof(char),1,ptr);
+  return 0;
 }
 
 int ubjson_write_array_begin(FILE *ptr){
   fwrite("[", sizeof(char),1,ptr);
+  return 0;
 }
 
 int ubjson_write_array_end(FILE *ptr) {
   fwrite("]", sizeof(char),1,ptr);
+  return 0;
 }
 
 int ubjson_write_null(FILE *ptr) {
   fwrite("Z", sizeof(char),1,ptr);
+  return 0;
 }
 
 int ubjson_write_bool(unsigned char b, FILE *ptr) {
@@ -70,7 +210,7 @@ int ubjson_write_int8(int8_t v, FILE *ptr) {
 }
 
 int ubjson_write_int32(int32_t v, FILE *ptr) {
-  static const char type_char = 'I';
+  static const char type_char = 'l';
   int is_little_endian = little_endian();
   fwrite(&type_char, sizeof(char),1,ptr);
 
@@ -102,3 +242,885 @@ int ubjson_write_string(const char *str, size_t n_char, FILE *ptr, int prefix) {
   fwrite(str, sizeof(char), n_char, ptr);
   return 0;
 }
+
+size_t json_read_ubjson_buffer(struct json_data *json, const struct char_buffer *buffer) {
+  return ubjson_read(json, buffer->buffer, buffer->size, 0);
+}
+
+size_t json_read_ubjson_buffer_insitu(struct json_data *json, struct char_buffer *buffer) {
+  if(json->n_json_values && (!json->insitu || !json->arena)) {
+    fprintf(stderr, "Error: only an empty json_data, or one read in situ into an arena, can be read in situ.\n");
+    return 0;
+  }
+  if(!json->arena && json_data_use_arena(json, 0)) return 0;
+  json->insitu = 1;
+  return ubjson_read(json, buffer->buffer, buffer->size, buffer->buffer);
+}
+
+size_t json_write_ubjson_value(struct json_sink *sink, const struct json_value *jv) {
+  struct ubjson_write_frame stack_buffer[UBJSON_WRITE_STACK_SZ];
+  struct ubjson_write_frame *stack = stack_buffer;
+  struct ubjson_write_frame *realloc_stack = 0;
+  struct ubjson_write_frame *top = 0;
+  size_t depth = 0, size_of_stack = UBJSON_WRITE_STACK_SZ;
+  size_t json_values_written = 0;
+  const struct json_value *child = 0;
+
+  if(!jv) return 0;
+
+  /* The elements of a typed array are written with the array. */
+  json_values_written++;
+  if(ubjson_write_token(sink, jv)) {
+    stack[0].jv = jv;
+    stack[0].next_child = 0;
+    depth = 1;
+  }
+  else {
+    json_values_written += jv->nchildren;
+  }
+
+  while(depth && !sink->status) {
+    top = &stack[depth-1];
+
+    /* All of the children have been written, so close the object or
+       array.  A pair has nothing to close. */
+    if(top->next_child == top->jv->nchildren) {
+      if(top->jv->json_type == JSON_OBJECT) json_sink_putc(sink, '}');
+      else if(top->jv->json_type == JSON_ARRAY) json_sink_putc(sink, ']');
+      depth--;
+      continue;
+    }
+
+    child = top->jv->children[top->next_child++];
+    json_values_written++;
+    if(!ubjson_write_token(sink, child)) {
+      json_values_written += child->nchildren;
+      continue;
+    }
+
+    /* Descend into the child. */
+    if(depth == size_of_stack) {
+      if(stack == stack_buffer) {
+	realloc_stack = (struct ubjson_write_frame*)malloc(2*size_of_stack*sizeof(struct ubjson_write_frame));
+	if(realloc_stack) memcpy(realloc_stack, stack, depth*sizeof(struct ubjson_write_frame));
+      }
+      else {
+	realloc_stack = (struct ubjson_write_frame*)realloc(stack, 2*size_of_stack*sizeof(struct ubjson_write_frame));
+      }
+      if(!realloc_stack) {
+	fprintf(stderr, "Error: could not allocate memory for the stack of the writer.\n");
+	if(stack != stack_buffer) free(stack);
+	return 0;
+      }
+      stack = realloc_stack;
+      size_of_stack *= 2;
+    }
+    stack[depth].jv = child;
+    stack[depth].next_child = 0;
+    depth++;
+  }
+  if(stack != stack_buffer) free(stack);
+
+  return json_values_written;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to read every value in a buffer, without recursion.  The
+   stack holds the objects and arrays that are being read.  The
+   arguments are (json_data, buffer, size, writable buffer for in situ
+   strings or null).  Returns the number of json_values read, or
+   zero. */
+size_t ubjson_read(struct json_data *json, const char *buffer, size_t size, char *insitu) {
+  struct ubjson_reader reader;
+  struct ubjson_read_frame stack_buffer[UBJSON_READ_STACK_SZ];
+  struct ubjson_read_frame *stack = stack_buffer;
+  struct ubjson_read_frame *realloc_stack = 0;
+  struct ubjson_read_frame *top = 0;
+  size_t depth = 0, size_of_stack = UBJSON_READ_STACK_SZ;
+  struct json_value *jv = 0, *parent = 0;
+  unsigned char marker = 0, type = 0;
+  long count = 0;
+  int status = 0;
+
+  reader.buffer = (const unsigned char*)buffer;
+  reader.size = size;
+  reader.position = 0;
+  reader.insitu = insitu;
+  reader.json = json;
+
+  while(!status) {
+    parent = 0;
+    top = depth ? &stack[depth-1] : 0;
+
+    /* A no-op may come before any value that has a marker, or before
+       the end of a container. */
+    if(!top || !top->type) {
+      while(reader.position < size && reader.buffer[reader.position] == 'N') reader.position++;
+    }
+
+    if(!top) {
+      if(reader.position == size) break;
+    }
+    else {
+      if(top->remaining == 0) {
+	depth--;
+	continue;
+      }
+      if(top->remaining < 0) {
+	if(reader.position == size) {
+	  status = ubjson_error(&reader, "the buffer ends within an object or an array");
+	  break;
+	}
+	if(reader.buffer[reader.position] == (top->jv->json_type == JSON_OBJECT ? '}' : ']')) {
+	  reader.position++;
+	  depth--;
+	  continue;
+	}
+      }
+      else {
+	top->remaining--;
+      }
+
+      parent = top->jv;
+      if(parent->json_type == JSON_OBJECT) {
+	jv = ubjson_read_string(&reader, JSON_PAIR, 1, 1);
+	if(!jv || json_add_element(json, parent, jv)) {
+	  status = 1;
+	  break;
+	}
+	parent = jv;
+	if(!top->type) {
+	  while(reader.position < size && reader.buffer[reader.position] == 'N') reader.position++;
+	}
+      }
+    }
+
+    if(top && top->type) {
+      marker = top->type;
+    }
+    else if(reader.position < size) {
+      marker = reader.buffer[reader.position++];
+    }
+    else {
+      status = ubjson_error(&reader, "expected a value");
+      break;
+    }
+
+    if(marker != '[' && marker != '{') {
+      jv = ubjson_read_scalar(&reader, marker, !top || !top->type);
+      if(!jv || json_add_element(json, parent, jv)) status = 1;
+      continue;
+    }
+
+    jv = json_add_structure(json, marker == '{' ? JSON_OBJECT : JSON_ARRAY);
+    if(!jv || json_add_element(json, parent, jv) || ubjson_read_header(&reader, &type, &count)) {
+      status = 1;
+      break;
+    }
+
+    /* An array of one scalar type is read in one go. */
+    if(marker == '[' && type && type != '[' && type != '{') {
+      status = ubjson_read_typed_array(&reader, jv, type, count);
+      continue;
+    }
+    if(ubjson_reserve_children(&reader, jv, count)) {
+      status = 1;
+      break;
+    }
+
+    /* Descend into the object or array. */
+    if(depth == size_of_stack) {
+      if(stack == stack_buffer) {
+	realloc_stack = (struct ubjson_read_frame*)malloc(2*size_of_stack*sizeof(struct ubjson_read_frame));
+	if(realloc_stack) memcpy(realloc_stack, stack, depth*sizeof(struct ubjson_read_frame));
+      }
+      else {
+	realloc_stack = (struct ubjson_read_frame*)realloc(stack, 2*size_of_stack*sizeof(struct ubjson_read_frame));
+      }
+      if(!realloc_stack) {
+	fprintf(stderr, "Error: could not allocate memory to read nested UBJSON.\n");
+	status = 2;
+	break;
+      }
+      stack = realloc_stack;
+      size_of_stack *= 2;
+    }
+    stack[depth].jv = jv;
+    stack[depth].remaining = count;
+    stack[depth].type = type;
+    depth++;
+  }
+
+  if(stack != stack_buffer) free(stack);
+  if(status) return 0;
+
+  /* Return the number of json_values read */
+  return json->n_json_values;
+}
+
+/* A function to read an integer of the type given by a marker.  The
+   arguments are (reader, marker, pointer to the value).  Returns zero
+   on success. */
+int ubjson_read_int(struct ubjson_reader *reader, unsigned char marker, long *l) {
+  const unsigned char *p = reader->buffer + reader->position;
+  int16_t v16;
+  int32_t v32;
+  int64_t v64;
+  size_t size;
+
+  switch(marker) {
+  case 'i': case 'U': size = 1; break;
+  case 'I': size = 2; break;
+  case 'l': size = 4; break;
+  case 'L': size = 8; break;
+  default:
+    return ubjson_error(reader, "expected an integer marker");
+  }
+  if(reader->size - reader->position < size) return ubjson_error(reader, "the buffer ends within an integer");
+
+  switch(marker) {
+  case 'i': *l = (int8_t)p[0]; break;
+  case 'U': *l = p[0]; break;
+  case 'I': swap_block(&v16, p, 1, 2); *l = v16; break;
+  case 'l': swap_block(&v32, p, 1, 4); *l = v32; break;
+  case 'L': swap_block(&v64, p, 1, 8); *l = (long)v64; break;
+  }
+  reader->position += size;
+  return 0;
+}
+
+/* A function to read a length or a count, which is an integer with
+   its own marker and must not be negative. */
+int ubjson_read_length(struct ubjson_reader *reader, long *l) {
+  if(reader->position == reader->size) return ubjson_error(reader, "expected a length");
+  if(ubjson_read_int(reader, reader->buffer[reader->position++], l)) return 1;
+  if(*l < 0) return ubjson_error(reader, "a length must not be negative");
+  return 0;
+}
+
+/* A function to read the optional type and count that follow the
+   opening marker of an object or array.  The type is zero, and the
+   count is -1, if they are not given. */
+int ubjson_read_header(struct ubjson_reader *reader, unsigned char *type, long *count) {
+  *type = 0;
+  *count = -1;
+
+  if(reader->position < reader->size && reader->buffer[reader->position] == '$') {
+    if(reader->size - reader->position < 2) return ubjson_error(reader, "expected a type");
+    *type = reader->buffer[reader->position+1];
+    reader->position += 2;
+    if(reader->position == reader->size || reader->buffer[reader->position] != '#') {
+      return ubjson_error(reader, "a type must be followed by a count");
+    }
+  }
+  if(reader->position < reader->size && reader->buffer[reader->position] == '#') {
+    reader->position++;
+    if(ubjson_read_length(reader, count)) return 1;
+
+    /* Every value takes at least one byte, unless the type carries the
+       value, so a larger count cannot be valid. */
+    if((unsigned long)*count > reader->size) return ubjson_error(reader, "the count is too large");
+  }
+  return 0;
+}
+
+/* A function to read a value that is not an object or an array, after
+   its marker.  The arguments are (reader, marker, non-zero if the
+   marker was in the buffer rather than given by the type of the
+   container). */
+struct json_value* ubjson_read_scalar(struct ubjson_reader *reader, unsigned char marker, int has_marker) {
+  struct json_value *jv = 0;
+  const unsigned char *p = 0;
+  uint32_t v32;
+  uint64_t v64;
+  float f;
+  double d;
+  long l;
+
+  switch(marker) {
+  case 'Z':
+    return json_add_structure(reader->json, JSON_NULL);
+
+  case 'T': case 'F':
+    jv = json_add_structure(reader->json, JSON_BOOLEAN);
+    if(jv) jv->value.b_value = marker == 'T';
+    return jv;
+
+  case 'i': case 'U': case 'I': case 'l': case 'L':
+    if(ubjson_read_int(reader, marker, &l)) return 0;
+    jv = json_add_structure(reader->json, JSON_INT);
+    if(jv) jv->value.l_value = l;
+    return jv;
+
+  case 'd': case 'D':
+    if(reader->size - reader->position < (marker == 'd' ? 4U : 8U)) {
+      ubjson_error(reader, "the buffer ends within a number");
+      return 0;
+    }
+    p = reader->buffer + reader->position;
+    if(marker == 'd') {
+      swap_block(&v32, p, 1, 4);
+      memcpy(&f, &v32, 4);
+      d = f;
+      reader->position += 4;
+    }
+    else {
+      swap_block(&v64, p, 1, 8);
+      memcpy(&d, &v64, 8);
+      reader->position += 8;
+    }
+    jv = json_add_structure(reader->json, JSON_FLOAT);
+    if(jv) jv->value.d_value = d;
+    return jv;
+
+  case 'H':
+    if(ubjson_read_length(reader, &l)) return 0;
+    if((unsigned long)l > reader->size - reader->position) {
+      ubjson_error(reader, "the buffer ends within a number");
+      return 0;
+    }
+    jv = json_add_structure(reader->json, JSON_NDEF);
+    if(!jv) return 0;
+    if(json_parse_number((const char*)reader->buffer + reader->position, l, jv)) {
+      ubjson_error(reader, "not a valid high precision number");
+      return 0;
+    }
+    reader->position += l;
+    return jv;
+
+  case 'S':
+    return ubjson_read_string(reader, JSON_STRING, 1, 1);
+
+  case 'C':
+    /* A char is a string of one byte, without a length. */
+    return ubjson_read_string(reader, JSON_STRING, 0, has_marker);
+
+  default:
+    ubjson_error(reader, "unknown marker");
+    return 0;
+  }
+}
+
+/* A function to read a string, a char or a key into a new json_value
+   of the given type.  The arguments are (reader, json_type, non-zero
+   if a length comes first, non-zero if the byte before the string has
+   been read and may be overwritten). */
+struct json_value* ubjson_read_string(struct ubjson_reader *reader, int json_type, int has_length,
+				      int has_room) {
+  struct json_value *jv = 0;
+  const char *str = 0;
+  size_t escaped_size;
+  long n = 1;
+
+  if(has_length && ubjson_read_length(reader, &n)) return 0;
+  if((unsigned long)n > reader->size - reader->position) {
+    ubjson_error(reader, "the buffer ends within a string");
+    return 0;
+  }
+  str = (const char*)reader->buffer + reader->position;
+  reader->position += n;
+
+  jv = (struct json_value*)json_data_alloc(reader->json, sizeof(struct json_value));
+  if(!jv) {
+    fprintf(stderr, "Error: could not allocate a json_value.\n");
+    return 0;
+  }
+  json_clear_value(jv);
+  jv->json_type = json_type;
+
+  /* A string that needs no escaping is moved back over the last byte
+     of its length, or the marker of a char, to make room for the
+     terminator. */
+  escaped_size = json_escaped_size(str, n);
+  if(json_type == JSON_PAIR && reader->json->intern) {
+    jv->value.str_value = ubjson_intern_key(reader, str, n, escaped_size);
+    if(!jv->value.str_value) return 0;
+  }
+  else if(reader->insitu && has_room && escaped_size == (size_t)n) {
+    jv->value.str_value = reader->insitu + (str - (const char*)reader->buffer) - 1;
+    memmove(jv->value.str_value, str, n);
+    jv->value.str_value[escaped_size] = '\0';
+  }
+  else {
+    jv->value.str_value = (char*)json_data_alloc(reader->json, escaped_size + 1);
+    if(!jv->value.str_value) {
+      fprintf(stderr, "Error: could not allocate memory for json_value string.\n");
+      return 0;
+    }
+    json_escape(str, n, jv->value.str_value);
+    jv->value.str_value[escaped_size] = '\0';
+  }
+  jv->str_len = (unsigned int)escaped_size;
+
+  if(json_append_value(reader->json, jv)) return 0;
+  return jv;
+}
+
+/* A function to add a key to the interning table of the json_data.
+   The key is escaped first, as it would appear in ASCII json, in a
+   temporary copy if it needs escaping.  The arguments are (reader,
+   characters, number of characters, size once escaped).  Returns the
+   canonical key, or null. */
+char* ubjson_intern_key(struct ubjson_reader *reader, const char *str, size_t n, size_t escaped_size) {
+  const char *key = 0;
+  char *escaped = 0;
+
+  if(escaped_size == n) return (char*)json_intern_key(reader->json->intern, str, n);
+
+  escaped = (char*)malloc(escaped_size);
+  if(!escaped) {
+    fprintf(stderr, "Error: could not allocate memory for json_value string.\n");
+    return 0;
+  }
+  json_escape(str, n, escaped);
+  key = json_intern_key(reader->json->intern, escaped, escaped_size);
+  free(escaped);
+  return (char*)key;
+}
+
+/* A function to read the values of an array with a type and a count.
+   Numbers are swapped into host order a block at a time.  When the
+   json_data packs its arrays, they become the elements of a packed
+   array, and those of eight bytes are swapped straight into place. */
+int ubjson_read_typed_array(struct ubjson_reader *reader, struct json_value *jv, unsigned char type,
+			    long count) {
+  union {
+    int8_t i8[UBJSON_SWAP_BLK_SZ];
+    uint8_t u8[UBJSON_SWAP_BLK_SZ];
+    int16_t i16[UBJSON_SWAP_BLK_SZ];
+    int32_t i32[UBJSON_SWAP_BLK_SZ];
+    int64_t i64[UBJSON_SWAP_BLK_SZ];
+    float f32[UBJSON_SWAP_BLK_SZ];
+    double f64[UBJSON_SWAP_BLK_SZ];
+  } block;
+  struct json_value *child = 0;
+  size_t size = 0, n, i;
+  long *l_values = 0;
+  double *d_values = 0;
+  long done;
+
+  switch(type) {
+  case 'i': case 'U': size = 1; break;
+  case 'I': size = 2; break;
+  case 'l': case 'd': size = 4; break;
+  case 'L': case 'D': size = 8; break;
+  }
+
+  /* Other types are read one value at a time. */
+  if(!size) {
+    if(ubjson_reserve_children(reader, jv, count)) return 1;
+    for(done=0;done<count;done++) {
+      child = ubjson_read_scalar(reader, type, 0);
+      if(!child || json_add_element(reader->json, jv, child)) return 1;
+    }
+    return 0;
+  }
+
+  if((unsigned long)count > (reader->size - reader->position)/size) {
+    return ubjson_error(reader, "the buffer ends within a typed array");
+  }
+
+  if(reader->json->pack_arrays && count > 0) {
+    jv->json_type = type == 'd' || type == 'D' ? JSON_PACKED_FLOAT : JSON_PACKED_INT;
+    if(json_packed_reserve(reader->json, jv, (unsigned int)count)) return 2;
+    l_values = jv->value.l_values;
+    d_values = jv->value.d_values;
+    if(type == 'D' || (type == 'L' && sizeof(long) == 8)) {
+      swap_block(l_values, reader->buffer + reader->position, count, 8);
+      reader->position += count*8;
+      jv->str_len = (unsigned int)count;
+      return 0;
+    }
+  }
+  else if(ubjson_reserve_children(reader, jv, count)) {
+    return 1;
+  }
+
+  for(done=0;done<count;done+=n) {
+    n = count - done < UBJSON_SWAP_BLK_SZ ? count - done : UBJSON_SWAP_BLK_SZ;
+    swap_block(&block, reader->buffer + reader->position, n, size);
+    reader->position += n*size;
+
+    if(l_values) {
+      for(i=0;i<n;i++) {
+	switch(type) {
+	case 'i': l_values[done+i] = block.i8[i]; break;
+	case 'U': l_values[done+i] = block.u8[i]; break;
+	case 'I': l_values[done+i] = block.i16[i]; break;
+	case 'l': l_values[done+i] = block.i32[i]; break;
+	case 'L': l_values[done+i] = (long)block.i64[i]; break;
+	case 'd': d_values[done+i] = block.f32[i]; break;
+	}
+      }
+      jv->str_len += (unsigned int)n;
+      continue;
+    }
+
+    for(i=0;i<n;i++) {
+      child = json_add_structure(reader->json, type == 'd' || type == 'D' ? JSON_FLOAT : JSON_INT);
+      if(!child) return 2;
+      switch(type) {
+      case 'i': child->value.l_value = block.i8[i]; break;
+      case 'U': child->value.l_value = block.u8[i]; break;
+      case 'I': child->value.l_value = block.i16[i]; break;
+      case 'l': child->value.l_value = block.i32[i]; break;
+      case 'L': child->value.l_value = (long)block.i64[i]; break;
+      case 'd': child->value.d_value = block.f32[i]; break;
+      case 'D': child->value.d_value = block.f64[i]; break;
+      }
+
+      /* The children were allocated from the count. */
+      child->parent = jv;
+      jv->children[jv->nchildren++] = child;
+    }
+  }
+  return 0;
+}
+
+/* A function to allocate the children of an object or array whose
+   count is known, such that they are not reallocated as they are
+   added. */
+int ubjson_reserve_children(struct ubjson_reader *reader, struct json_value *jv, long count) {
+  if(count <= 0) return 0;
+  jv->children = (struct json_value**)json_data_alloc(reader->json, count*sizeof(struct json_value*));
+  if(!jv->children) {
+    fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
+    return 1;
+  }
+  jv->nchildren_alloc = (unsigned int)count;
+  return 0;
+}
+
+/* A function to report an error at the position of a reader.
+   Returns 1. */
+int ubjson_error(const struct ubjson_reader *reader, const char *msg) {
+  printf("Error: %s at byte %lu\n", msg, (unsigned long)reader->position);
+  return 1;
+}
+
+/* A function to write one json_value: a scalar, a key, or the header
+   of an object or array.  Strings and keys are unescaped, since
+   UBJSON keeps them as they are.  A pair without a value is given
+   null, such that its object stays valid, and a pair that is
+   written on its own has its key written as a string.  An object or
+   array that is read on demand, and has not been read yet, stops the
+   writer.  Returns non-zero if the children of the value must be
+   written next. */
+int ubjson_write_token(struct json_sink *sink, const struct json_value *jv) {
+  char *out = 0;
+  uint64_t bits = 0;
+
+  if(json_lazy_pending(jv)) {
+    if(!sink->status) fprintf(stderr, "Error: an object or array that is read on demand must be read with json_lazy_expand_all before it is written.\n");
+    sink->status = 1;
+  }
+
+  switch(jv->json_type) {
+  case JSON_OBJECT: case JSON_ARRAY:
+    if(!jv->nchildren) {
+      json_sink_write(sink, jv->json_type == JSON_OBJECT ? "{}" : "[]", 2);
+      return 0;
+    }
+    if(jv->json_type == JSON_ARRAY && ubjson_write_typed_array(sink, jv)) return 0;
+    json_sink_putc(sink, jv->json_type == JSON_OBJECT ? '{' : '[');
+    return 1;
+
+  case JSON_PAIR:
+    ubjson_write_text(sink, jv->value.str_value, jv->str_len, !jv->parent);
+    if(jv->nchildren) return 1;
+    json_sink_putc(sink, 'Z');
+    return 0;
+
+  case JSON_STRING:
+    ubjson_write_text(sink, jv->value.str_value, jv->str_len, 1);
+    return 0;
+
+  case JSON_INT:
+    ubjson_write_int(sink, jv->value.l_value);
+    return 0;
+
+  case JSON_FLOAT:
+    out = json_sink_reserve(sink, 9);
+    if(!out) return 0;
+    memcpy(&bits, &jv->value.d_value, sizeof(double));
+    out[0] = 'D';
+    ubjson_put(out + 1, bits, 8);
+    sink->position += 9;
+    return 0;
+
+  case JSON_BOOLEAN:
+    json_sink_putc(sink, jv->value.b_value ? 'T' : 'F');
+    return 0;
+
+  case JSON_NULL:
+    json_sink_putc(sink, 'Z');
+    return 0;
+
+  case JSON_PACKED_INT: case JSON_PACKED_FLOAT:
+    ubjson_write_packed(sink, jv);
+    return 0;
+
+  default:
+    fprintf(stderr, "Error: json_type=%u is out of range", jv->json_type);
+    sink->status = 1;
+    return 0;
+  }
+}
+
+/* A function to write an array whose elements are all integers, or
+   all floats, as a strongly typed array, where the type and count are
+   given once and each element is only its big-endian bytes.  The
+   integers take the smallest type that holds all of them.  Returns
+   zero, without writing anything, if the array is not of one numeric
+   type or if the typed array would not be smaller. */
+int ubjson_write_typed_array(struct json_sink *sink, const struct json_value *jv) {
+  const struct json_value *child = jv->children[0];
+  unsigned int json_type = child->json_type;
+  long min = 0, max = 0, l;
+  size_t size_of_plain = 0, size = 8, n, i, k;
+  unsigned char marker = 'D';
+  uint64_t bits = 0;
+  char *out = 0;
+
+  if(json_type != JSON_INT && json_type != JSON_FLOAT) return 0;
+  if(json_type == JSON_INT) min = max = child->value.l_value;
+  for(i=0;i<jv->nchildren;i++) {
+    child = jv->children[i];
+    if(child->json_type != json_type) return 0;
+    if(json_type == JSON_INT) {
+      l = child->value.l_value;
+      if(l < min) min = l;
+      if(l > max) max = l;
+      size_of_plain += 1 + ubjson_int_size(l);
+    }
+    else {
+      size_of_plain += 9;
+    }
+  }
+
+  if(json_type == JSON_INT) marker = ubjson_typed_marker(min, max, &size);
+
+  /* The header of a typed array takes three bytes and the count
+     more than the end marker of a plain array. */
+  if(3 + ubjson_int_size((long)jv->nchildren) + jv->nchildren*size >= size_of_plain) return 0;
+
+  json_sink_putc(sink, '[');
+  json_sink_putc(sink, '$');
+  json_sink_putc(sink, (char)marker);
+  json_sink_putc(sink, '#');
+  ubjson_write_int(sink, (long)jv->nchildren);
+
+  /* The payload is formatted into the sink a block at a time. */
+  for(i=0;i<jv->nchildren;i+=n) {
+    n = jv->nchildren - i < UBJSON_SWAP_BLK_SZ ? jv->nchildren - i : UBJSON_SWAP_BLK_SZ;
+    out = json_sink_reserve(sink, n*size);
+    if(!out) return 1;
+    for(k=0;k<n;k++) {
+      child = jv->children[i+k];
+      if(json_type == JSON_INT) bits = (uint64_t)child->value.l_value;
+      else memcpy(&bits, &child->value.d_value, sizeof(double));
+      ubjson_put(out + k*size, bits, size);
+    }
+    sink->position += n*size;
+  }
+
+  return 1;
+}
+
+/* A function to write a packed array as a strongly typed array, whose
+   payload is swapped into big-endian order a block at a time.
+   Integers take the smallest type that holds all of them.  Values of
+   eight bytes are swapped straight from the packed array, and smaller
+   integers are narrowed first. */
+void ubjson_write_packed(struct json_sink *sink, const struct json_value *jv) {
+  union {
+    int8_t i8[UBJSON_SWAP_BLK_SZ];
+    int16_t i16[UBJSON_SWAP_BLK_SZ];
+    int32_t i32[UBJSON_SWAP_BLK_SZ];
+    int64_t i64[UBJSON_SWAP_BLK_SZ];
+  } block;
+  const long *l_values = jv->value.l_values;
+  long min = 0, max = 0;
+  size_t size = 8, n, i, k;
+  unsigned char marker = 'D';
+  const void *src = 0;
+  char *out = 0;
+
+  if(!jv->str_len) {
+    json_sink_write(sink, "[]", 2);
+    return;
+  }
+
+  if(jv->json_type == JSON_PACKED_INT) {
+    min = max = l_values[0];
+    for(i=1;i<jv->str_len;i++) {
+      if(l_values[i] < min) min = l_values[i];
+      if(l_values[i] > max) max = l_values[i];
+    }
+    marker = ubjson_typed_marker(min, max, &size);
+  }
+
+  json_sink_putc(sink, '[');
+  json_sink_putc(sink, '$');
+  json_sink_putc(sink, (char)marker);
+  json_sink_putc(sink, '#');
+  ubjson_write_int(sink, (long)jv->str_len);
+
+  for(i=0;i<jv->str_len;i+=n) {
+    n = jv->str_len - i < UBJSON_SWAP_BLK_SZ ? jv->str_len - i : UBJSON_SWAP_BLK_SZ;
+    out = json_sink_reserve(sink, n*size);
+    if(!out) return;
+
+    if(jv->json_type == JSON_PACKED_FLOAT) src = jv->value.d_values + i;
+    else if(size == 8 && sizeof(long) == 8) src = l_values + i;
+    else {
+      for(k=0;k<n;k++) {
+	switch(size) {
+	case 1: block.i8[k] = (int8_t)l_values[i+k]; break;
+	case 2: block.i16[k] = (int16_t)l_values[i+k]; break;
+	case 4: block.i32[k] = (int32_t)l_values[i+k]; break;
+	default: block.i64[k] = l_values[i+k]; break;
+	}
+      }
+      src = &block;
+    }
+    swap_block(out, src, n, size);
+    sink->position += n*size;
+  }
+}
+
+/* A function to choose the marker of a typed array of integers.  The
+   arguments are (smallest integer, largest integer, pointer to the
+   size of an element).  Returns the marker. */
+unsigned char ubjson_typed_marker(long min, long max, size_t *size) {
+  if(min >= INT8_MIN && max <= INT8_MAX) { *size = 1; return 'i'; }
+  if(min >= 0 && max <= UINT8_MAX) { *size = 1; return 'U'; }
+  if(min >= INT16_MIN && max <= INT16_MAX) { *size = 2; return 'I'; }
+  if(min >= INT32_MIN && max <= INT32_MAX) { *size = 4; return 'l'; }
+  *size = 8;
+  return 'L';
+}
+
+/* A function to write an integer with the smallest marker that holds
+   it. */
+void ubjson_write_int(struct json_sink *sink, long l) {
+  size_t size = ubjson_int_size(l);
+  char *out = json_sink_reserve(sink, 1 + size);
+  if(!out) return;
+  out[0] = (char)ubjson_int_marker(l);
+  ubjson_put(out + 1, (uint64_t)l, size);
+  sink->position += 1 + size;
+}
+
+/* A function to write a string or a key, with its length, after
+   undoing its escape sequences.  The arguments are (sink, string as
+   stored in the tree, number of characters, non-zero to write the 'S'
+   marker first). */
+void ubjson_write_text(struct json_sink *sink, const char *str, size_t n, int has_marker) {
+  char *out = 0, *text = 0;
+  size_t size_of_header = 0, size = 0;
+  char header[10];
+
+  if(has_marker) json_sink_putc(sink, 'S');
+  if(!memchr(str, '\\', n)) {
+    ubjson_write_int(sink, (long)n);
+    json_sink_write(sink, str, n);
+    return;
+  }
+
+  /* The string is unescaped after room for the length, which is only
+     known afterwards, and is then moved into place.  A string that
+     does not fit in the sink is unescaped into memory of its own. */
+  out = json_sink_reserve(sink, sizeof(header) + n);
+  text = out ? out + sizeof(header) : (char*)malloc(n);
+  if(!text) {
+    if(!sink->status) fprintf(stderr, "Error: could not allocate memory to write a string.\n");
+    sink->status = 1;
+    return;
+  }
+  size = json_unescape(str, n, text);
+
+  header[0] = (char)ubjson_int_marker((long)size);
+  size_of_header = 1 + ubjson_int_size((long)size);
+  ubjson_put(header + 1, (uint64_t)size, size_of_header - 1);
+  if(out) {
+    memcpy(out, header, size_of_header);
+    memmove(out + size_of_header, text, size);
+    sink->position += size_of_header + size;
+  }
+  else {
+    json_sink_write(sink, header, size_of_header);
+    json_sink_write(sink, text, size);
+    free(text);
+  }
+}
+
+/* The number of bytes of the smallest integer type that holds l. */
+size_t ubjson_int_size(long l) {
+  if(l >= INT8_MIN && l <= UINT8_MAX) return 1;
+  if(l >= INT16_MIN && l <= INT16_MAX) return 2;
+  if(l >= INT32_MIN && l <= INT32_MAX) return 4;
+  return 8;
+}
+
+/* The marker of the smallest integer type that holds l. */
+unsigned char ubjson_int_marker(long l) {
+  if(l >= INT8_MIN && l <= INT8_MAX) return 'i';
+  if(l >= 0 && l <= UINT8_MAX) return 'U';
+  if(l >= INT16_MIN && l <= INT16_MAX) return 'I';
+  if(l >= INT32_MIN && l <= INT32_MAX) return 'l';
+  return 'L';
+}
+
+/* A function to store the low bytes of a value in big-endian order,
+   whatever the order of the host.  The size is 1, 2, 4 or 8. */
+void ubjson_put(char *out, uint64_t v, size_t size) {
+  size_t i;
+  for(i=size;i>0;i--) {
+    out[i-1] = (char)(v & 0xff);
+    v >>= 8;
+  }
+}
+
+#ifdef UBJSON_SWAP_X86
+/* A function to choose the vector implementation of swap_block. */
+void swap_block_select(void) {
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) swap_block_impl = swap_block_avx2;
+  else if(__builtin_cpu_supports("ssse3")) swap_block_impl = swap_block_ssse3;
+  swap_block_selected = 1;
+}
+
+/* Functions to swap the bytes of values 16 or 32 bytes at a time.  The
+   arguments are (destination, source, number of bytes, size of a
+   value).  Returns the number of bytes swapped, which leaves less
+   than one vector for the caller. */
+__attribute__((target("ssse3")))
+size_t swap_block_ssse3(unsigned char *dst, const unsigned char *src, size_t n_bytes, size_t size) {
+  const __m128i mask = _mm_loadu_si128((const __m128i*)swap_block_masks[size == 2 ? 0 : size == 4 ? 1 : 2]);
+  __m128i v;
+  size_t i;
+
+  for(i=0;i+16<=n_bytes;i+=16) {
+    v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t swap_block_avx2(unsigned char *dst, const unsigned char *src, size_t n_bytes, size_t size) {
+  const __m256i mask = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((const __m128i*)swap_block_masks[size == 2 ? 0 : size == 4 ? 1 : 2]));
+  __m256i v;
+  size_t i;
+
+  for(i=0;i+32<=n_bytes;i+=32) {
+    v = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+#endif
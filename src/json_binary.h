@@ -1,11 +1,26 @@
+#ifndef JSON_BINARY_H
+#define JSON_BINARY_H
+
+#include <stdio.h>
 #include <inttypes.h>
 
+#include "json.h"
+#include "json_sink.h"
+
 uint32_t swap_uint32(uint32_t v);
 int32_t swap_int32(int32_t v);
 int64_t swap_int64(int64_t v);
 uint64_t swap_uint64(uint64_t v);
 int little_endian();
 
+/* Copy an array of big-endian values into host order, or host-order
+   values into big-endian order.  The arguments are (destination,
+   source, number of values, size of a value), where the size is 1, 2,
+   4 or 8 bytes.  Neither side need be aligned.  On x86 processors
+   with SSSE3 or AVX2, whole vectors of values are swapped with a byte
+   shuffle. */
+void swap_block(void *dst, const void *src, size_t n, size_t size);
+
 int ubjson_write_object_begin(FILE *ptr);
 int ubjson_write_object_end(FILE *ptr);
 int ubjson_write_array_begin(FILE *ptr);
@@ -16,3 +31,43 @@ int ubjson_write_int8(int8_t v, FILE *ptr);
 int ubjson_write_int32(int32_t v, FILE *ptr);
 int ubjson_write_int64(int64_t v, FILE *ptr);
 int ubjson_write_string(const char *str, size_t n_char, FILE *ptr, int use_prefix);
+
+/* The number of values of a typed array that are swapped at a time. */
+#define UBJSON_SWAP_BLK_SZ 256
+
+/* A function to read a buffer that contains UBJSON into the same tree
+   as json_read_ascii_buffer would build from the equivalent json.
+   Every marker is read, and the no-op marker is skipped.  Containers
+   that give their count are allocated exactly, and the payload of an
+   array of one numeric type is swapped into host order in blocks.
+   Strings are escaped as they would be in a json document, and high
+   precision numbers are read as numbers.  A typed numeric array is
+   read as a packed array if the json_data packs its arrays, as set by
+   json_data_use_packed_arrays.  The buffer may hold several
+   values one after the other.  The arguments are (json_data, buffer).
+   The function returns the number of json_values read, or zero if the
+   buffer is not valid UBJSON. */
+size_t json_read_ubjson_buffer(struct json_data *, const struct char_buffer *);
+
+/* A function to read a buffer that contains UBJSON in situ.  Strings
+   that need no escaping are moved one byte back, over the end of
+   their length, and terminated in the buffer rather than copied.  The
+   buffer therefore no longer contains valid UBJSON, and must not be
+   freed or changed before the json_data is freed.  The json_data must
+   be empty, or have been read in situ into an arena.  An arena is used
+   if it does not have one, since strings that need escaping are still
+   copied.  The function returns the number of json_values read,
+   or zero if the buffer is not valid UBJSON. */
+size_t json_read_ubjson_buffer_insitu(struct json_data *, struct char_buffer *);
+
+/* A function to write a json_value and its children to a sink as
+   UBJSON.  This is what the writers do when their mode contains
+   JSON_WRITE_UBJSON.  Integers take the smallest marker that holds
+   them, floats are written as float64, and strings and keys are
+   unescaped.  An array whose elements are all integers, or all
+   floats, is written as a strongly typed array, with its type and
+   count, when that is smaller, and a packed array always is.  The arguments are (sink, json_value).  Returns the number
+   of json_values written. */
+size_t json_write_ubjson_value(struct json_sink *sink, const struct json_value *jv);
+
+#endif
@@ -5,18 +5,91 @@
 #include <errno.h>
 
 #include "json.h"
+#include "json_arena.h"
+#include "json_lazy.h"
+#include "json_object.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+void json_free_values(struct json_data *json);
 
 /* A function to clear a json_value struct */
 void json_clear_value(struct json_value *jv) {
   jv->json_type = JSON_NDEF;
+  jv->str_len = 0;
   jv->children = 0;
   jv->nchildren = 0;
+  jv->nchildren_alloc = 0;
   jv->parent = 0;
-  jv->value.b_value = 0;
+  memset(&jv->value, 0, sizeof(jv->value));
+}
+
+/* A function to clear a json_data struct */
+void json_data_clear(struct json_data *json) {
+  json->json_values = 0;
+  json->n_json_values = 0;
+  json->json_values_alloc = 0;
+  json->arena = 0;
+  json->insitu = 0;
+  json->lazy = 0;
+  json->pack_arrays = 0;
+  json->intern = 0;
+  json->stats = 0;
+}
+
+int json_data_reserve(struct json_data *json, unsigned int n_values) {
+  struct json_value **realloc_all_json_values = 0;
+
+  if(n_values > json->json_values_alloc) {
+    realloc_all_json_values = (struct json_value**)realloc(json->json_values,
+							   n_values*sizeof(struct json_value*));
+    if(!realloc_all_json_values) {
+      fprintf(stderr, "Error: could not allocate memory for json pointer array.\n");
+      return 1;
+    }
+    json->json_values = realloc_all_json_values;
+    json->json_values_alloc = n_values;
+  }
+
+  /* Make sure that the json_values can be carved from one block. */
+  if(json->arena && n_values > json->n_json_values) {
+    if(json_arena_reserve(json->arena, (n_values - json->n_json_values)*sizeof(struct json_value))) {
+      return 2;
+    }
+  }
+
+  return 0;
+}
+
+void json_free_value_array(struct json_data *json) {
+  if(!json) return;
+
+  json_free_values(json);
+  if(json->arena) {
+    json_arena_free(json->arena);
+    free(json->arena);
+  }
+  if(json->lazy) {
+    json_lazy_free(json->lazy);
+    free(json->lazy);
+  }
+  if(json->json_values) free(json->json_values);
+  json_data_clear(json);
+}
+
+void json_data_reset(struct json_data *json) {
+  json_free_values(json);
+  if(json->arena) json_arena_reset(json->arena);
+  if(json->lazy) {
+    json_lazy_free(json->lazy);
+    free(json->lazy);
+    json->lazy = 0;
+  }
+  json->n_json_values = 0;
+  json->insitu = 0;
 }
 
 const char* json_type_to_string(unsigned int json_type) {
-  static char *json_type_str[9] = {
+  static char *json_type_str[11] = {
     "NDEF",
     "OBJECT",
     "ARRAY",
@@ -25,8 +98,10 @@ const char* json_type_to_string(unsigned int json_type) {
     "INT",
     "FLOAT",
     "BOOLEAN",
-    "NULL"};
-  if(json_type < 9) return json_type_str[json_type];
+    "NULL",
+    "PACKED_INT",
+    "PACKED_FLOAT"};
+  if(json_type < 11) return json_type_str[json_type];
   return "OUT_OF_RANGE";
 }
 
@@ -42,6 +117,9 @@ void json_print_value(const struct json_value *jv) {
     if(jv->value.b_value) printf("value=true, ");
     else printf("value=false, ");
   }
+  else if(jv->json_type == JSON_PACKED_INT || jv->json_type == JSON_PACKED_FLOAT) {
+    printf("size=%u, ", jv->str_len);
+  }
   printf("\n");
 }
 
@@ -53,6 +131,17 @@ void json_print_tree(const struct json_value *jv) {
   for(i=0;i<jv->nchildren;i++) json_print_tree(jv->children[i]);
 }
 
+unsigned int json_value_nchildren(struct json_value *jv) {
+  json_lazy_expand(jv);
+  return jv->nchildren;
+}
+
+struct json_value* json_value_child(struct json_value *jv, unsigned int i) {
+  json_lazy_expand(jv);
+  if(i >= jv->nchildren) return 0;
+  return jv->children[i];
+}
+
 long json_find_child_index(const struct json_value *jv_child, 
 			   const struct json_value *jv_parent) {
   long i = 0;
@@ -78,111 +167,7 @@ int json_is_last_child(const struct json_value *jv_child,
 }
 
 void json_print_formatted(const struct json_value *jv, long indent) {
-  long i;
-  long indent_next = indent;
-  long indent_reduction = 0;
-  const struct json_value *jv_parent_tmp = 0;
-  const struct json_value *jv_child_tmp = 0;
-
-  int print_indent = 0, print_newline = 0;
-
-  const long indent_step = 2;
-
-  /* The pointer must not be null */
-  if(!jv) return;
-
-  /* Check if a newline should be printed or not */
-  if((jv->json_type == JSON_OBJECT ||
-      jv->json_type == JSON_ARRAY))
-    indent_next += indent_step;
-
-  /* Check if an indent should be printed or not */
-  if(jv->parent) {
-    if((jv->parent->json_type == JSON_OBJECT || 
-	jv->parent->json_type == JSON_ARRAY)){
-      print_indent = 1;
-      print_newline = 1;
-    }
-  }
-
-  if(print_newline) printf("\n");
-
-  /* Print the indent if needed. */
-  if(print_indent) {
-    for(i=0;i<indent;i++) {
-      printf(" ");
-    }
-  }
-
-  /* Print the values */
-  if(jv->json_type == JSON_OBJECT) printf("{");
-  else if(jv->json_type == JSON_ARRAY) printf("[");
-  else if(jv->json_type == JSON_PAIR) printf("\"%s\": ", jv->value.str_value);
-  else if(jv->json_type == JSON_STRING) printf("\"%s\"", jv->value.str_value);
-  else if(jv->json_type == JSON_INT) printf("%ld", jv->value.l_value);
-  else if(jv->json_type == JSON_FLOAT) printf("%lf", jv->value.d_value);
-  else if(jv->json_type == JSON_BOOLEAN) {
-    if(jv->value.b_value) printf("true");
-    else printf("false");
-  }
-  else if(jv->json_type == JSON_NULL) printf("null");
-  else { 
-    printf("ERROR");
-    assert(0);
-  }
-
-  /* Print all of the children of this json_value */
-  for(i=0;i<jv->nchildren;i++) {
-    json_print_formatted(jv->children[i], indent_next);
-  }
-
-  /* Handle the trailing characters, if this is the end of an array or
-     object.  Only start appending trailing characters when the bottom
-     of the tree has been reached. */
-  if(jv->nchildren == 0) {
-    indent_reduction = 0;
-    jv_parent_tmp = jv->parent;
-    jv_child_tmp = jv;
-    while(jv_parent_tmp && jv_child_tmp) {
-      
-      if(!json_is_last_child(jv_child_tmp, jv_parent_tmp)) {
-	if(jv_parent_tmp->json_type == JSON_OBJECT ||
-	   jv_parent_tmp->json_type == JSON_ARRAY) {
-	  printf(",");
-	}
-	break;
-      }
-      
-      if(jv_parent_tmp->json_type == JSON_OBJECT ||
-	 jv_parent_tmp->json_type == JSON_ARRAY) {
-	
-	printf("\n");
-	/* Using longs, to catch a potential error where the indent
-	   becomes negative. */
-	for(i=0;i<(indent-indent_reduction);i++) {
-	  printf(" ");
-	}
-	if(jv_parent_tmp->json_type == JSON_OBJECT) {
-	  printf("}");
-	}
-	else if(jv_parent_tmp->json_type == JSON_ARRAY) {
-	  printf("]");
-	}
-      }
-      
-      /* Reduce the indent */
-      indent_reduction += indent_step;
-      
-      /* Navigate back up the tree */
-      jv_child_tmp = jv_parent_tmp;
-      jv_parent_tmp = jv_parent_tmp->parent;
-    }
-  }
-
-  /* Print the final newline */
-  if(!jv->parent) {
-    printf("\n");
-  }
+  json_write_tree(stdout, "a", jv, indent);
 }
 
 int json_check_type(const struct json_value *jv_parent, unsigned int required_type){
@@ -196,3 +181,34 @@ int json_check_type(const struct json_value *jv_parent, unsigned int required_ty
   }
   return 0;
 }
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to free the json_values of a json_data, other than the
+   blocks of an arena.  Every json_value is stored in the json_values
+   array.  Therefore, the tree does not need to be walked.  When an
+   arena is used, the json_values, child arrays, strings and indices
+   of the keys of objects are all released with the arena blocks. */
+void json_free_values(struct json_data *json) {
+  unsigned int i;
+  struct json_value *jv = 0;
+
+  if(json->arena) return;
+
+  for(i=0;i<json->n_json_values;i++) {
+    jv = json->json_values[i];
+    if(!jv) continue;
+    if(jv->children) free(jv->children);
+    json_object_index_free(json, jv);
+    /* Strings that were read in situ belong to the caller's buffer,
+       and interned keys belong to the table. */
+    if((jv->json_type == JSON_STRING || (jv->json_type == JSON_PAIR && !json->intern)) && !json->insitu) {
+      if(jv->value.str_value) free(jv->value.str_value);
+    }
+    if(jv->json_type == JSON_PACKED_INT || jv->json_type == JSON_PACKED_FLOAT) {
+      if(jv->value.l_values) free(jv->value.l_values);
+    }
+    free(jv);
+  }
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_context.h"
+#include "json_parser.h"
+
+int json_context_init(struct json_context *ctx, size_t block_size) {
+  json_data_clear(&ctx->json);
+  if(json_data_use_arena(&ctx->json, block_size)) return 1;
+  if(json_parser_init(&ctx->parser, &ctx->json)) {
+    json_free_value_array(&ctx->json);
+    return 2;
+  }
+  return 0;
+}
+
+size_t json_context_read(struct json_context *ctx, const struct char_buffer *buffer) {
+  json_context_reset(ctx);
+  json_parser_feed(&ctx->parser, buffer->buffer, buffer->size);
+  return json_parser_finish(&ctx->parser);
+}
+
+void json_context_reset(struct json_context *ctx) {
+  json_data_reset(&ctx->json);
+  json_parser_reset(&ctx->parser);
+}
+
+void json_context_free(struct json_context *ctx) {
+  json_parser_free(&ctx->parser);
+  json_free_value_array(&ctx->json);
+}
@@ -0,0 +1,44 @@
+#ifndef JSON_CONTEXT_H
+#define JSON_CONTEXT_H
+
+#include "json.h"
+#include "json_parser.h"
+
+/* A parser and a json_data that are kept from one document to the
+   next, for a program that reads many documents, such as a server
+   that reads one per request.  The json_values, child arrays and
+   strings are carved from an arena, and the arena blocks, the array of
+   json_values and the buffers of the parser are all kept when the
+   context is reset.  Once the context has read a document as large as
+   the next one, the next one is read without calling malloc.  Packed
+   arrays, interning and statistics are selected by calling
+   json_data_use_packed_arrays, json_data_use_intern or
+   json_data_use_stats on the json member after json_context_init.  An
+   intern table is well suited, as the keys of the documents are then
+   only copied once.  The context must not be copied or moved once it
+   is initialised, as the parser points into it. */
+struct json_context {
+  struct json_data json; /* The json_values of the current document */
+  struct json_parser parser; /* Reads into json */
+};
+
+/* Prepare a context.  The arguments are (context, block size of the
+   arena), where a block size of zero selects JSON_ARENA_BLK_SZ.
+   Returns zero on success. */
+int json_context_init(struct json_context *ctx, size_t block_size);
+
+/* Read a document, after releasing the one before it.  The json_values
+   are in the json member, and are valid until the next document is
+   read, or the context is reset or freed.  Returns the number of
+   json_values read, or zero if the document is not valid. */
+size_t json_context_read(struct json_context *ctx, const struct char_buffer *buffer);
+
+/* Release the current document, keeping the memory for the next.  A
+   document can then be fed to the parser member in chunks, with
+   json_parser_feed and json_parser_finish. */
+void json_context_reset(struct json_context *ctx);
+
+/* Free all of the memory that belongs to the context. */
+void json_context_free(struct json_context *ctx);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_intern.h"
+#include "json_object.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+const char* json_intern_probe(const struct json_intern_slots *slots, const char *key, size_t n,
+			      uint32_t hash);
+struct json_intern_slot* json_intern_find(const struct json_intern_slots *slots, const char *key,
+					  size_t n, uint32_t hash);
+int json_intern_grow(struct json_intern *table);
+
+int json_intern_init(struct json_intern *table) {
+  table->slots = 0;
+  table->n_keys = 0;
+  json_arena_clear(&table->arena, JSON_INTERN_BLK_SZ);
+  if(pthread_mutex_init(&table->lock, 0)) {
+    fprintf(stderr, "Error: could not create the lock of an interning table.\n");
+    return 1;
+  }
+  return 0;
+}
+
+void json_intern_free(struct json_intern *table) {
+  struct json_intern_slots *slots = table->slots, *prev = 0;
+
+  while(slots) {
+    prev = slots->prev;
+    free(slots);
+    slots = prev;
+  }
+  json_arena_free(&table->arena);
+  pthread_mutex_destroy(&table->lock);
+  table->slots = 0;
+  table->n_keys = 0;
+}
+
+void json_data_use_intern(struct json_data *json, struct json_intern *table) {
+  json->intern = table;
+}
+
+const char* json_intern_key(struct json_intern *table, const char *key, size_t n) {
+  struct json_intern_slots *slots = 0;
+  struct json_intern_slot *slot = 0;
+  uint32_t hash = json_object_hash(key, n);
+  const char *canonical = 0;
+  char *copy = 0;
+
+  /* Most keys are in the table already, and are found without the
+     lock. */
+  slots = __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+  if(slots && (canonical = json_intern_probe(slots, key, n, hash))) return canonical;
+
+  /* The key may have been added since the table was probed, so it is
+     looked for again under the lock, which no other thread that adds
+     keys holds. */
+  pthread_mutex_lock(&table->lock);
+  if(table->slots) slot = json_intern_find(table->slots, key, n, hash);
+  if(slot && slot->key) {
+    pthread_mutex_unlock(&table->lock);
+    return slot->key;
+  }
+
+  /* The table is kept at most half full, so that the probes are
+     short. */
+  if(!table->slots || 2*(table->n_keys + 1) > table->slots->mask + 1) {
+    if(json_intern_grow(table)) {
+      pthread_mutex_unlock(&table->lock);
+      return 0;
+    }
+    slot = json_intern_find(table->slots, key, n, hash);
+  }
+
+  /* The hash is stored in front of the characters, for
+     json_intern_hash. */
+  copy = (char*)json_arena_alloc(&table->arena, sizeof(uint32_t) + n + 1);
+  if(!copy) {
+    fprintf(stderr, "Error: could not allocate memory for an interned key.\n");
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+  }
+  memcpy(copy, &hash, sizeof(uint32_t));
+  copy += sizeof(uint32_t);
+  memcpy(copy, key, n);
+  copy[n] = '\0';
+
+  /* The key is published last, such that a thread that finds it
+     without the lock also sees the hash, the length and the
+     characters. */
+  slot->hash = hash;
+  slot->len = (unsigned int)n;
+  __atomic_store_n(&slot->key, copy, __ATOMIC_RELEASE);
+  table->n_keys++;
+  pthread_mutex_unlock(&table->lock);
+  return copy;
+}
+
+const char* json_intern_lookup(struct json_intern *table, const char *key, size_t n) {
+  struct json_intern_slots *slots = __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+
+  if(!slots) return 0;
+  return json_intern_probe(slots, key, n, json_object_hash(key, n));
+}
+
+uint32_t json_intern_hash(const char *key) {
+  uint32_t hash;
+  memcpy(&hash, key - sizeof(uint32_t), sizeof(uint32_t));
+  return hash;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to find a key without the lock.  The slots are probed in
+   turn from the home slot of the hash, and the key of each slot is
+   read once, such that a slot that is filled meanwhile is either seen
+   whole or as empty.  Returns the canonical key, or null if an empty
+   slot is reached first. */
+const char* json_intern_probe(const struct json_intern_slots *slots, const char *key, size_t n,
+			      uint32_t hash) {
+  const struct json_intern_slot *slot = 0;
+  const char *canonical = 0;
+  unsigned int i;
+
+  for(i = hash & slots->mask;; i = (i + 1) & slots->mask) {
+    slot = &slots->slot[i];
+    canonical = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+    if(!canonical) return 0;
+    if(slot->hash == hash && slot->len == n && !memcmp(canonical, key, n)) return canonical;
+  }
+}
+
+/* A function to find the slot of a key, with the lock held.  Returns
+   the slot that holds the key, or the empty slot where it would be
+   added. */
+struct json_intern_slot* json_intern_find(const struct json_intern_slots *slots, const char *key,
+					  size_t n, uint32_t hash) {
+  struct json_intern_slot *slot = 0;
+  unsigned int i;
+
+  for(i = hash & slots->mask;; i = (i + 1) & slots->mask) {
+    slot = &slots->slot[i];
+    if(!slot->key) return slot;
+    if(slot->hash == hash && slot->len == n && !memcmp(slot->key, key, n)) return slot;
+  }
+}
+
+/* A function to double the number of slots of a table, with the lock
+   held.  The keys are moved to their slots in the new table by their
+   stored hashes, without being compared.  The new slots are complete
+   before they are published, and the old slots are kept for the
+   threads that may still be probing them.  Returns zero on success. */
+int json_intern_grow(struct json_intern *table) {
+  struct json_intern_slots *slots = 0, *old_slots = table->slots;
+  unsigned int nslots = old_slots ? 2*(old_slots->mask + 1) : JSON_INTERN_MIN_SLOTS;
+  unsigned int old_nslots = old_slots ? old_slots->mask + 1 : 0;
+  unsigned int i, j;
+
+  slots = (struct json_intern_slots*)calloc(1, sizeof(struct json_intern_slots) +
+					    nslots*sizeof(struct json_intern_slot));
+  if(!slots) {
+    fprintf(stderr, "Error: could not allocate memory for the slots of an interning table.\n");
+    return 1;
+  }
+  slots->prev = old_slots;
+  slots->mask = nslots - 1;
+  slots->slot = (struct json_intern_slot*)(slots + 1);
+
+  for(i=0;i<old_nslots;i++) {
+    if(!old_slots->slot[i].key) continue;
+    for(j = old_slots->slot[i].hash & slots->mask; slots->slot[j].key; j = (j + 1) & slots->mask);
+    slots->slot[j] = old_slots->slot[i];
+  }
+
+  __atomic_store_n(&table->slots, slots, __ATOMIC_RELEASE);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef JSON_INTERN_H
+#define JSON_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "json.h"
+
+/* The number of slots of a table when the first key is added. */
+#define JSON_INTERN_MIN_SLOTS 64
+
+/* The size of the arena blocks that hold the keys.  The keys of most
+   documents are few, so this is smaller than JSON_ARENA_BLK_SZ. */
+#define JSON_INTERN_BLK_SZ 65536
+
+/* One key of an interning table, with the hash from json_object_hash
+   and the number of characters without the terminator.  The key is
+   stored last, such that a slot that has a key is complete. */
+struct json_intern_slot {
+  uint32_t hash;
+  unsigned int len;
+  const char *key; /* Either null, if the slot is empty, or the canonical key */
+};
+
+/* The slots of an interning table, which are allocated together with
+   this header.  When the table grows, the slots that are replaced are
+   kept until the table is freed, as other threads may still be
+   probing them. */
+struct json_intern_slots {
+  struct json_intern_slots *prev; /* Either null or the slots that these replaced */
+  unsigned int mask; /* The number of slots minus one */
+  struct json_intern_slot *slot;
+};
+
+/* A table of the keys of objects, in which each distinct key is
+   stored once.  A json_data that uses the table sets the str_value of
+   each JSON_PAIR to the canonical copy of its key, rather than to a
+   copy of its own, so keys that are repeated within a document, or
+   across documents, share their memory, and two keys are the same if
+   their pointers are equal.  The keys are kept as they appear in the
+   document, with any escape sequences.  The table is an open
+   addressing hash table, which is kept at most half full, and the keys
+   are carved from its arena.  Several documents may be read into
+   json_data structs that share the table at once.  A key that is in
+   the table already is found without taking the lock, and only new
+   keys are added under the lock. */
+struct json_intern {
+  struct json_intern_slots *slots; /* Either null or the current slots */
+  unsigned int n_keys;
+  struct json_arena arena; /* Owns the characters of the keys */
+  pthread_mutex_t lock; /* Held while keys are added */
+};
+
+/* Prepare a table for use.  Returns zero on success. */
+int json_intern_init(struct json_intern *table);
+
+/* Free the keys and the slots of a table.  The json_data structs that
+   use the table must be freed first. */
+void json_intern_free(struct json_intern *table);
+
+/* Switch a json_data to store the keys of objects in a table.  The
+   table must outlive the json_data, and may be shared by any number
+   of them.  This applies to json_read_ascii_buffer,
+   json_read_ascii_buffer_insitu, json_read_ascii_file,
+   json_read_ascii_buffer_parallel, json_read_ascii_buffer_lazy,
+   json_read_ubjson_buffer, json_parser_init and json_tape_to_data.
+   This must be called before anything is read into the json_data. */
+void json_data_use_intern(struct json_data *json, struct json_intern *table);
+
+/* Return the canonical copy of a key, which is added to the table if
+   it is not there yet.  The arguments are (table, key, number of
+   characters).  The copy is terminated.  Returns null if the key could
+   not be added. */
+const char* json_intern_key(struct json_intern *table, const char *key, size_t n);
+
+/* Return the canonical copy of a key, or null if the key is not in the
+   table.  Nothing is added, and the lock is not taken.  A key that is
+   not in the table is not the key of any pair read with the table,
+   which json_object_find_interned relies on. */
+const char* json_intern_lookup(struct json_intern *table, const char *key, size_t n);
+
+/* The hash of a canonical key, from json_object_hash, which is stored
+   with the key rather than computed again.  The key must have been
+   returned by json_intern_key or json_intern_lookup. */
+uint32_t json_intern_hash(const char *key);
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_lazy.h"
+#include "json_scan.h"
+
+/* What may follow, while the grammar of the structure is checked. */
+#define JSON_LAZY_EXPECT_VALUE 0 /* A value, after a ':' or ',' or at the top level */
+#define JSON_LAZY_EXPECT_FIRST_VALUE 1 /* A value or ']', after a '[' */
+#define JSON_LAZY_EXPECT_KEY 2 /* A key, after a ',' in an object */
+#define JSON_LAZY_EXPECT_FIRST_KEY 3 /* A key or '}', after a '{' */
+#define JSON_LAZY_EXPECT_COLON 4 /* A ':', after a key */
+#define JSON_LAZY_EXPECT_COMMA 5 /* A ',' or the end of the object or array */
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_lazy_scan(struct json_lazy *lazy);
+int json_lazy_match(struct json_lazy *lazy);
+struct json_value* json_lazy_value(struct json_lazy *lazy, size_t *i);
+int json_lazy_error(const struct json_lazy *lazy, const char *msg, size_t i);
+char json_lazy_char(const struct json_lazy *lazy, size_t i);
+struct json_value* json_string_value(struct json_data *json, const char *str, size_t str_len);
+struct json_value* json_key_value(struct json_data *json, const char *str, size_t str_len);
+int json_append_value(struct json_data *json, struct json_value *json_value);
+struct json_value* json_add_structure(struct json_data *json, int json_type);
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv);
+size_t json_scalar_end(const char *buffer, size_t i, size_t size);
+int json_parse_scalar(const char *str, size_t n, struct json_value *jv);
+
+size_t json_read_ascii_buffer_lazy(struct json_data *json, const struct char_buffer *buffer) {
+  struct json_lazy *lazy = 0;
+  size_t i = 0;
+
+  if(json->n_json_values || json->lazy) {
+    fprintf(stderr, "Error: a json_data must be empty to be read on demand.\n");
+    return 0;
+  }
+  if(buffer->size >= JSON_LAZY_OPEN) {
+    fprintf(stderr, "Error: the buffer is too large to be read on demand.\n");
+    return 0;
+  }
+  if(!json->arena && json_data_use_arena(json, 0)) return 0;
+
+  lazy = (struct json_lazy*)malloc(sizeof(struct json_lazy));
+  if(!lazy) {
+    fprintf(stderr, "Error: could not allocate memory for the structure of the document.\n");
+    return 0;
+  }
+  lazy->buffer = buffer->buffer;
+  lazy->size = buffer->size;
+  lazy->indices = 0;
+  lazy->n_indices = 0;
+  lazy->json = json;
+  json->lazy = lazy;
+
+  if(json_lazy_scan(lazy) || json_lazy_match(lazy)) return 0;
+
+  /* The top-level values are created now, and containers among them
+     are read when they are accessed. */
+  while(i < lazy->n_indices) {
+    if(!json_lazy_value(lazy, &i)) return 0;
+  }
+
+  return json->n_json_values;
+}
+
+int json_lazy_pending(const struct json_value *jv) {
+  return (jv->json_type == JSON_OBJECT || jv->json_type == JSON_ARRAY) &&
+    jv->nchildren == 0 && jv->value.lazy;
+}
+
+int json_lazy_expand(struct json_value *jv) {
+  struct json_lazy_ref *ref = 0;
+  struct json_lazy *lazy = 0;
+  struct json_value *pair = 0, *child = 0;
+  size_t i, end;
+
+  if(!json_lazy_pending(jv)) return 0;
+
+  ref = jv->value.lazy;
+  lazy = ref->lazy;
+  i = ref->position;
+  end = lazy->indices[i] & ~JSON_LAZY_OPEN;
+  i++;
+
+  /* The reference shares the union with the index of an object, which
+     is cleared as children are added. */
+  jv->value.lazy = 0;
+
+  /* The grammar was checked when the structure was recorded, so the
+     keys, ':' and ',' are where they should be. */
+  while(i < end) {
+    pair = 0;
+    if(jv->json_type == JSON_OBJECT) {
+      pair = json_key_value(lazy->json, lazy->buffer + lazy->indices[i] + 1,
+			    lazy->indices[i+1] - lazy->indices[i] - 1);
+      if(!pair || json_append_value(lazy->json, pair) || json_add_element(lazy->json, jv, pair)) break;
+      i += 3; /* The quotes of the key and the ':' */
+    }
+
+    child = json_lazy_value(lazy, &i);
+    if(!child || json_add_element(lazy->json, pair ? pair : jv, child)) break;
+    i++; /* The ',' or the closing bracket */
+  }
+  if(i <= end) {
+    /* The container is left pending, to be read again, rather than
+       with only some of its children.  The children that were read
+       belong to the arena. */
+    jv->nchildren = 0;
+    jv->value.lazy = ref;
+    return 1;
+  }
+
+  return 0;
+}
+
+int json_lazy_expand_all(struct json_data *json) {
+  unsigned int i;
+
+  /* The children of a container are appended to the json_values, and
+     so are reached by the same loop. */
+  for(i=0;i<json->n_json_values;i++) {
+    if(json->json_values[i] && json_lazy_expand(json->json_values[i])) return 1;
+  }
+  return 0;
+}
+
+void json_lazy_free(struct json_lazy *lazy) {
+  if(lazy->indices) free(lazy->indices);
+  lazy->indices = 0;
+  lazy->n_indices = 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to record the offsets of the structural characters of the
+   whole buffer.  The buffer is scanned a window at a time, such that
+   the scanner only needs an index array the size of one window. */
+int json_lazy_scan(struct json_lazy *lazy) {
+  struct json_scanner scanner;
+  uint32_t *window = 0, *realloc_indices = 0;
+  size_t size_of_indices = 0, offset, n, k, i;
+
+  window = (uint32_t*)malloc(JSON_LAZY_WINDOW_SZ*sizeof(uint32_t));
+  if(!window) {
+    fprintf(stderr, "Error: could not allocate memory to scan the document.\n");
+    return 1;
+  }
+
+  json_scanner_clear(&scanner);
+  for(offset=0;offset<lazy->size;offset+=JSON_LAZY_WINDOW_SZ) {
+    k = lazy->size - offset < JSON_LAZY_WINDOW_SZ ? lazy->size - offset : JSON_LAZY_WINDOW_SZ;
+    n = json_scan_structurals(&scanner, lazy->buffer + offset, k, window);
+
+    /* The index array grows geometrically, from a guess of one offset
+       for every eight characters. */
+    if(lazy->n_indices + n > size_of_indices) {
+      size_of_indices = size_of_indices ? 2*size_of_indices : lazy->size/8 + 64;
+      if(size_of_indices < lazy->n_indices + n) size_of_indices = lazy->n_indices + n;
+      realloc_indices = (uint32_t*)realloc(lazy->indices, size_of_indices*sizeof(uint32_t));
+      if(!realloc_indices) {
+	fprintf(stderr, "Error: could not allocate memory to scan the document.\n");
+	free(window);
+	return 2;
+      }
+      lazy->indices = realloc_indices;
+    }
+    for(i=0;i<n;i++) lazy->indices[lazy->n_indices+i] = (uint32_t)(offset + window[i]);
+    lazy->n_indices += n;
+  }
+  free(window);
+
+  /* The spare room of the last guess is given back. */
+  if(lazy->n_indices && lazy->n_indices < size_of_indices) {
+    realloc_indices = (uint32_t*)realloc(lazy->indices, lazy->n_indices*sizeof(uint32_t));
+    if(realloc_indices) lazy->indices = realloc_indices;
+  }
+
+  if(scanner.prev_in_string) {
+    printf("Error: the buffer ends within a string at character %lu\n", (unsigned long)lazy->size);
+    return 3;
+  }
+  return 0;
+}
+
+/* A function to find the closing bracket of each object and array,
+   and store its index in the entry of the opening bracket.  The
+   grammar of the structure is checked on the way, as json_parser
+   does, and each number, true, false or null is converted and thrown
+   away, such that a document is rejected here rather than when a
+   container is read. */
+int json_lazy_match(struct json_lazy *lazy) {
+  uint32_t *stack = 0, *realloc_stack = 0;
+  size_t depth = 0, size_of_stack = 64, i, open, n;
+  int expect = JSON_LAZY_EXPECT_VALUE;
+  struct json_value jv;
+  char c;
+
+  stack = (uint32_t*)malloc(size_of_stack*sizeof(uint32_t));
+  if(!stack) {
+    fprintf(stderr, "Error: could not allocate memory to match the brackets of the document.\n");
+    return 1;
+  }
+
+  for(i=0;i<lazy->n_indices;i++) {
+    c = lazy->buffer[lazy->indices[i]];
+    if(c == '{' || c == '[') {
+      if(expect != JSON_LAZY_EXPECT_VALUE && expect != JSON_LAZY_EXPECT_FIRST_VALUE) {
+	free(stack);
+	return json_lazy_error(lazy, "missing separator", i);
+      }
+      if(depth == size_of_stack) {
+	realloc_stack = (uint32_t*)realloc(stack, 2*size_of_stack*sizeof(uint32_t));
+	if(!realloc_stack) {
+	  fprintf(stderr, "Error: could not allocate memory to match the brackets of the document.\n");
+	  free(stack);
+	  return 1;
+	}
+	stack = realloc_stack;
+	size_of_stack *= 2;
+      }
+      stack[depth++] = (uint32_t)i;
+      expect = c == '{' ? JSON_LAZY_EXPECT_FIRST_KEY : JSON_LAZY_EXPECT_FIRST_VALUE;
+    }
+    else if(c == '}' || c == ']') {
+      open = depth ? stack[depth-1] : 0;
+      if(!depth || lazy->buffer[lazy->indices[open]] != (c == '}' ? '{' : '[')) {
+	free(stack);
+	return json_lazy_error(lazy, "unbalanced brackets", i);
+      }
+      if(!(expect == JSON_LAZY_EXPECT_COMMA ||
+	   (c == '}' && expect == JSON_LAZY_EXPECT_FIRST_KEY) ||
+	   (c == ']' && expect == JSON_LAZY_EXPECT_FIRST_VALUE))) {
+	free(stack);
+	return json_lazy_error(lazy, c == '}' ? "unexpected '}'" : "unexpected ']'", i);
+      }
+      lazy->indices[open] = JSON_LAZY_OPEN | (uint32_t)i;
+      depth--;
+      expect = depth ? JSON_LAZY_EXPECT_COMMA : JSON_LAZY_EXPECT_VALUE;
+    }
+    else if(c == ':') {
+      if(expect != JSON_LAZY_EXPECT_COLON) {
+	free(stack);
+	return json_lazy_error(lazy, "a pair must have a string key", i);
+      }
+      expect = JSON_LAZY_EXPECT_VALUE;
+    }
+    else if(c == ',') {
+      if(expect != JSON_LAZY_EXPECT_COMMA) {
+	free(stack);
+	return json_lazy_error(lazy, "unexpected ','", i);
+      }
+      expect = lazy->buffer[lazy->indices[stack[depth-1]]] == '{' ?
+	JSON_LAZY_EXPECT_KEY : JSON_LAZY_EXPECT_VALUE;
+    }
+    else if(c == '"') {
+      /* The scanner found the closing quote, as the buffer does not end
+	 within a string. */
+      if(expect == JSON_LAZY_EXPECT_KEY || expect == JSON_LAZY_EXPECT_FIRST_KEY) {
+	expect = JSON_LAZY_EXPECT_COLON;
+      }
+      else if(expect == JSON_LAZY_EXPECT_VALUE || expect == JSON_LAZY_EXPECT_FIRST_VALUE) {
+	expect = depth ? JSON_LAZY_EXPECT_COMMA : JSON_LAZY_EXPECT_VALUE;
+      }
+      else {
+	free(stack);
+	return json_lazy_error(lazy, "unexpected string", i);
+      }
+      i++;
+    }
+    else {
+      if(expect != JSON_LAZY_EXPECT_VALUE && expect != JSON_LAZY_EXPECT_FIRST_VALUE) {
+	free(stack);
+	return json_lazy_error(lazy, "unexpected value", i);
+      }
+      n = json_scalar_end(lazy->buffer, lazy->indices[i], lazy->size) - lazy->indices[i];
+      json_clear_value(&jv);
+      if(json_parse_scalar(lazy->buffer + lazy->indices[i], n, &jv)) {
+	free(stack);
+	return json_lazy_error(lazy, "not a valid number, true, false or null", i);
+      }
+      expect = depth ? JSON_LAZY_EXPECT_COMMA : JSON_LAZY_EXPECT_VALUE;
+    }
+  }
+  free(stack);
+
+  if(depth) {
+    printf("Error: the buffer ends within an object or an array at character %lu\n",
+	   (unsigned long)lazy->size);
+    return 2;
+  }
+  return 0;
+}
+
+/* A function to create the value that starts at an index, and move the
+   index past it.  The arguments are (structure, pointer to the
+   index).  Objects and arrays are created without their children.
+   The grammar has already been
+   checked.  Returns the json_value, or null if it could not be
+   allocated. */
+struct json_value* json_lazy_value(struct json_lazy *lazy, size_t *i) {
+  struct json_value *jv = 0;
+  const char *str = 0;
+  size_t n, close;
+
+  switch(json_lazy_char(lazy, *i)) {
+  case '{': case '[':
+    jv = json_add_structure(lazy->json, json_lazy_char(lazy, *i) == '{' ? JSON_OBJECT : JSON_ARRAY);
+    if(!jv) return 0;
+
+    /* An empty container has nothing to read later. */
+    close = lazy->indices[*i] & ~JSON_LAZY_OPEN;
+    if(close != *i + 1) {
+      jv->value.lazy = (struct json_lazy_ref*)json_data_alloc(lazy->json, sizeof(struct json_lazy_ref));
+      if(!jv->value.lazy) return 0;
+      jv->value.lazy->lazy = lazy;
+      jv->value.lazy->position = (uint32_t)*i;
+    }
+    *i = close + 1;
+    return jv;
+
+  case '"':
+    str = lazy->buffer + lazy->indices[*i];
+    jv = json_string_value(lazy->json, str + 1, lazy->indices[*i+1] - lazy->indices[*i] - 1);
+    if(!jv || json_append_value(lazy->json, jv)) return 0;
+    *i += 2;
+    return jv;
+
+  default:
+    jv = json_add_structure(lazy->json, JSON_NDEF);
+    if(!jv) return 0;
+    str = lazy->buffer + lazy->indices[*i];
+    n = json_scalar_end(lazy->buffer, lazy->indices[*i], lazy->size) - lazy->indices[*i];
+    if(json_parse_scalar(str, n, jv)) {
+      json_lazy_error(lazy, "not a valid number, true, false or null", *i);
+      return 0;
+    }
+    (*i)++;
+    return jv;
+  }
+}
+
+/* A function to report a syntax error at an index.  The offset of an
+   opening bracket is not kept, so the error is placed at its closing
+   bracket instead.  Returns 1. */
+int json_lazy_error(const struct json_lazy *lazy, const char *msg, size_t i) {
+  unsigned long offset = lazy->size;
+  if(i < lazy->n_indices) {
+    if(lazy->indices[i] & JSON_LAZY_OPEN) i = lazy->indices[i] & ~JSON_LAZY_OPEN;
+    offset = lazy->indices[i];
+  }
+  printf("Error: %s at character %lu\n", msg, offset);
+  return 1;
+}
+
+/* A function to return the character at an index of the structure. */
+char json_lazy_char(const struct json_lazy *lazy, size_t i) {
+  uint32_t entry = lazy->indices[i];
+  if(entry & JSON_LAZY_OPEN) {
+    return lazy->buffer[lazy->indices[entry & ~JSON_LAZY_OPEN]] == '}' ? '{' : '[';
+  }
+  return lazy->buffer[entry];
+}
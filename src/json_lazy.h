@@ -0,0 +1,76 @@
+#ifndef JSON_LAZY_H
+#define JSON_LAZY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+/* The number of characters that are scanned at a time, when the
+   structure of a document is recorded. */
+#define JSON_LAZY_WINDOW_SZ 65536
+
+/* The flag of an entry of the structure that is an opening bracket.
+   The rest of the entry is the index of the closing bracket, rather
+   than an offset, and so documents read on demand must be smaller
+   than 2 GiB. */
+#define JSON_LAZY_OPEN 0x80000000U
+
+/* The structure of a document that is read as it is accessed.  The
+   offsets of the structural characters, quotes and scalars are found
+   up front, and the entry of each opening bracket is replaced by the
+   index of its closing bracket.  The containers are read from the
+   structure when they are first accessed. */
+struct json_lazy {
+  const char *buffer; /* The caller's buffer, which must be kept */
+  size_t size;
+  uint32_t *indices; /* The offsets, or JSON_LAZY_OPEN and an index, in order */
+  size_t n_indices;
+  struct json_data *json; /* The json_data that the values are added to */
+};
+
+/* Where an object or array that has not been read yet starts.  This
+   is stored in the value of the container, until it is read. */
+struct json_lazy_ref {
+  struct json_lazy *lazy;
+  uint32_t position; /* The index of the opening bracket */
+};
+
+/* A function to read a buffer that contains json on demand.  Only the
+   structure of the document is recorded, and the whole document is
+   checked, as json_read_ascii_buffer does.  Each object and array
+   starts out without children, which are created, with their strings
+   and numbers decoded, the first time that the container is accessed
+   through json_value_nchildren, json_value_child, json_object_get or
+   json_query_eval.  Code that reads the children array directly must
+   first call json_lazy_expand, and the writers and json_tape_from_data
+   must be given a tree that was read with json_lazy_expand_all.  The
+   buffer must not be freed or changed, and the json_data must not be
+   moved, before the json_data is freed.  The json_data must be empty,
+   and an arena is used if it does not have one.  The function returns
+   the number of top-level json_values, or zero if the document is not
+   valid. */
+size_t json_read_ascii_buffer_lazy(struct json_data *, const struct char_buffer *);
+
+/* Returns non-zero if the json_value is an object or array whose
+   children have not been read yet. */
+int json_lazy_pending(const struct json_value *jv);
+
+/* Read the children of an object or array, if they have not been read
+   yet.  The children are objects and arrays that are not read in
+   turn, or values.  Returns zero on success, or non-zero if memory
+   could not be allocated, in which case the container is left
+   without children, to be read again. */
+int json_lazy_expand(struct json_value *jv);
+
+/* Read every object and array of a json_data that has not been read
+   yet, such that the tree can be written, or shared between threads.
+   Returns zero on success, or non-zero if memory could not be
+   allocated. */
+int json_lazy_expand_all(struct json_data *json);
+
+/* Free the memory that belongs to the structure of a document.  The
+   json_values are freed with the json_data. */
+void json_lazy_free(struct json_lazy *lazy);
+
+#endif
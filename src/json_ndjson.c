@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_ndjson.h"
+#include "json_parser.h"
+#include "json_scan.h"
+
+/* The number of records that a worker takes at a time. */
+#define JSON_NDJSON_BATCH 64
+
+/* The smallest and largest arena block used for a record. */
+#define JSON_NDJSON_MIN_BLK_SZ 1024
+#define JSON_NDJSON_MAX_BLK_SZ JSON_ARENA_BLK_SZ
+
+/* The arena block size of a worker that passes records to a callback,
+   whose arena is reused for every record. */
+#define JSON_NDJSON_WORKER_BLK_SZ 65536
+
+/* The position of one record within the buffer. */
+struct json_ndjson_record {
+  const char *start;
+  size_t size;
+};
+
+/* The work that is shared between the worker threads. */
+struct json_ndjson_job {
+  const struct json_ndjson_record *records;
+  size_t n_records;
+  size_t next_record; /* The next record that has not been taken */
+  pthread_mutex_t lock; /* Protects next_record and status */
+
+  struct json_data *results; /* Either null or one json_data per record */
+  json_record_callback callback;
+  void *ctx;
+  int status; /* Non-zero once the job is stopped, by a callback or for want of memory */
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+size_t json_ndjson_split(const struct char_buffer *buffer, struct json_ndjson_record **records);
+int json_ndjson_run(struct json_ndjson_job *job, unsigned int n_threads);
+void* json_ndjson_worker(void *arg);
+int json_ndjson_parse(struct json_parser *parser, const struct json_ndjson_record *record,
+		      struct json_data *json);
+
+size_t json_read_ndjson_buffer(struct json_data **results, const struct char_buffer *buffer,
+			       unsigned int n_threads) {
+  struct json_ndjson_job job;
+  struct json_ndjson_record *records = 0;
+  size_t n_records = 0;
+  size_t i;
+
+  *results = 0;
+  n_records = json_ndjson_split(buffer, &records);
+  if(!n_records) return 0;
+
+  *results = (struct json_data*)malloc(n_records*sizeof(struct json_data));
+  if(!*results) {
+    fprintf(stderr, "Error: could not allocate memory for the ndjson records.\n");
+    free(records);
+    return 0;
+  }
+  for(i=0;i<n_records;i++) json_data_clear(&(*results)[i]);
+
+  job.records = records;
+  job.n_records = n_records;
+  job.results = *results;
+  job.callback = 0;
+  job.ctx = 0;
+  json_ndjson_run(&job, n_threads);
+  free(records);
+
+  /* A record that was not read, rather than found to be invalid, would
+     look like an invalid line, so no records are returned. */
+  if(job.status || job.next_record < n_records) {
+    fprintf(stderr, "Error: could not read all of the ndjson records.\n");
+    json_free_ndjson(*results, n_records);
+    *results = 0;
+    return 0;
+  }
+  return n_records;
+}
+
+int json_read_ndjson_callback(const struct char_buffer *buffer, unsigned int n_threads,
+			      json_record_callback callback, void *ctx) {
+  struct json_ndjson_job job;
+  struct json_ndjson_record *records = 0;
+  size_t n_records = 0;
+
+  n_records = json_ndjson_split(buffer, &records);
+  if(!n_records) return 0;
+
+  job.records = records;
+  job.n_records = n_records;
+  job.results = 0;
+  job.callback = callback;
+  job.ctx = ctx;
+  json_ndjson_run(&job, n_threads);
+
+  free(records);
+  return job.status;
+}
+
+void json_free_ndjson(struct json_data *results, size_t n_records) {
+  size_t i;
+  if(!results) return;
+  for(i=0;i<n_records;i++) json_free_value_array(&results[i]);
+  free(results);
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to find the records in a buffer.  A raw newline cannot
+   occur within a json string, therefore every newline ends a record.
+   Lines that only contain white space are skipped.  Returns the number
+   of records, which are stored in an allocated array. */
+size_t json_ndjson_split(const struct char_buffer *buffer, struct json_ndjson_record **records) {
+  struct json_ndjson_record *realloc_records = 0;
+  size_t n_records = 0, size_of_records = 0;
+  const char *c = buffer->buffer;
+  const char *end = buffer->buffer + buffer->size;
+  const char *newline = 0;
+  const char *s = 0;
+
+  *records = 0;
+  while(c < end) {
+    newline = (const char*)memchr(c, '\n', (size_t)(end - c));
+    if(!newline) newline = end;
+
+    /* Skip blank lines. */
+    for(s=c;s<newline;s++) {
+      if(*s != ' ' && *s != '\t' && *s != '\r') break;
+    }
+    if(s < newline) {
+      if(n_records == size_of_records) {
+	size_of_records = size_of_records ? 2*size_of_records : 1024;
+	realloc_records = (struct json_ndjson_record*)realloc(*records,
+							      size_of_records*sizeof(struct json_ndjson_record));
+	if(!realloc_records) {
+	  fprintf(stderr, "Error: could not allocate memory for the ndjson records.\n");
+	  free(*records);
+	  *records = 0;
+	  return 0;
+	}
+	*records = realloc_records;
+      }
+      (*records)[n_records].start = c;
+      (*records)[n_records].size = (size_t)(newline - c);
+      n_records++;
+    }
+    c = newline + 1;
+  }
+  return n_records;
+}
+
+/* A function to run the worker threads, until all of the records have
+   been parsed.  The calling thread is one of the workers. */
+int json_ndjson_run(struct json_ndjson_job *job, unsigned int n_threads) {
+  pthread_t *threads = 0;
+  unsigned int i, n_started = 0;
+  long n_cpu = 0;
+
+  if(!n_threads) {
+    n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = n_cpu > 0 ? (unsigned int)n_cpu : 1;
+  }
+
+  /* There is no point in starting threads that have nothing to do. */
+  if(n_threads > (job->n_records + JSON_NDJSON_BATCH - 1)/JSON_NDJSON_BATCH) {
+    n_threads = (unsigned int)((job->n_records + JSON_NDJSON_BATCH - 1)/JSON_NDJSON_BATCH);
+  }
+
+  /* Choose the scanner before the threads start, rather than in each
+     of them. */
+  json_scan_implementation();
+
+  job->next_record = 0;
+  job->status = 0;
+  pthread_mutex_init(&job->lock, 0);
+
+  if(n_threads > 1) {
+    threads = (pthread_t*)malloc((n_threads-1)*sizeof(pthread_t));
+    if(!threads) {
+      fprintf(stderr, "Warning: could not allocate worker threads, reading on one thread.\n");
+    }
+    else {
+      for(i=0;i<n_threads-1;i++) {
+	if(pthread_create(&threads[i], 0, json_ndjson_worker, job)) break;
+	n_started++;
+      }
+    }
+  }
+
+  json_ndjson_worker(job);
+
+  for(i=0;i<n_started;i++) pthread_join(threads[i], 0);
+  free(threads);
+  pthread_mutex_destroy(&job->lock);
+  return job->status;
+}
+
+/* The worker thread.  Records are taken in batches, to reduce the
+   contention for the lock.  Each worker keeps one parser for all of
+   its records.  When the records are passed to a callback, the worker
+   also keeps one json_data, whose arena is reset between records, such
+   that the workers do not allocate for each record.  A worker that
+   cannot be prepared stops the job when the records are passed to a
+   callback, and otherwise leaves its records to the other workers.  A
+   record that cannot be read for want of memory stops the job. */
+void* json_ndjson_worker(void *arg) {
+  struct json_ndjson_job *job = (struct json_ndjson_job*)arg;
+  struct json_parser parser;
+  struct json_data json;
+  size_t first, last, i;
+  int ret = 0;
+
+  json_data_clear(&json);
+  if((!job->results && json_data_use_arena(&json, JSON_NDJSON_WORKER_BLK_SZ)) ||
+     json_parser_init(&parser, &json)) {
+    fprintf(stderr, "Error: could not prepare an ndjson worker.\n");
+    json_free_value_array(&json);
+    if(!job->results) {
+      pthread_mutex_lock(&job->lock);
+      if(!job->status) job->status = -1;
+      pthread_mutex_unlock(&job->lock);
+    }
+    return 0;
+  }
+
+  for(;;) {
+    pthread_mutex_lock(&job->lock);
+    if(job->status) {
+      pthread_mutex_unlock(&job->lock);
+      break;
+    }
+    first = job->next_record;
+    last = first + JSON_NDJSON_BATCH;
+    if(last > job->n_records) last = job->n_records;
+    job->next_record = last;
+    pthread_mutex_unlock(&job->lock);
+
+    if(first >= last) break;
+
+    for(i=first;i<last;i++) {
+      if(job->results) {
+	ret = json_ndjson_parse(&parser, &job->records[i], &job->results[i]) == 1 ? -1 : 0;
+      }
+      else {
+	json_data_reset(&json);
+	ret = json_ndjson_parse(&parser, &job->records[i], &json) == 1 ? -1 : 0;
+	if(!ret) ret = job->callback(job->ctx, i, &json);
+      }
+      if(ret) {
+	pthread_mutex_lock(&job->lock);
+	if(!job->status) job->status = ret;
+	pthread_mutex_unlock(&job->lock);
+	break;
+      }
+    }
+    if(ret) break;
+  }
+
+  json_parser_free(&parser);
+  json_free_value_array(&json);
+  return 0;
+}
+
+/* A function to parse one record.  The parser is pointed at the
+   json_data of the record, and keeps its buffers from the records
+   before.  A json_data without an arena is given its own, whose block
+   size follows the size of the record, such that small records do not
+   each hold a large block.  The json_data is left empty if the record
+   is not read.  Returns zero on success, one if memory could not be
+   allocated, or two if the record is not valid. */
+int json_ndjson_parse(struct json_parser *parser, const struct json_ndjson_record *record,
+		      struct json_data *json) {
+  size_t block_size = 8*record->size;
+
+  if(!json->arena) {
+    if(block_size < JSON_NDJSON_MIN_BLK_SZ) block_size = JSON_NDJSON_MIN_BLK_SZ;
+    if(block_size > JSON_NDJSON_MAX_BLK_SZ) block_size = JSON_NDJSON_MAX_BLK_SZ;
+    if(json_data_use_arena(json, block_size)) return 1;
+  }
+
+  parser->json = json;
+  json_parser_reset(parser);
+  json_parser_feed(parser, record->start, record->size);
+  if(!json_parser_finish(parser)) {
+    json_data_reset(json);
+    /* The tree is only aborted when it cannot be allocated. */
+    if(parser->status == JSON_PARSER_NOMEM || parser->status == JSON_PARSER_ABORTED) return 1;
+    return 2;
+  }
+  return 0;
+}
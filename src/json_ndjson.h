@@ -0,0 +1,41 @@
+#ifndef JSON_NDJSON_H
+#define JSON_NDJSON_H
+
+#include "json.h"
+
+/* The function that is called for each record of a newline delimited
+   json buffer.  The arguments are (context pointer, record number,
+   json_data).  The record number counts the non-empty lines from zero.
+   The json_data is empty if the record is not valid json, and is only
+   valid until the function returns, as each worker reuses its memory
+   for the next record.  The function is called from the worker
+   threads, and so records are not reported in order.  Returns zero to
+   continue, or non-zero to stop reading records. */
+typedef int (*json_record_callback)(void *, size_t, struct json_data *);
+
+/* A function to read a buffer of newline delimited json (JSON Lines),
+   where each non-empty line is a separate document.  The records are
+   parsed concurrently, by a pool of worker threads.  Each record has
+   its own arena.  The arguments are (pointer to the array of records,
+   buffer, number of threads), where zero threads selects the number of
+   online processors.  The array of records is allocated, and is in the
+   same order as the input.  A record that is not valid json is left
+   empty.  Returns the number of records, or zero if there are none or
+   if any record could not be read for want of memory, in which case
+   no records are returned. */
+size_t json_read_ndjson_buffer(struct json_data **, const struct char_buffer *, unsigned int);
+
+/* A function to read a buffer of newline delimited json, passing each
+   record to a callback rather than keeping it.  The arguments are
+   (buffer, number of threads, callback, context pointer).  Returns
+   zero, the first non-zero value returned by the callback, or -1 if a
+   worker could not allocate its parser, or a record could not be read
+   for want of memory.  The other workers then stop taking records, and
+   the record that could not be read is not passed to the callback. */
+int json_read_ndjson_callback(const struct char_buffer *, unsigned int, json_record_callback, void *);
+
+/* Free the records returned by json_read_ndjson_buffer.  The arguments
+   are (array of records, number of records). */
+void json_free_ndjson(struct json_data *, size_t);
+
+#endif
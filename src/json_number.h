@@ -0,0 +1,37 @@
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stddef.h>
+
+#include "json.h"
+
+/* The largest number of characters written by json_format_int or
+   json_format_double. */
+#define JSON_NUMBER_MAX_SZ 32
+
+/* A function to parse a json number, which need not be terminated.
+   The arguments are (first character, number of characters,
+   json_value).  A number without a fraction or an exponent that fits
+   in a long is stored as a JSON_INT, and any other number as a
+   JSON_FLOAT, which is the nearest double.  All of the characters
+   must belong to the number.  Returns zero on success, or non-zero if
+   the characters are not a valid json number, or the number is too
+   large for a double. */
+int json_parse_number(const char *str, size_t n, struct json_value *jv);
+
+/* A function to write a long as decimal text.  The arguments are
+   (value, buffer), where the buffer has room for JSON_NUMBER_MAX_SZ
+   characters.  The text is not terminated.  Returns the number of
+   characters written. */
+size_t json_format_int(long l, char *buffer);
+
+/* A function to write a double as the shortest decimal text that reads
+   back as the same double.  The text always has a fraction or an
+   exponent, such that it is read back as a float: 1.0, 0.001, 1e-9,
+   1.5e+300.  Infinities and NaNs cannot be written as json, and are
+   written as null.  The arguments are (value, buffer), where the
+   buffer has room for JSON_NUMBER_MAX_SZ characters.  The text is not
+   terminated.  Returns the number of characters written. */
+size_t json_format_double(double d, char *buffer);
+
+#endif
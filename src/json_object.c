@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_intern.h"
+#include "json_lazy.h"
+#include "json_object.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_object_key_equal(const struct json_value *pair, const char *key, size_t n);
+struct json_value* json_object_pair_value(const struct json_value *pair);
+
+struct json_value* json_object_get(struct json_data *json, struct json_value *jv, const char *key,
+				   size_t n) {
+  unsigned int i;
+
+  if(!jv || jv->json_type != JSON_OBJECT || json_lazy_expand(jv)) return 0;
+
+  /* Small objects are searched in order, without hashing the key. */
+  if(jv->nchildren < JSON_OBJECT_INDEX_MIN || json_object_index(json, jv)) {
+    for(i=0;i<jv->nchildren;i++) {
+      if(json_object_key_equal(jv->children[i], key, n)) return json_object_pair_value(jv->children[i]);
+    }
+    return 0;
+  }
+
+  return json_object_find(jv, key, n, json_object_hash(key, n));
+}
+
+struct json_value* json_object_find(struct json_value *jv, const char *key, size_t n,
+				    uint32_t hash) {
+  const struct json_object_index *index = 0;
+  struct json_value *pair = 0;
+  unsigned int i, slot;
+
+  if(!jv || jv->json_type != JSON_OBJECT || json_lazy_expand(jv)) return 0;
+
+  index = jv->value.index;
+  if(!index || index->nchildren != jv->nchildren) {
+    for(i=0;i<jv->nchildren;i++) {
+      if(json_object_key_equal(jv->children[i], key, n)) return json_object_pair_value(jv->children[i]);
+    }
+    return 0;
+  }
+
+  /* The slots are probed in turn from the home slot of the hash,
+     until the key or an empty slot is found.  The pairs were inserted
+     in order, so the first pair with a repeated key is found first. */
+  for(slot = hash & index->mask; index->pairs[slot]; slot = (slot + 1) & index->mask) {
+    if(index->hashes[slot] != hash) continue;
+    pair = jv->children[index->pairs[slot] - 1];
+    if(json_object_key_equal(pair, key, n)) return json_object_pair_value(pair);
+  }
+
+  return 0;
+}
+
+struct json_value* json_object_find_interned(struct json_value *jv, const char *key) {
+  const struct json_object_index *index = 0;
+  struct json_value *pair = 0;
+  unsigned int i, slot;
+  uint32_t hash;
+
+  if(!key || !jv || jv->json_type != JSON_OBJECT || json_lazy_expand(jv)) return 0;
+
+  /* An index is probed with the hash that is stored with the key. */
+  index = jv->value.index;
+  if(index && index->nchildren == jv->nchildren) {
+    hash = json_intern_hash(key);
+    for(slot = hash & index->mask; index->pairs[slot]; slot = (slot + 1) & index->mask) {
+      if(index->hashes[slot] != hash) continue;
+      pair = jv->children[index->pairs[slot] - 1];
+      if(pair->value.str_value == key) return json_object_pair_value(pair);
+    }
+    return 0;
+  }
+
+  for(i=0;i<jv->nchildren;i++) {
+    if(jv->children[i] && jv->children[i]->value.str_value == key) return json_object_pair_value(jv->children[i]);
+  }
+  return 0;
+}
+
+int json_object_index(struct json_data *json, struct json_value *jv) {
+  struct json_object_index *index = 0;
+  struct json_value *pair = 0;
+  unsigned int nslots, i, slot;
+  uint32_t hash;
+
+  if(!jv || jv->json_type != JSON_OBJECT || json_lazy_expand(jv)) return 1;
+
+  /* An index that is out of step with the pairs is rebuilt. */
+  if(jv->value.index) {
+    if(jv->value.index->nchildren == jv->nchildren) return 0;
+    json_object_index_free(json, jv);
+  }
+  if(jv->nchildren < JSON_OBJECT_INDEX_MIN) return 0;
+
+  /* The table is at most half full, so that probe sequences stay
+     short. */
+  for(nslots = 2*JSON_OBJECT_INDEX_MIN; nslots < 2*jv->nchildren; nslots *= 2) {
+    if(nslots > (~0U)/4) return 2;
+  }
+
+  index = (struct json_object_index*)json_data_alloc(json, sizeof(struct json_object_index) +
+						     nslots*(sizeof(uint32_t) + sizeof(unsigned int)));
+  if(!index) {
+    fprintf(stderr, "Error: could not allocate memory for the index of an object.\n");
+    return 3;
+  }
+  index->nchildren = jv->nchildren;
+  index->mask = nslots - 1;
+  index->hashes = (uint32_t*)(index + 1);
+  index->pairs = (unsigned int*)(index->hashes + nslots);
+  memset(index->pairs, 0, nslots*sizeof(unsigned int));
+
+  for(i=0;i<jv->nchildren;i++) {
+    pair = jv->children[i];
+    if(!pair || pair->json_type != JSON_PAIR || !pair->value.str_value) continue;
+    if(json->intern) hash = json_intern_hash(pair->value.str_value);
+    else hash = json_object_hash(pair->value.str_value, pair->str_len);
+    for(slot = hash & index->mask; index->pairs[slot]; slot = (slot + 1) & index->mask);
+    index->hashes[slot] = hash;
+    index->pairs[slot] = i + 1;
+  }
+
+  jv->value.index = index;
+  return 0;
+}
+
+void json_object_index_free(struct json_data *json, struct json_value *jv) {
+  if(jv->json_type != JSON_OBJECT || json_lazy_pending(jv) || !jv->value.index) return;
+  /* An index in the arena is released with the arena. */
+  if(!json->arena) free(jv->value.index);
+  jv->value.index = 0;
+}
+
+uint32_t json_object_hash(const char *key, size_t n) {
+  /* FNV-1a, which is quick for the short keys of typical documents. */
+  uint32_t hash = 2166136261U;
+  size_t i;
+
+  for(i=0;i<n;i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/*===========================================================================*/
+/* Functions that are not declared in the header files. */
+
+int json_object_key_equal(const struct json_value *pair, const char *key, size_t n) {
+  if(!pair || pair->json_type != JSON_PAIR || !pair->value.str_value) return 0;
+  if(pair->str_len != n) return 0;
+  if(pair->value.str_value == key) return 1;
+  return memcmp(pair->value.str_value, key, n) == 0;
+}
+
+struct json_value* json_object_pair_value(const struct json_value *pair) {
+  if(pair->nchildren == 0) return 0;
+  return pair->children[0];
+}
@@ -0,0 +1,79 @@
+#ifndef JSON_OBJECT_H
+#define JSON_OBJECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+/* The number of pairs an object must have before its keys are
+   indexed.  Smaller objects are searched in order, which is faster
+   than hashing the key. */
+#define JSON_OBJECT_INDEX_MIN 16
+
+/* An open addressing hash table of the keys of one object.  Each slot
+   holds the hash of a key and the index of its pair plus one, or zero
+   if the slot is empty.  The table has at least twice as many slots
+   as the object has pairs. */
+struct json_object_index {
+  unsigned int nchildren; /* The number of pairs when the index was built */
+  unsigned int mask; /* The number of slots minus one */
+  uint32_t *hashes; /* The hash of the key in each slot */
+  unsigned int *pairs; /* The index of the pair in each slot plus one */
+};
+
+/* Find the value of a key in an object.  The arguments are
+   (json_data that the object was read into, object, key, number of
+   characters in the key).  The key is compared with the keys as they
+   appear in the document, with any escape sequences.  If a key is
+   repeated, the value of the first pair is returned.  The first lookup
+   in an object with at least JSON_OBJECT_INDEX_MIN pairs builds a hash
+   index of its keys, as json_object_index does.  An object must
+   therefore not be searched from more than one thread at a time, until
+   it has been indexed.  Returns the value, or null if the key is not
+   found or the json_value is not an object. */
+struct json_value* json_object_get(struct json_data *json, struct json_value *jv, const char *key,
+				   size_t n);
+
+/* Find the value of a key in an object, without building an index.
+   The arguments are (object, key, number of characters in the key,
+   hash of the key from json_object_hash).  The index is used if the
+   object has one that matches its pairs, and otherwise the pairs are
+   searched in order.  Nothing is allocated, unless the object is read
+   on demand and has not been read yet, so this may be called from
+   several threads at once.  Returns the value, or null. */
+struct json_value* json_object_find(struct json_value *jv, const char *key, size_t n,
+				    uint32_t hash);
+
+/* Find the value of a key in an object that was read with an
+   interning table.  The arguments are (object, canonical key from
+   json_intern_key or json_intern_lookup).  The keys are compared by
+   their pointers alone.  If the object has been indexed, the index is
+   probed with the hash that is stored with the key, so nothing is
+   hashed or allocated, other than when the object is read on demand.
+   Returns the value, or null if the key is not found, the key is null,
+   or the json_value is not an object. */
+struct json_value* json_object_find_interned(struct json_value *jv, const char *key);
+
+/* Build the hash index of an object, if it has enough pairs and is
+   not indexed already.  The arguments are (json_data that the object
+   was read into, object).  The index is carved from the arena of the
+   json_data, if it uses one, such that it is released with the arena
+   without visiting the object, and is otherwise allocated and freed
+   with the object.  It is kept until the object is changed, or the
+   json_data is reset or freed.  If the json_data uses an interning
+   table, the hashes that are stored with the keys are used, rather
+   than hashing each key again.  Returns zero on success, or non-zero
+   if the index could not be allocated. */
+int json_object_index(struct json_data *json, struct json_value *jv);
+
+/* Drop the hash index of an object, if it has one.  The arguments are
+   (json_data, object).  This is called when the pairs of the object
+   change. */
+void json_object_index_free(struct json_data *json, struct json_value *jv);
+
+/* The hash of a key.  The arguments are (key, number of
+   characters). */
+uint32_t json_object_hash(const char *key, size_t n);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_packed.h"
+#include "json_stats.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_packed_start(struct json_value *jv, unsigned int json_type);
+int json_packed_reserve(struct json_data *json, struct json_value *jv, unsigned int size);
+struct json_value* json_add_structure(struct json_data *json, int json_type);
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv);
+
+void json_data_use_packed_arrays(struct json_data *json) {
+  json->pack_arrays = 1;
+}
+
+int json_is_packed(const struct json_value *jv) {
+  return jv->json_type == JSON_PACKED_INT || jv->json_type == JSON_PACKED_FLOAT;
+}
+
+unsigned int json_packed_size(const struct json_value *jv) {
+  return json_is_packed(jv) ? jv->str_len : 0;
+}
+
+const long* json_packed_ints(const struct json_value *jv) {
+  return jv->json_type == JSON_PACKED_INT ? jv->value.l_values : 0;
+}
+
+const double* json_packed_floats(const struct json_value *jv) {
+  return jv->json_type == JSON_PACKED_FLOAT ? jv->value.d_values : 0;
+}
+
+struct json_value* json_packed_new(struct json_data *json, int json_type, unsigned int size) {
+  struct json_value *jv = 0;
+
+  if(json_type != JSON_PACKED_INT && json_type != JSON_PACKED_FLOAT) {
+    fprintf(stderr, "Error: %s is not a type of packed array.\n", json_type_to_string(json_type));
+    return 0;
+  }
+  jv = json_add_structure(json, json_type);
+  if(!jv || json_packed_reserve(json, jv, size)) return 0;
+  return jv;
+}
+
+int json_packed_append_int(struct json_data *json, struct json_value *jv, long l) {
+  if(json_packed_start(jv, JSON_PACKED_INT)) return 1;
+  if(jv->str_len == jv->nchildren_alloc &&
+     json_packed_reserve(json, jv, jv->nchildren_alloc ? 2*jv->nchildren_alloc : 4)) return 2;
+  jv->value.l_values[jv->str_len++] = l;
+  return 0;
+}
+
+int json_packed_append_float(struct json_data *json, struct json_value *jv, double d) {
+  if(json_packed_start(jv, JSON_PACKED_FLOAT)) return 1;
+  if(jv->str_len == jv->nchildren_alloc &&
+     json_packed_reserve(json, jv, jv->nchildren_alloc ? 2*jv->nchildren_alloc : 4)) return 2;
+  jv->value.d_values[jv->str_len++] = d;
+  return 0;
+}
+
+int json_unpack_array(struct json_data *json, struct json_value *jv) {
+  int json_type = jv->json_type;
+  long *l_values = jv->value.l_values;
+  double *d_values = jv->value.d_values;
+  unsigned int size = jv->str_len, i;
+  struct json_value *child = 0;
+
+  if(!json_is_packed(jv)) return 0;
+
+  jv->json_type = JSON_ARRAY;
+  jv->str_len = 0;
+  jv->nchildren_alloc = 0;
+  memset(&jv->value, 0, sizeof(jv->value));
+
+  /* The elements become json_values, in the same order as they would
+     have been read into an ordinary array. */
+  if(size) {
+    jv->children = (struct json_value**)json_data_alloc(json, size*sizeof(struct json_value*));
+    if(!jv->children) {
+      fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
+      return 1;
+    }
+    jv->nchildren_alloc = size;
+  }
+  for(i=0;i<size;i++) {
+    child = json_add_structure(json, json_type == JSON_PACKED_INT ? JSON_INT : JSON_FLOAT);
+    if(!child) return 2;
+    if(json_type == JSON_PACKED_INT) child->value.l_value = l_values[i];
+    else child->value.d_value = d_values[i];
+    if(json_add_element(json, jv, child)) return 3;
+  }
+
+  if(!json->arena && l_values) free(l_values);
+  return 0;
+}
+
+void json_packed_shrink(struct json_data *json, struct json_value *jv) {
+  size_t size_of_element = jv->json_type == JSON_PACKED_INT ? sizeof(long) : sizeof(double);
+  void *realloc_values = 0;
+
+  if(json->arena || !json_is_packed(jv) || !jv->str_len || jv->str_len == jv->nchildren_alloc) return;
+
+  realloc_values = realloc(jv->value.l_values, jv->str_len*size_of_element);
+  if(!realloc_values) return;
+  if(jv->json_type == JSON_PACKED_INT) jv->value.l_values = (long*)realloc_values;
+  else jv->value.d_values = (double*)realloc_values;
+  jv->nchildren_alloc = jv->str_len;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to check that an array can take an element of a packed
+   type.  An empty array, which has not been read on demand, becomes a
+   packed array of that type.  Returns zero if the element can be
+   appended. */
+int json_packed_start(struct json_value *jv, unsigned int json_type) {
+  if(jv->json_type == json_type) return 0;
+  if(jv->json_type == JSON_ARRAY && !jv->nchildren && !jv->children && !jv->value.lazy) {
+    jv->json_type = json_type;
+    jv->str_len = 0;
+    jv->nchildren_alloc = 0;
+    return 0;
+  }
+  fprintf(stderr, "Error: a %s cannot be appended to a %s.\n",
+	  json_type == JSON_PACKED_INT ? "integer" : "float", json_type_to_string(jv->json_type));
+  return 1;
+}
+
+/* A function to make room for a number of elements in a packed array.
+   The elements are moved if they cannot be extended in place.
+   Returns zero on success. */
+int json_packed_reserve(struct json_data *json, struct json_value *jv, unsigned int size) {
+  size_t size_of_element = jv->json_type == JSON_PACKED_INT ? sizeof(long) : sizeof(double);
+  void *realloc_values = 0;
+
+  if(size <= jv->nchildren_alloc) return 0;
+  if(json->arena) {
+    realloc_values = json_arena_grow(json->arena, jv->value.l_values, jv->nchildren_alloc*size_of_element,
+				     size*size_of_element);
+  }
+  else {
+    realloc_values = realloc(jv->value.l_values, size*size_of_element);
+  }
+  if(!realloc_values) {
+    fprintf(stderr, "Error: could not allocate memory for the elements of a packed array.\n");
+    return 1;
+  }
+
+  JSON_STATS_ADD(json->stats, reallocations, 1);
+  if(jv->json_type == JSON_PACKED_INT) jv->value.l_values = (long*)realloc_values;
+  else jv->value.d_values = (double*)realloc_values;
+  jv->nchildren_alloc = size;
+  return 0;
+}
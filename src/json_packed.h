@@ -0,0 +1,55 @@
+#ifndef JSON_PACKED_H
+#define JSON_PACKED_H
+
+#include "json.h"
+
+/* Switch a json_data to read arrays whose elements are all integers,
+   or all floats, as packed arrays.  A packed array is one json_value
+   of type JSON_PACKED_INT or JSON_PACKED_FLOAT, whose elements are
+   stored contiguously rather than as json_values of their own, and
+   which has no children.  An array that mixes integers and floats, or
+   holds anything else, is read as an ordinary array.  This applies to
+   json_read_ascii_buffer, json_read_ascii_buffer_insitu,
+   json_read_ascii_file and json_parser_init, and to the typed numeric
+   arrays of json_read_ubjson_buffer.  Documents that are read on
+   demand are not packed, and json_read_ascii_buffer_parallel reads
+   serially.  Queries do not reach the elements of a packed array.
+   This must be called before anything is read into the json_data. */
+void json_data_use_packed_arrays(struct json_data *json);
+
+/* Returns non-zero if the json_value is a packed array. */
+int json_is_packed(const struct json_value *jv);
+
+/* The number of elements of a packed array, or zero for any other
+   json_value. */
+unsigned int json_packed_size(const struct json_value *jv);
+
+/* The elements of a JSON_PACKED_INT or a JSON_PACKED_FLOAT.  Returns
+   null if the json_value is not a packed array of that type. */
+const long* json_packed_ints(const struct json_value *jv);
+const double* json_packed_floats(const struct json_value *jv);
+
+/* Create a packed array that is not in a tree yet, as
+   json_add_structure would.  The arguments are (json_data, json_type,
+   number of elements to allocate), where the type is JSON_PACKED_INT
+   or JSON_PACKED_FLOAT.  Returns the json_value, or null. */
+struct json_value* json_packed_new(struct json_data *json, int json_type, unsigned int size);
+
+/* Append an element to a packed array, which grows as needed.  An
+   empty JSON_ARRAY becomes a packed array of the type of its first
+   element.  The arguments are (json_data, array, element).  Returns
+   zero on success. */
+int json_packed_append_int(struct json_data *json, struct json_value *jv, long l);
+int json_packed_append_float(struct json_data *json, struct json_value *jv, double d);
+
+/* Turn a packed array into an ordinary JSON_ARRAY, whose elements are
+   json_values that are added to the json_data, for code that needs to
+   walk its children.  The arguments are (json_data, array).  Returns
+   zero on success. */
+int json_unpack_array(struct json_data *json, struct json_value *jv);
+
+/* Release the spare room of a packed array, once all of its elements
+   have been appended.  The memory of an arena is not given back. */
+void json_packed_shrink(struct json_data *json, struct json_value *jv);
+
+#endif
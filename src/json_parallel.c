@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_scan.h"
+#include "json_parser.h"
+#include "json_parallel.h"
+
+/* The number of ranges per thread.  More ranges than threads evens
+   out the work when some elements take longer to read than others. */
+#define JSON_PARALLEL_RANGES_PER_THREAD 4
+
+/* The number of characters that are scanned at a time, when looking
+   for the ends of the elements. */
+#define JSON_PARALLEL_WINDOW_SZ 65536
+
+/* One range of elements of the top-level array.  The range starts
+   after a comma, or after the opening bracket, and ends before the
+   next comma that was chosen as a split, or at the end of the buffer. */
+struct json_parallel_range {
+  const char *start;
+  size_t size;
+  int first; /* The range includes the opening bracket */
+  int last; /* The range includes the closing bracket */
+
+  struct json_data json; /* The elements of this range */
+  size_t n_json_values; /* The number read, or zero if not valid */
+};
+
+/* The work that is shared between the worker threads. */
+struct json_parallel_job {
+  struct json_parallel_range *ranges;
+  size_t n_ranges;
+  size_t next_range; /* The next range that has not been taken */
+  pthread_mutex_t lock; /* Protects next_range */
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+size_t json_parallel_split(const struct char_buffer *buffer, size_t n_ranges,
+			   struct json_parallel_range **ranges);
+int json_parallel_blank(const char *start, const char *end);
+void json_parallel_run(struct json_parallel_job *job, unsigned int n_threads);
+void* json_parallel_worker(void *arg);
+void json_parallel_parse(struct json_parallel_range *range);
+int json_parallel_join(struct json_data *json, struct json_value *root,
+		       struct json_parallel_range *ranges, size_t n_ranges);
+
+size_t json_read_ascii_buffer_parallel(struct json_data *json, const struct char_buffer *buffer,
+				       unsigned int n_threads) {
+  struct json_parallel_job job;
+  struct json_parallel_range *ranges = 0;
+  unsigned int n_values_before = json->n_json_values;
+  size_t n_ranges = 0, i;
+  long n_cpu = 0;
+  int failed = 0;
+
+  if(!n_threads) {
+    n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = n_cpu > 0 ? (unsigned int)n_cpu : 1;
+  }
+  /* The ranges of a packed root array could not be joined, so a
+     json_data that packs its arrays is read serially.  So is one that
+     collects statistics, which are not updated from several threads. */
+  if(n_threads < 2 || buffer->size < JSON_PARALLEL_MIN_SZ || json->pack_arrays || json->stats) {
+    return json_read_ascii_buffer(json, buffer);
+  }
+
+  /* If the document cannot be divided, then read it serially.  This
+     also reports any error in the structure of the document. */
+  n_ranges = json_parallel_split(buffer, (size_t)n_threads*JSON_PARALLEL_RANGES_PER_THREAD, &ranges);
+  if(n_ranges < 2) {
+    free(ranges);
+    return json_read_ascii_buffer(json, buffer);
+  }
+
+  /* The first range is read into the json_data itself, such that the
+     array that it opens becomes the root.  The other ranges are read
+     into json_data structs of their own, in arenas of the same size
+     if the json_data uses an arena, and with the same interning
+     table. */
+  for(i=1;i<n_ranges;i++) {
+    json_data_clear(&ranges[i].json);
+    ranges[i].json.intern = json->intern;
+    if(json->arena && json_data_use_arena(&ranges[i].json, json->arena->block_size)) failed = 1;
+  }
+  ranges[0].json = *json;
+
+  if(!failed) {
+    job.ranges = ranges;
+    job.n_ranges = n_ranges;
+    json_parallel_run(&job, n_threads);
+    for(i=0;i<n_ranges;i++) {
+      if(!ranges[i].n_json_values) failed = 1;
+    }
+  }
+  *json = ranges[0].json;
+
+  if(!failed && json_parallel_join(json, json->json_values[n_values_before], ranges, n_ranges)) {
+    failed = 1;
+  }
+
+  for(i=1;i<n_ranges;i++) json_free_value_array(&ranges[i].json);
+  free(ranges);
+
+  if(failed) return 0;
+
+  /* Return the number of json_values read */
+  return json->n_json_values;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to divide the top-level array into ranges of elements.
+   The structural characters are found with the scanner, and a comma
+   that separates two elements of the top-level array is chosen as a
+   split once the range before it is long enough.  The arguments are
+   (buffer, number of ranges wanted, pointer to the ranges).  Returns
+   the number of ranges, or zero if the document is not a single
+   top-level array or is not balanced. */
+size_t json_parallel_split(const struct char_buffer *buffer, size_t n_ranges,
+			   struct json_parallel_range **ranges) {
+  struct json_scanner scanner;
+  uint32_t *indices = 0;
+  const char *c = buffer->buffer;
+  const char *open = 0, *close = 0, *split = 0;
+  size_t range_size = buffer->size/n_ranges;
+  size_t n_indices = 0, window_size = 0, offset = 0, n = 0, i;
+  size_t depth = 0;
+  int extra = 0;
+
+  *ranges = (struct json_parallel_range*)malloc(n_ranges*sizeof(struct json_parallel_range));
+  indices = (uint32_t*)malloc(JSON_PARALLEL_WINDOW_SZ*sizeof(uint32_t));
+  if(!*ranges || !indices) {
+    fprintf(stderr, "Error: could not allocate memory to divide the document.\n");
+    free(indices);
+    return 0;
+  }
+
+  json_scanner_clear(&scanner);
+  for(offset=0;offset<buffer->size && !extra;offset+=window_size) {
+    window_size = buffer->size - offset;
+    if(window_size > JSON_PARALLEL_WINDOW_SZ) window_size = JSON_PARALLEL_WINDOW_SZ;
+    n_indices = json_scan_structurals(&scanner, c + offset, window_size, indices);
+
+    for(i=0;i<n_indices;i++) {
+      const char *s = c + offset + indices[i];
+
+      /* Anything after the top-level array means that there is more
+	 than one top-level value. */
+      if(close) {
+	extra = 1;
+	break;
+      }
+      if(!open) {
+	if(*s != '[') break;
+	open = s;
+	split = s;
+      }
+
+      switch(*s) {
+      case '[':
+      case '{':
+	depth++;
+	break;
+      case ']':
+      case '}':
+	depth--;
+	if(!depth) close = s;
+	break;
+      case ',':
+	if(depth == 1 && (size_t)(s - split) >= range_size && n + 1 < n_ranges) {
+	  (*ranges)[n].start = split + 1;
+	  (*ranges)[n].size = (size_t)(s - split - 1);
+	  n++;
+	  split = s;
+	}
+	break;
+      }
+    }
+    if(!open) break;
+  }
+  free(indices);
+
+  if(!open || !close || extra || *close != ']' || scanner.prev_in_string) return 0;
+
+  /* The last range runs to the end of the buffer, including the
+     closing bracket. */
+  (*ranges)[n].start = split + 1;
+  (*ranges)[n].size = (size_t)(c + buffer->size - split - 1);
+  n++;
+
+  for(i=0;i<n;i++) {
+    (*ranges)[i].first = i == 0;
+    (*ranges)[i].last = i == n - 1;
+    (*ranges)[i].n_json_values = 0;
+
+    /* An empty element at a split would be read as an empty array,
+       which is valid, whereas it is an error in the document. */
+    if(json_parallel_blank((*ranges)[i].start, i == n - 1 ? close : (*ranges)[i].start + (*ranges)[i].size)) {
+      return 0;
+    }
+  }
+  (*ranges)[0].start = c;
+  (*ranges)[0].size += (size_t)(open + 1 - c);
+
+  return n;
+}
+
+/* Returns one if there are only white space characters between start
+   and end. */
+int json_parallel_blank(const char *start, const char *end) {
+  for(;start<end;start++) {
+    if(*start != ' ' && *start != '\t' && *start != '\n' && *start != '\r') return 0;
+  }
+  return 1;
+}
+
+/* A function to run the worker threads, until all of the ranges have
+   been read.  The calling thread is one of the workers. */
+void json_parallel_run(struct json_parallel_job *job, unsigned int n_threads) {
+  pthread_t *threads = 0;
+  unsigned int i, n_started = 0;
+
+  if(n_threads > job->n_ranges) n_threads = (unsigned int)job->n_ranges;
+
+  /* Choose the scanner before the threads start, rather than in each
+     of them. */
+  json_scan_implementation();
+
+  job->next_range = 0;
+  pthread_mutex_init(&job->lock, 0);
+
+  threads = (pthread_t*)malloc((n_threads-1)*sizeof(pthread_t));
+  if(!threads) {
+    fprintf(stderr, "Warning: could not allocate worker threads, reading on one thread.\n");
+  }
+  else {
+    for(i=0;i<n_threads-1;i++) {
+      if(pthread_create(&threads[i], 0, json_parallel_worker, job)) break;
+      n_started++;
+    }
+  }
+
+  json_parallel_worker(job);
+
+  for(i=0;i<n_started;i++) pthread_join(threads[i], 0);
+  free(threads);
+  pthread_mutex_destroy(&job->lock);
+}
+
+/* The worker thread. */
+void* json_parallel_worker(void *arg) {
+  struct json_parallel_job *job = (struct json_parallel_job*)arg;
+  size_t i;
+
+  for(;;) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next_range++;
+    pthread_mutex_unlock(&job->lock);
+
+    if(i >= job->n_ranges) break;
+    json_parallel_parse(&job->ranges[i]);
+  }
+  return 0;
+}
+
+/* A function to read one range of elements.  The range is enclosed in
+   brackets where it does not include those of the document, such that
+   it is read as an array that holds the elements. */
+void json_parallel_parse(struct json_parallel_range *range) {
+  struct json_parser parser;
+
+  if(json_parser_init(&parser, &range->json)) return;
+  if(!range->first) json_parser_feed(&parser, "[", 1);
+  json_parser_feed(&parser, range->start, range->size);
+  if(!range->last) json_parser_feed(&parser, "]", 1);
+  range->n_json_values = json_parser_finish(&parser);
+  json_parser_free(&parser);
+}
+
+/* A function to move the elements of the other ranges under the root
+   array, which was read by the first range.  The json_values are
+   appended in the order of the ranges, which is the order in which a
+   serial parse creates them.  The array that encloses each of the
+   other ranges is dropped.  Returns zero on success. */
+int json_parallel_join(struct json_data *json, struct json_value *root,
+		       struct json_parallel_range *ranges, size_t n_ranges) {
+  struct json_value **realloc_json_values = 0;
+  struct json_value **realloc_children = 0;
+  struct json_value *wrapper = 0;
+  unsigned int n_json_values = json->n_json_values;
+  unsigned int nchildren = root->nchildren;
+  unsigned int i, j;
+
+  for(i=1;i<n_ranges;i++) {
+    n_json_values += ranges[i].json.n_json_values - 1;
+    nchildren += ranges[i].json.json_values[0]->nchildren;
+  }
+
+  if(n_json_values > json->json_values_alloc) {
+    realloc_json_values = (struct json_value**)realloc(json->json_values,
+						       n_json_values*sizeof(struct json_value*));
+    if(!realloc_json_values) {
+      fprintf(stderr, "Error: could not allocate memory for json pointer array.\n");
+      return 1;
+    }
+    json->json_values = realloc_json_values;
+    json->json_values_alloc = n_json_values;
+  }
+
+  if(nchildren > root->nchildren_alloc) {
+    if(json->arena) {
+      realloc_children = (struct json_value**)json_arena_grow(json->arena, root->children,
+							      root->nchildren_alloc*sizeof(struct json_value*),
+							      nchildren*sizeof(struct json_value*));
+    }
+    else {
+      realloc_children = (struct json_value**)realloc(root->children,
+						      nchildren*sizeof(struct json_value*));
+    }
+    if(!realloc_children) {
+      fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
+      return 2;
+    }
+    root->children = realloc_children;
+    root->nchildren_alloc = nchildren;
+  }
+
+  for(i=1;i<n_ranges;i++) {
+    wrapper = ranges[i].json.json_values[0];
+    for(j=0;j<wrapper->nchildren;j++) {
+      wrapper->children[j]->parent = root;
+      root->children[root->nchildren++] = wrapper->children[j];
+    }
+    memcpy(json->json_values + json->n_json_values, ranges[i].json.json_values + 1,
+	   (ranges[i].json.n_json_values - 1)*sizeof(struct json_value*));
+    json->n_json_values += ranges[i].json.n_json_values - 1;
+
+    /* The json_values now belong to the json_data.  Only the enclosing
+       array is left to be freed with the range. */
+    wrapper->nchildren = 0;
+    ranges[i].json.json_values[0] = wrapper;
+    ranges[i].json.n_json_values = 1;
+    if(json->arena) json_arena_take(json->arena, ranges[i].json.arena);
+  }
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef JSON_PARALLEL_H
+#define JSON_PARALLEL_H
+
+#include "json.h"
+
+/* Documents that are smaller than this are always read on one
+   thread, since starting the threads would cost more than it saves. */
+#define JSON_PARALLEL_MIN_SZ 1048576
+
+/* A function to read a document that is one very large top-level
+   array on several threads.  The elements of the array are divided
+   into ranges of similar size, the ranges are read concurrently and
+   the resulting subtrees are joined under one array.  The tree and
+   the order of the json_values are the same as those from
+   json_read_ascii_buffer.  Any other document, or one that is too
+   small to be worth dividing, is read on the calling thread.  The
+   arguments are (json_data, buffer, number of threads), where zero
+   threads selects the number of online processors.  The function
+   returns the number of json_values read, or zero if the document is
+   not valid. */
+size_t json_read_ascii_buffer_parallel(struct json_data *, const struct char_buffer *, unsigned int);
+
+#endif
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_scan.h"
+#include "json_number.h"
+#include "json_parser.h"
+#include "json_stats.h"
+
+/* The number of characters that are scanned for structural characters
+   at a time.  This must be a multiple of JSON_SCAN_BLK_SZ. */
+#define JSON_SCAN_WINDOW_SZ 65536
+
+/* What the grammar allows next. */
+#define JSON_EXPECT_VALUE 0 /* A value, after a ':' or ',' or at the top level */
+#define JSON_EXPECT_FIRST_VALUE 1 /* A value or ']', after a '[' */
+#define JSON_EXPECT_KEY 2 /* A key, after a ',' in an object */
+#define JSON_EXPECT_FIRST_KEY 3 /* A key or '}', after a '{' */
+#define JSON_EXPECT_COLON 4 /* A ':', after a key */
+#define JSON_EXPECT_COMMA 5 /* A ',' or the end of the object or array */
+
+/* Functions that are used in this file, but are not declared in the header files. */
+size_t json_scalar_end(const char *buffer, size_t i, size_t size);
+int json_parse_scalar(const char *str, size_t n, struct json_value *jv);
+int json_parser_start(struct json_parser *parser);
+void json_parser_rewind(struct json_parser *parser);
+int json_parser_carry(struct json_parser *parser, const char *str, size_t n);
+int json_parser_error(struct json_parser *parser, const char *msg, size_t i);
+int json_parser_callback(struct json_parser *parser, int ret);
+void json_parser_value_done(struct json_parser *parser);
+void json_parser_string(struct json_parser *parser, const char *str, size_t n);
+void json_parser_scalar(struct json_parser *parser, const char *str, size_t n, size_t i);
+void json_parser_structural(struct json_parser *parser, char c, size_t i);
+
+int json_parser_init_callbacks(struct json_parser *parser, const struct json_callbacks *callbacks,
+			       void *ctx) {
+  parser->callbacks = callbacks;
+  parser->ctx = ctx;
+  parser->json = 0;
+  parser->jv_parent = 0;
+  parser->first_value = 0;
+  return json_parser_start(parser);
+}
+
+int json_parser_reset(struct json_parser *parser) {
+  json_parser_rewind(parser);
+  if(parser->json) {
+    parser->jv_parent = 0;
+    parser->first_value = parser->json->n_json_values;
+    parser->stats = parser->json->stats;
+  }
+  return 0;
+}
+
+void json_parser_free(struct json_parser *parser) {
+  free(parser->indices);
+  free(parser->stack);
+  free(parser->tmp_buffer);
+  parser->indices = 0;
+  parser->size_of_indices = 0;
+  parser->stack = 0;
+  parser->size_of_stack = 0;
+  parser->tmp_buffer = 0;
+  parser->tmp_size = 0;
+  parser->size_of_tmp_buffer = 0;
+}
+
+/* A function to parse the next chunk of a document.  For each window
+   of the chunk, the structural characters are found by
+   json_scan_structurals, and the events are then generated from the
+   resulting index, without visiting the characters in between. */
+int json_parser_feed(struct json_parser *parser, const char *chunk, size_t size) {
+  size_t n_indices = 0;
+  size_t window = 0, window_size = 0;
+  size_t i = 0, k = 0, end = 0;
+  size_t str_start = 0;
+  int str_in_chunk = 0;
+  uint32_t *realloc_indices = 0;
+#ifdef JSON_STATS
+  double feed_start = 0, scan_start = 0, other_seconds = 0;
+#endif
+
+  if(parser->status) return parser->status;
+
+#ifdef JSON_STATS
+  /* The time that is not spent scanning or converting scalars is
+     counted as building. */
+  if(parser->stats) {
+    feed_start = json_stats_now();
+    other_seconds = parser->stats->scan_seconds + parser->stats->number_seconds;
+    parser->stats->bytes_scanned += size;
+  }
+#endif
+
+  /* Make sure that there is room for the structural indices of one
+     window.  There can be at most one index per character.  Small
+     documents only need a small index. */
+  window_size = size < JSON_SCAN_WINDOW_SZ ? size : JSON_SCAN_WINDOW_SZ;
+  if(window_size > parser->size_of_indices) {
+    realloc_indices = (uint32_t*)realloc(parser->indices, window_size*sizeof(uint32_t));
+    if(!realloc_indices) {
+      printf("Error: could not allocate the structural index to parse this file.");
+      parser->status = JSON_PARSER_NOMEM;
+      return parser->status;
+    }
+    parser->indices = realloc_indices;
+    parser->size_of_indices = window_size;
+  }
+
+  /* Complete a scalar that was split between chunks.  The scanner
+     does not report the rest of the scalar as a new value. */
+  if(parser->reading_scalar) {
+    end = json_scalar_end(chunk, 0, size);
+    if(json_parser_carry(parser, chunk, end)) return parser->status;
+    if(end < size) {
+      parser->reading_scalar = 0;
+      json_parser_scalar(parser, parser->tmp_buffer, parser->tmp_size, 0);
+    }
+  }
+
+  for(window=0;window<size && !parser->status;window+=JSON_SCAN_WINDOW_SZ) {
+    window_size = size - window;
+    if(window_size > JSON_SCAN_WINDOW_SZ) window_size = JSON_SCAN_WINDOW_SZ;
+#ifdef JSON_STATS
+    if(parser->stats) scan_start = json_stats_now();
+#endif
+    n_indices = json_scan_structurals(&parser->scanner, chunk+window, window_size, parser->indices);
+#ifdef JSON_STATS
+    if(parser->stats) parser->stats->scan_seconds += json_stats_now() - scan_start;
+#endif
+
+    for(k=0;k<n_indices && !parser->status;k++) {
+      i = window + parser->indices[k];
+
+      /* Within a string, the only index is the closing quote.  The
+	 string may have been opened in a previous window, or in a
+	 previous chunk. */
+      if(parser->reading_str) {
+	parser->reading_str = 0;
+	if(str_in_chunk) {
+	  json_parser_string(parser, chunk+str_start, i-str_start);
+	}
+	else if(!json_parser_carry(parser, chunk, i)) {
+	  json_parser_string(parser, parser->tmp_buffer, parser->tmp_size);
+	}
+	str_in_chunk = 0;
+      }
+
+      /* The opening quote of a string, which is a key within an
+	 object. */
+      else if(chunk[i] == '"') {
+	if(parser->expect == JSON_EXPECT_KEY || parser->expect == JSON_EXPECT_FIRST_KEY) {
+	  parser->reading_key = 1;
+	}
+	else if(parser->expect == JSON_EXPECT_VALUE || parser->expect == JSON_EXPECT_FIRST_VALUE) {
+	  parser->reading_key = 0;
+	}
+	else {
+	  json_parser_error(parser, "unexpected string", i);
+	  break;
+	}
+	parser->reading_str = 1;
+	str_in_chunk = 1;
+	str_start = i+1;
+      }
+
+      /* Check for one of {}[]:, */
+      else if(chunk[i] == '{' || chunk[i] == '}' || chunk[i] == '[' || chunk[i] == ']' ||
+	      chunk[i] == ':' || chunk[i] == ',') {
+	json_parser_structural(parser, chunk[i], i);
+      }
+
+      /* Otherwise this is the first character of a number, true, false
+	 or null, which runs until the next white space or structural
+	 character.  If the chunk ends first, the scalar is completed
+	 by the next chunk. */
+      else {
+	if(parser->expect != JSON_EXPECT_VALUE && parser->expect != JSON_EXPECT_FIRST_VALUE) {
+	  json_parser_error(parser, "unexpected value", i);
+	  break;
+	}
+	end = json_scalar_end(chunk, i, size);
+	if(end == size) {
+	  parser->tmp_size = 0;
+	  if(json_parser_carry(parser, chunk+i, end-i)) break;
+	  parser->reading_scalar = 1;
+	}
+	else {
+	  json_parser_scalar(parser, chunk+i, end-i, i);
+	}
+      }
+    }
+  }
+
+  /* Keep the part of a string that has not been closed in this chunk. */
+  if(!parser->status && parser->reading_str) {
+    if(str_in_chunk) {
+      parser->tmp_size = 0;
+      json_parser_carry(parser, chunk+str_start, size-str_start);
+    }
+    else {
+      json_parser_carry(parser, chunk, size);
+    }
+  }
+
+  parser->offset += size;
+#ifdef JSON_STATS
+  if(parser->stats) {
+    parser->stats->build_seconds += json_stats_now() - feed_start -
+      (parser->stats->scan_seconds + parser->stats->number_seconds - other_seconds);
+  }
+#endif
+  return parser->status;
+}
+
+int json_parser_end(struct json_parser *parser) {
+
+  /* The end of the document ends a scalar. */
+  if(!parser->status && parser->reading_scalar) {
+    parser->reading_scalar = 0;
+    json_parser_scalar(parser, parser->tmp_buffer, parser->tmp_size, 0);
+  }
+  if(!parser->status && parser->reading_str) {
+    json_parser_error(parser, "the buffer ends within a string", 0);
+  }
+  if(!parser->status && parser->depth) {
+    json_parser_error(parser, "the buffer ends within an object or an array", 0);
+  }
+  return parser->status;
+}
+
+int json_read_ascii_events(const struct char_buffer *buffer, const struct json_callbacks *callbacks,
+			   void *ctx) {
+  struct json_parser parser;
+  int status = 0;
+
+  if(json_parser_init_callbacks(&parser, callbacks, ctx)) return JSON_PARSER_NOMEM;
+  json_parser_feed(&parser, buffer->buffer, buffer->size);
+  status = json_parser_end(&parser);
+  json_parser_free(&parser);
+  return status;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to reset the state that is common to all parsers. */
+int json_parser_start(struct json_parser *parser) {
+  parser->stack = 0;
+  parser->size_of_stack = 0;
+  parser->tmp_buffer = 0;
+  parser->size_of_tmp_buffer = 0;
+  parser->stats = 0;
+
+  /* The index is allocated by the first call to json_parser_feed. */
+  parser->indices = 0;
+  parser->size_of_indices = 0;
+  json_parser_rewind(parser);
+  return 0;
+}
+
+/* A function to return a parser to the start of a document, without
+   freeing its memory. */
+void json_parser_rewind(struct json_parser *parser) {
+  json_scanner_clear(&parser->scanner);
+  parser->depth = 0;
+  parser->expect = JSON_EXPECT_VALUE;
+  parser->reading_str = 0;
+  parser->reading_key = 0;
+  parser->reading_scalar = 0;
+  parser->tmp_size = 0;
+  parser->offset = 0;
+  parser->status = JSON_PARSER_OK;
+}
+
+/* A function to find the end of a number, true, false or null.  The
+   arguments are (buffer, index of the first character, size of the
+   buffer).  Returns the index of the first character after the
+   value. */
+size_t json_scalar_end(const char *buffer, size_t i, size_t size) {
+  while(i < size) {
+    switch(buffer[i]) {
+    case ' ': case '\t': case '\n': case '\r':
+    case ',': case ':': case ']': case '}': case '[': case '{': case '"':
+      return i;
+    default:
+      i++;
+    }
+  }
+  return i;
+}
+
+/* A function to parse a number, true, false or null, which need not
+   be terminated.  The arguments are (first character, number of
+   characters, json_value).  The type and value are stored in the
+   json_value.  Returns zero on success. */
+int json_parse_scalar(const char *str, size_t n, struct json_value *jv) {
+
+  /* Check if this is a null */
+  if(n == 4 && !memcmp(str, "null", 4)) {
+    jv->json_type = JSON_NULL;
+  }
+
+  /* Check if this is true */
+  else if(n == 4 && !memcmp(str, "true", 4)) {
+    jv->value.b_value = 1;
+    jv->json_type = JSON_BOOLEAN;
+  }
+
+  /* Check if this is false */
+  else if(n == 5 && !memcmp(str, "false", 5)) {
+    jv->value.b_value = 0;
+    jv->json_type = JSON_BOOLEAN;
+  }
+
+  /* Otherwise this must be a number. */
+  else {
+    return json_parse_number(str, n, jv);
+  }
+
+  return 0;
+}
+
+/* A function to append characters to the temporary buffer of the
+   parser, such that a value can be carried over to the next chunk. */
+int json_parser_carry(struct json_parser *parser, const char *str, size_t n) {
+  char *realloc_buffer = 0;
+  size_t size_of_tmp_buffer = 0;
+
+  /* Leave room for a string terminator. */
+  if(parser->tmp_size + n + 1 > parser->size_of_tmp_buffer) {
+    size_of_tmp_buffer = parser->size_of_tmp_buffer ? 2*parser->size_of_tmp_buffer : 64;
+    if(size_of_tmp_buffer < parser->tmp_size + n + 1) size_of_tmp_buffer = parser->tmp_size + n + 1;
+    realloc_buffer = (char*)realloc(parser->tmp_buffer, size_of_tmp_buffer*sizeof(char));
+    if(!realloc_buffer) {
+      printf("Error: could not allocate temporary buffer to parse this file.");
+      parser->status = JSON_PARSER_NOMEM;
+      return 1;
+    }
+    parser->tmp_buffer = realloc_buffer;
+    parser->size_of_tmp_buffer = size_of_tmp_buffer;
+  }
+  memcpy(parser->tmp_buffer + parser->tmp_size, str, n);
+  parser->tmp_size += n;
+  return 0;
+}
+
+/* A function to stop the parse with a syntax error.  The argument i is
+   the index of the character within the current chunk. */
+int json_parser_error(struct json_parser *parser, const char *msg, size_t i) {
+  printf("Error: %s at character %lu\n", msg, (unsigned long)(parser->offset+i));
+  parser->status = JSON_PARSER_SYNTAX;
+  return 1;
+}
+
+/* A function to check the value returned by a callback. */
+int json_parser_callback(struct json_parser *parser, int ret) {
+  if(ret) parser->status = JSON_PARSER_ABORTED;
+  return ret;
+}
+
+/* A function to update the grammar state after a complete value. */
+void json_parser_value_done(struct json_parser *parser) {
+  parser->expect = parser->depth ? JSON_EXPECT_COMMA : JSON_EXPECT_VALUE;
+}
+
+/* A function to report a key or a string, from the characters between
+   the quotes. */
+void json_parser_string(struct json_parser *parser, const char *str, size_t n) {
+  const struct json_callbacks *cb = parser->callbacks;
+  parser->tmp_size = 0;
+  if(parser->reading_key) {
+    if(cb->key && json_parser_callback(parser, cb->key(parser->ctx, str, n))) return;
+    parser->expect = JSON_EXPECT_COLON;
+  }
+  else {
+    if(cb->string && json_parser_callback(parser, cb->string(parser->ctx, str, n))) return;
+    json_parser_value_done(parser);
+  }
+}
+
+/* A function to report a number, true, false or null.  The argument i
+   is the index of the first character within the current chunk. */
+void json_parser_scalar(struct json_parser *parser, const char *str, size_t n, size_t i) {
+  const struct json_callbacks *cb = parser->callbacks;
+  struct json_value jv;
+  int ret = 0;
+#ifdef JSON_STATS
+  double number_start = 0;
+#endif
+
+  /* The value is parsed in place, or from the temporary buffer if it
+     was carried over. */
+  parser->tmp_size = 0;
+
+  json_clear_value(&jv);
+#ifdef JSON_STATS
+  if(parser->stats) number_start = json_stats_now();
+#endif
+  ret = json_parse_scalar(str, n, &jv);
+#ifdef JSON_STATS
+  if(parser->stats) parser->stats->number_seconds += json_stats_now() - number_start;
+#endif
+  if(ret) {
+    json_parser_error(parser, "could not convert the value", i);
+    return;
+  }
+
+  if(jv.json_type == JSON_INT) {
+    if(cb->int_value) ret = cb->int_value(parser->ctx, jv.value.l_value);
+  }
+  else if(jv.json_type == JSON_FLOAT) {
+    if(cb->float_value) ret = cb->float_value(parser->ctx, jv.value.d_value);
+  }
+  else if(jv.json_type == JSON_BOOLEAN) {
+    if(cb->bool_value) ret = cb->bool_value(parser->ctx, jv.value.b_value);
+  }
+  else {
+    if(cb->null_value) ret = cb->null_value(parser->ctx);
+  }
+  if(json_parser_callback(parser, ret)) return;
+  json_parser_value_done(parser);
+}
+
+/* A function to handle one of the characters {}[]:, which are found
+   outside strings.  The argument i is the index of the character
+   within the current chunk. */
+void json_parser_structural(struct json_parser *parser, char c, size_t i) {
+  const struct json_callbacks *cb = parser->callbacks;
+  unsigned char *realloc_stack = 0;
+  size_t size_of_stack = 0;
+  int ret = 0;
+
+  /* Check for the beginning of an object or an array. */
+  if(c == '{' || c == '[') {
+    if(parser->expect != JSON_EXPECT_VALUE && parser->expect != JSON_EXPECT_FIRST_VALUE) {
+      json_parser_error(parser, "missing separator", i);
+      return;
+    }
+    if(parser->depth == parser->size_of_stack) {
+      size_of_stack = parser->size_of_stack ? 2*parser->size_of_stack : 64;
+      realloc_stack = (unsigned char*)realloc(parser->stack, size_of_stack);
+      if(!realloc_stack) {
+	printf("Error: could not allocate memory for the parser stack.\n");
+	parser->status = JSON_PARSER_NOMEM;
+	return;
+      }
+      parser->stack = realloc_stack;
+      parser->size_of_stack = size_of_stack;
+    }
+    parser->stack[parser->depth++] = (unsigned char)c;
+#ifdef JSON_STATS
+    if(parser->stats && parser->depth > parser->stats->max_depth) parser->stats->max_depth = parser->depth;
+#endif
+    if(c == '{') {
+      if(cb->object_begin) ret = cb->object_begin(parser->ctx);
+      parser->expect = JSON_EXPECT_FIRST_KEY;
+    }
+    else {
+      if(cb->array_begin) ret = cb->array_begin(parser->ctx);
+      parser->expect = JSON_EXPECT_FIRST_VALUE;
+    }
+    json_parser_callback(parser, ret);
+  }
+
+  /* A colon separates the key and the value of a pair */
+  else if(c == ':') {
+    if(parser->expect != JSON_EXPECT_COLON) {
+      json_parser_error(parser, "a pair must have a string key", i);
+      return;
+    }
+    parser->expect = JSON_EXPECT_VALUE;
+  }
+
+  /* A comma is used to separate elements within arrays and objects. */
+  else if(c == ',') {
+    if(parser->expect != JSON_EXPECT_COMMA) {
+      json_parser_error(parser, "unexpected ','", i);
+      return;
+    }
+    parser->expect = parser->stack[parser->depth-1] == '{' ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+  }
+
+  /* A ']' character closes an array, and a '}' character closes an
+     object. */
+  else {
+    if(!parser->depth ||
+       parser->stack[parser->depth-1] != (c == '}' ? '{' : '[') ||
+       !(parser->expect == JSON_EXPECT_COMMA ||
+	 (c == '}' && parser->expect == JSON_EXPECT_FIRST_KEY) ||
+	 (c == ']' && parser->expect == JSON_EXPECT_FIRST_VALUE))) {
+      json_parser_error(parser, c == '}' ? "unexpected '}'" : "unexpected ']'", i);
+      return;
+    }
+    parser->depth--;
+    if(c == '}') {
+      if(cb->object_end) ret = cb->object_end(parser->ctx);
+    }
+    else {
+      if(cb->array_end) ret = cb->array_end(parser->ctx);
+    }
+    if(json_parser_callback(parser, ret)) return;
+    json_parser_value_done(parser);
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+
+#include "json.h"
+#include "json_scan.h"
+
+/* The status of a parser. */
+#define JSON_PARSER_OK 0
+#define JSON_PARSER_NOMEM 1 /* A memory allocation failed */
+#define JSON_PARSER_SYNTAX 2 /* The document is not valid json */
+#define JSON_PARSER_ABORTED 3 /* A callback returned non-zero */
+
+/* The functions that are called as a document is parsed.  A function
+   pointer can be null, if the event is not needed.  The first
+   argument is the context pointer that was given to the parser.  A
+   function returns zero to continue, or non-zero to stop the parse.
+   Strings are not terminated, and are only valid during the call. */
+struct json_callbacks {
+  int (*object_begin)(void *);
+  int (*object_end)(void *);
+  int (*array_begin)(void *);
+  int (*array_end)(void *);
+  int (*key)(void *, const char *, size_t);
+  int (*string)(void *, const char *, size_t);
+  int (*int_value)(void *, long);
+  int (*float_value)(void *, double);
+  int (*bool_value)(void *, int);
+  int (*null_value)(void *);
+};
+
+/* The state of a parse that can be resumed, such that a document can
+   be read in chunks as they arrive from a socket or a pipe.  A string
+   or a scalar that is split between chunks is carried over in the
+   temporary buffer.  All other characters are read in place. */
+struct json_parser {
+  const struct json_callbacks *callbacks; /* The events of the parse */
+  void *ctx; /* The first argument of each callback */
+
+  struct json_scanner scanner; /* Escape and string state between chunks */
+  uint32_t *indices; /* The structural indices of one window */
+  size_t size_of_indices; /* The number of indices allocated */
+
+  unsigned char *stack; /* The open objects and arrays */
+  size_t depth; /* The number of open objects and arrays */
+  size_t size_of_stack; /* The number of stack entries allocated */
+  int expect; /* What the grammar allows next */
+
+  int reading_str; /* Within a string */
+  int reading_key; /* The string being read is a key */
+  int reading_scalar; /* Within a number, true, false or null */
+
+  char *tmp_buffer; /* A string or scalar carried over between chunks */
+  size_t tmp_size; /* The number of characters in the temporary buffer */
+  size_t size_of_tmp_buffer; /* The number of characters allocated */
+
+  size_t offset; /* The number of characters fed so far */
+  int status; /* JSON_PARSER_OK, or the error that stopped the parse */
+
+  /* Either null or the counters of the json_data, which are only
+     updated when the library is built with JSON_STATS. */
+  struct json_stats *stats;
+
+  /* The tree that is built by json_parser_init. */
+  struct json_data *json;
+  struct json_value *jv_parent; /* The object, array or pair being filled */
+  unsigned int first_value; /* The number of json_values before the parse */
+};
+
+/* Prepare a parser to read a document into a json_data.  The
+   arguments are (parser, json_data).  Returns zero on success. */
+int json_parser_init(struct json_parser *parser, struct json_data *json);
+
+/* Prepare a parser to report a document as a sequence of events,
+   without building a tree.  The arguments are (parser, callbacks,
+   context pointer).  Returns zero on success. */
+int json_parser_init_callbacks(struct json_parser *parser, const struct json_callbacks *callbacks,
+			       void *ctx);
+
+/* Prepare a parser for another document, keeping its callbacks and
+   the memory it has allocated, such that the next document is parsed
+   without allocating unless it needs more.  A parser from
+   json_parser_init appends the next document to its json_data, which
+   may be emptied first with json_data_reset.  Returns zero on
+   success. */
+int json_parser_reset(struct json_parser *parser);
+
+/* Parse the next chunk of a document.  The arguments are (parser,
+   chunk, number of characters).  The chunk is not needed after the
+   call returns.  Returns zero on success, or the error status. */
+int json_parser_feed(struct json_parser *parser, const char *chunk, size_t size);
+
+/* Complete the document, after the last chunk has been fed.  Returns
+   the status of the parse. */
+int json_parser_end(struct json_parser *parser);
+
+/* Complete a document that is being read into a json_data.  Returns
+   the number of json_values read, or zero if the document is not
+   valid. */
+size_t json_parser_finish(struct json_parser *parser);
+
+/* Free the memory that belongs to the parser.  The json_data is not
+   freed. */
+void json_parser_free(struct json_parser *parser);
+
+/* Parse a whole buffer, reporting each event to the callbacks.  The
+   arguments are (buffer, callbacks, context pointer).  Returns the
+   status of the parse. */
+int json_read_ascii_events(const struct char_buffer *buffer, const struct json_callbacks *callbacks,
+			   void *ctx);
+
+#endif
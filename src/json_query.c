@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "json.h"
+#include "json_ascii_utils.h"
+#include "json_lazy.h"
+#include "json_object.h"
+#include "json_query.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_query_compile_key(struct json_query_step *step, const char *token, size_t n, char *key,
+			   char *scratch);
+int json_query_compile_slice(struct json_query_step *step, const char *token, size_t n);
+int json_query_parse_long(const char *str, size_t n, long *l);
+size_t json_query_walk(const struct json_query *query, size_t i, struct json_value *jv,
+		       struct json_value **results, size_t max_results, size_t count);
+
+int json_query_compile(struct json_query *query, const char *path) {
+  const char *token = 0, *end = 0;
+  size_t path_len = strlen(path), n_steps = 0, i;
+  char *key = 0, *scratch = 0;
+  int status = 0;
+
+  query->steps = 0;
+  query->n_steps = 0;
+  query->keys = 0;
+
+  if(path_len == 0) return 0;
+  if(path[0] != '/') {
+    fprintf(stderr, "Error: a json pointer must start with '/': %s\n", path);
+    return 1;
+  }
+
+  for(i=0;i<path_len;i++) {
+    if(path[i] == '/') n_steps++;
+  }
+
+  /* A character of a key takes at most six characters once it has
+     been escaped, as \u00XX.  The scratch space holds a token once
+     "~0" and "~1" have been replaced. */
+  query->steps = (struct json_query_step*)malloc(n_steps*sizeof(struct json_query_step));
+  query->keys = (char*)malloc(6*path_len);
+  scratch = (char*)malloc(path_len);
+  if(!query->steps || !query->keys || !scratch) {
+    fprintf(stderr, "Error: could not allocate memory for a query.\n");
+    if(scratch) free(scratch);
+    json_query_free(query);
+    return 2;
+  }
+
+  key = query->keys;
+  for(token = path + 1; query->n_steps < n_steps; token = end + 1) {
+    struct json_query_step *step = &query->steps[query->n_steps];
+    end = strchr(token, '/');
+    if(!end) end = path + path_len;
+
+    step->key = 0;
+    step->key_len = 0;
+    step->hash = 0;
+    step->index = -1;
+    step->start = step->end = 0;
+    step->step = 1;
+    step->has_start = step->has_end = 0;
+
+    if(end - token == 1 && token[0] == '*') {
+      step->type = JSON_QUERY_WILDCARD;
+    }
+    else if(end - token >= 2 && token[0] == '[' && end[-1] == ']' && memchr(token, ':', end - token)) {
+      step->type = JSON_QUERY_SLICE;
+      status = json_query_compile_slice(step, token + 1, end - token - 2);
+    }
+    else {
+      step->type = JSON_QUERY_KEY;
+      status = json_query_compile_key(step, token, end - token, key, scratch);
+      key += step->key_len;
+    }
+
+    if(status) {
+      fprintf(stderr, "Error: the json pointer is not valid: %s\n", path);
+      free(scratch);
+      json_query_free(query);
+      return 3;
+    }
+    query->n_steps++;
+  }
+
+  free(scratch);
+  return 0;
+}
+
+void json_query_free(struct json_query *query) {
+  if(query->steps) free(query->steps);
+  if(query->keys) free(query->keys);
+  query->steps = 0;
+  query->n_steps = 0;
+  query->keys = 0;
+}
+
+size_t json_query_eval(const struct json_query *query, struct json_value *root,
+		       struct json_value **results, size_t max_results) {
+  if(!root) return 0;
+  return json_query_walk(query, 0, root, results, max_results, 0);
+}
+
+size_t json_query_eval_batch(const struct json_query *query, const struct json_data *json,
+			     size_t n_json, struct json_value **results, size_t max_results,
+			     size_t *counts) {
+  size_t i, total = 0;
+
+  for(i=0;i<n_json;i++) {
+    if(json[i].n_json_values == 0) counts[i] = 0;
+    else counts[i] = json_query_eval(query, json[i].json_values[0], results + i*max_results, max_results);
+    total += counts[i];
+  }
+
+  return total;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+int json_query_compile_key(struct json_query_step *step, const char *token, size_t n, char *key,
+			   char *scratch) {
+  size_t i, scratch_len = 0, key_len = 0;
+
+  /* The reference token is unescaped, and then escaped as the key
+     would be in a document, since keys are stored as they were
+     read. */
+  for(i=0;i<n;i++) {
+    if(token[i] == '~') {
+      if(i + 1 == n || (token[i+1] != '0' && token[i+1] != '1')) return 1;
+      scratch[scratch_len++] = token[++i] == '0' ? '~' : '/';
+    }
+    else {
+      scratch[scratch_len++] = token[i];
+    }
+  }
+  key_len = json_escape(scratch, scratch_len, key);
+
+  step->key = key;
+  step->key_len = key_len;
+  step->hash = json_object_hash(key, key_len);
+
+  /* A token of digits, without leading zeros, is also an array index. */
+  if(n > 0 && (n == 1 || token[0] != '0') && token[0] != '-' && token[0] != '+') {
+    if(json_query_parse_long(token, n, &step->index)) step->index = -1;
+  }
+
+  return 0;
+}
+
+int json_query_compile_slice(struct json_query_step *step, const char *token, size_t n) {
+  const char *colon = (const char*)memchr(token, ':', n);
+  const char *second = 0;
+  size_t first_len = colon - token, rest = n - first_len - 1;
+
+  if(first_len > 0) {
+    if(json_query_parse_long(token, first_len, &step->start)) return 1;
+    step->has_start = 1;
+  }
+
+  second = colon + 1;
+  colon = (const char*)memchr(second, ':', rest);
+  if(colon) {
+    if(colon + 1 < token + n) {
+      if(json_query_parse_long(colon + 1, token + n - colon - 1, &step->step)) return 1;
+      if(step->step <= 0) return 2;
+    }
+    rest = colon - second;
+  }
+
+  if(rest > 0) {
+    if(json_query_parse_long(second, rest, &step->end)) return 1;
+    step->has_end = 1;
+  }
+
+  return 0;
+}
+
+int json_query_parse_long(const char *str, size_t n, long *l) {
+  size_t i = 0;
+  long value = 0;
+  int negative = 0;
+
+  if(n > 0 && (str[0] == '-' || str[0] == '+')) {
+    negative = str[0] == '-';
+    i++;
+  }
+  if(i == n) return 1;
+
+  for(;i<n;i++) {
+    if(str[i] < '0' || str[i] > '9') return 1;
+    if(value > (LONG_MAX - (str[i] - '0'))/10) return 2;
+    value = 10*value + (str[i] - '0');
+  }
+
+  *l = negative ? -value : value;
+  return 0;
+}
+
+size_t json_query_walk(const struct json_query *query, size_t i, struct json_value *jv,
+		       struct json_value **results, size_t max_results, size_t count) {
+  const struct json_query_step *step = 0;
+  struct json_value *pair = 0;
+  struct json_value *child = 0;
+  long n, start, end, k;
+  unsigned int j;
+
+  /* The last step has been taken, so the value matches. */
+  if(i == query->n_steps) {
+    if(count < max_results) results[count] = jv;
+    return count + 1;
+  }
+
+  if(json_lazy_expand(jv)) return count;
+  step = &query->steps[i];
+  switch(step->type) {
+  case JSON_QUERY_KEY:
+    if(jv->json_type == JSON_OBJECT) {
+      child = json_object_find(jv, step->key, step->key_len, step->hash);
+      if(child) count = json_query_walk(query, i + 1, child, results, max_results, count);
+    }
+    else if(jv->json_type == JSON_ARRAY && step->index >= 0 && step->index < (long)jv->nchildren) {
+      count = json_query_walk(query, i + 1, jv->children[step->index], results, max_results, count);
+    }
+    break;
+
+  case JSON_QUERY_WILDCARD:
+    if(jv->json_type == JSON_OBJECT) {
+      for(j=0;j<jv->nchildren;j++) {
+	pair = jv->children[j];
+	if(pair->nchildren == 0) continue;
+	count = json_query_walk(query, i + 1, pair->children[0], results, max_results, count);
+      }
+    }
+    else if(jv->json_type == JSON_ARRAY) {
+      for(j=0;j<jv->nchildren;j++) {
+	count = json_query_walk(query, i + 1, jv->children[j], results, max_results, count);
+      }
+    }
+    break;
+
+  case JSON_QUERY_SLICE:
+    if(jv->json_type != JSON_ARRAY) break;
+
+    /* The bounds are clamped to the array, as for a python slice. */
+    n = (long)jv->nchildren;
+    start = step->has_start ? step->start : 0;
+    end = step->has_end ? step->end : n;
+    if(start < 0) start = start + n < 0 ? 0 : start + n;
+    if(end < 0) end = end + n < 0 ? 0 : end + n;
+    if(start > n) start = n;
+    if(end > n) end = n;
+    for(k=start;k<end;k+=step->step) {
+      count = json_query_walk(query, i + 1, jv->children[k], results, max_results, count);
+      if(step->step > end - k) break;
+    }
+    break;
+  }
+
+  return count;
+}
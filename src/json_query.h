@@ -0,0 +1,71 @@
+#ifndef JSON_QUERY_H
+#define JSON_QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+/* The kinds of step in a compiled query. */
+#define JSON_QUERY_KEY 1 /* A key of an object, or an index of an array */
+#define JSON_QUERY_WILDCARD 2 /* Every value of an object or an array */
+#define JSON_QUERY_SLICE 3 /* A range of elements of an array */
+
+/* One reference token of a path. */
+struct json_query_step {
+  int type; /* JSON_QUERY_KEY, JSON_QUERY_WILDCARD or JSON_QUERY_SLICE */
+
+  /* A key, escaped as it would be in a document, and its hash. */
+  const char *key;
+  size_t key_len;
+  uint32_t hash;
+  long index; /* The array index that the key spells, or -1 */
+
+  /* A slice, as in [start:end:step].  A bound that is negative counts
+     from the end of the array. */
+  long start, end, step;
+  int has_start, has_end; /* Zero if the bound was left out */
+};
+
+/* A path that has been compiled once, to be evaluated on many trees. */
+struct json_query {
+  struct json_query_step *steps;
+  size_t n_steps;
+  char *keys; /* The storage of the keys of the steps */
+};
+
+/* Compile a path.  The path is a JSON Pointer (RFC 6901), such as
+   "/user/id", where "~0" and "~1" stand for '~' and '/' in a key.  A
+   token "*" selects every value of an object or array, and a token
+   "[start:end]" or "[start:end:step]" selects a range of the elements
+   of an array, where any part may be left out.  The empty path
+   selects the root.  The arguments are (query, path).  Returns zero
+   on success, or non-zero if the path is not valid. */
+int json_query_compile(struct json_query *query, const char *path);
+
+/* Free the memory that belongs to a compiled query. */
+void json_query_free(struct json_query *query);
+
+/* Evaluate a query on a tree.  The arguments are (query, root,
+   results, maximum number of results).  The values that match are
+   stored in the results array, in document order, up to the maximum.
+   Keys are found through the index of an object, when it has one,
+   and nothing is allocated, such that one query may be evaluated on
+   several threads at once.  The exception is a tree that is read on
+   demand, whose containers are read as the query reaches them.
+   Returns the number of values that match, which may be more than the
+   maximum. */
+size_t json_query_eval(const struct json_query *query, struct json_value *root,
+		       struct json_value **results, size_t max_results);
+
+/* Evaluate a query on each of an array of json_data, such as the
+   records from json_read_ndjson_buffer.  The arguments are (query,
+   json_data array, number of json_data, results, maximum number of
+   results per json_data, counts).  The results of json_data i start
+   at results[i*max_results], and counts[i] is its number of matches,
+   as from json_query_eval.  Returns the total number of matches. */
+size_t json_query_eval_batch(const struct json_query *query, const struct json_data *json,
+			     size_t n_json, struct json_value **results, size_t max_results,
+			     size_t *counts);
+
+#endif
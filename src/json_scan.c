@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* Character classes used by the scalar implementation. */
+#define JSON_CLASS_QUOTE 1
+#define JSON_CLASS_BACKSLASH 2
+#define JSON_CLASS_STRUCTURAL 4
+#define JSON_CLASS_WHITESPACE 8
+
+/* Functions that are used in this file, but are not declared in the header files. */
+void json_scan_select(void);
+size_t json_scan_structurals_scalar(struct json_scanner *scanner, const char *buffer,
+				    size_t size, uint32_t *indices);
+void json_scan_classify_scalar(const char *block, struct json_scan_masks *masks);
+#ifdef JSON_SCAN_X86
+size_t json_scan_structurals_sse2(struct json_scanner *scanner, const char *buffer,
+				  size_t size, uint32_t *indices);
+size_t json_scan_structurals_avx2(struct json_scanner *scanner, const char *buffer,
+				  size_t size, uint32_t *indices);
+void json_scan_classify_sse2(const char *block, struct json_scan_masks *masks);
+void json_scan_classify_avx2(const char *block, struct json_scan_masks *masks);
+#endif
+
+/* The implementation in use.  These are set once, by
+   json_scan_select, and are the same for every thread. */
+static const char *json_scan_name = 0;
+static size_t (*json_scan_impl)(struct json_scanner *, const char *, size_t, uint32_t *) = 0;
+static void (*json_scan_classify_impl)(const char *, struct json_scan_masks *) = 0;
+
+void json_scanner_clear(struct json_scanner *scanner) {
+  scanner->prev_escaped = 0;
+  scanner->prev_in_string = 0;
+  scanner->prev_scalar = 0;
+}
+
+void json_scan_classify(const char *block, struct json_scan_masks *masks) {
+  if(!json_scan_classify_impl) json_scan_select();
+  json_scan_classify_impl(block, masks);
+}
+
+size_t json_scan_structurals(struct json_scanner *scanner, const char *buffer, size_t size,
+			     uint32_t *indices) {
+  if(!json_scan_impl) json_scan_select();
+  return json_scan_impl(scanner, buffer, size, indices);
+}
+
+const char* json_scan_implementation(void) {
+  if(!json_scan_name) json_scan_select();
+  return json_scan_name;
+}
+
+int json_scan_set_implementation(const char *name) {
+  if(!strcmp(name, "scalar")) {
+    json_scan_name = "scalar";
+    json_scan_impl = json_scan_structurals_scalar;
+    json_scan_classify_impl = json_scan_classify_scalar;
+  }
+#ifdef JSON_SCAN_X86
+  else if(!strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) {
+    json_scan_name = "sse2";
+    json_scan_impl = json_scan_structurals_sse2;
+    json_scan_classify_impl = json_scan_classify_sse2;
+  }
+  else if(!strcmp(name, "avx2") && __builtin_cpu_supports("avx2") &&
+	  __builtin_cpu_supports("pclmul")) {
+    json_scan_name = "avx2";
+    json_scan_impl = json_scan_structurals_avx2;
+    json_scan_classify_impl = json_scan_classify_avx2;
+  }
+#endif
+  else {
+    return 1;
+  }
+  return 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* Choose the fastest implementation that this CPU supports. */
+void json_scan_select(void) {
+#ifdef JSON_SCAN_X86
+  __builtin_cpu_init();
+  if(!json_scan_set_implementation("avx2")) return;
+  if(!json_scan_set_implementation("sse2")) return;
+#endif
+  json_scan_set_implementation("scalar");
+}
+
+/* Compute the bit-wise prefix xor of the mask, where each bit of the
+   result is the xor of all of the bits at or below that position.
+   Applied to the quote mask, this gives the characters that are
+   within a string. */
+static inline uint64_t json_prefix_xor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+/* Find the characters that are escaped by an odd length run of
+   backslashes.  Runs that start on an odd bit are carried past the
+   end of the run by the addition, which leaves the runs that start on
+   an even bit. */
+static inline uint64_t json_scan_escaped(struct json_scanner *scanner, uint64_t backslash,
+					 unsigned int n) {
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  uint64_t escaped, follows_escape, odd_starts, even_series, invert_mask;
+
+  if(!backslash) {
+    escaped = scanner->prev_escaped;
+    scanner->prev_escaped = 0;
+    return escaped;
+  }
+
+  backslash &= ~scanner->prev_escaped;
+  follows_escape = backslash << 1 | scanner->prev_escaped;
+  odd_starts = backslash & ~even_bits & ~follows_escape;
+  even_series = odd_starts + backslash;
+  scanner->prev_escaped = even_series < odd_starts; /* Overflow */
+  invert_mask = even_series << 1;
+  escaped = (even_bits ^ invert_mask) & follows_escape;
+
+  /* In a partial block, the character after the last one is padding,
+     and the escape is carried to the next block instead. */
+  if(n < JSON_SCAN_BLK_SZ) {
+    scanner->prev_escaped = (escaped >> n) & 1;
+    escaped &= ((uint64_t)1 << n) - 1;
+  }
+  return escaped;
+}
+
+/* Turn the classification of one block into the structural bits of
+   the block.  The arguments are (scanner, masks, unescaped quotes,
+   prefix xor of the unescaped quotes, number of characters in the
+   block).  This is shared by all of the implementations. */
+static inline uint64_t json_scan_bits(struct json_scanner *scanner,
+				      const struct json_scan_masks *masks,
+				      uint64_t quote, uint64_t quote_xor, unsigned int n) {
+  uint64_t in_string, scalar, scalar_start;
+
+  /* The in_string mask runs from an opening quote up to, but not
+     including, the closing quote. */
+  in_string = quote_xor ^ scanner->prev_in_string;
+  scanner->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+  /* Scalars are runs of characters outside strings that are not
+     structural or white space.  Only the first character of each run
+     is recorded. */
+  scalar = ~(masks->structural | masks->whitespace | quote | in_string);
+  scalar_start = scalar & ~(scalar << 1 | scanner->prev_scalar);
+  scanner->prev_scalar = (scalar >> (n-1)) & 1;
+
+  return (masks->structural & ~in_string) | quote | scalar_start;
+}
+
+/* The structural bits of one block of n characters, using the
+   portable prefix xor. */
+static inline uint64_t json_scan_block(struct json_scanner *scanner,
+				       const struct json_scan_masks *masks, unsigned int n) {
+  uint64_t quote = masks->quote & ~json_scan_escaped(scanner, masks->backslash, n);
+  return json_scan_bits(scanner, masks, quote, json_prefix_xor(quote), n);
+}
+
+/* Write the offsets of the set bits to the index array.  Returns the
+   number of offsets written. */
+static inline size_t json_scan_flatten(uint64_t bits, uint32_t offset, uint32_t *indices) {
+  size_t n = 0;
+  while(bits) {
+#if defined(__GNUC__)
+    indices[n++] = offset + (uint32_t)__builtin_ctzll(bits);
+#else
+    uint32_t i = 0;
+    while(!((bits >> i) & 1)) i++;
+    indices[n++] = offset + i;
+#endif
+    bits &= bits - 1;
+  }
+  return n;
+}
+
+/* Copy a partial block into a block that is padded with white
+   space. */
+static inline void json_scan_pad(const char *buffer, size_t size, char *block) {
+  memset(block, ' ', JSON_SCAN_BLK_SZ);
+  memcpy(block, buffer, size);
+}
+
+void json_scan_classify_scalar(const char *block, struct json_scan_masks *masks) {
+  static const unsigned char json_class[256] = {
+    ['"'] = JSON_CLASS_QUOTE,
+    ['\\'] = JSON_CLASS_BACKSLASH,
+    ['{'] = JSON_CLASS_STRUCTURAL, ['}'] = JSON_CLASS_STRUCTURAL,
+    ['['] = JSON_CLASS_STRUCTURAL, [']'] = JSON_CLASS_STRUCTURAL,
+    [':'] = JSON_CLASS_STRUCTURAL, [','] = JSON_CLASS_STRUCTURAL,
+    [' '] = JSON_CLASS_WHITESPACE, ['\t'] = JSON_CLASS_WHITESPACE,
+    ['\n'] = JSON_CLASS_WHITESPACE, ['\r'] = JSON_CLASS_WHITESPACE};
+  unsigned int i;
+  unsigned char c;
+  uint64_t bit;
+
+  masks->quote = masks->backslash = masks->structural = masks->whitespace = 0;
+  for(i=0;i<JSON_SCAN_BLK_SZ;i++) {
+    c = json_class[(unsigned char)block[i]];
+    if(!c) continue;
+    bit = (uint64_t)1 << i;
+    if(c & JSON_CLASS_QUOTE) masks->quote |= bit;
+    else if(c & JSON_CLASS_BACKSLASH) masks->backslash |= bit;
+    else if(c & JSON_CLASS_STRUCTURAL) masks->structural |= bit;
+    else masks->whitespace |= bit;
+  }
+}
+
+size_t json_scan_structurals_scalar(struct json_scanner *scanner, const char *buffer,
+				    size_t size, uint32_t *indices) {
+  struct json_scan_masks masks;
+  char block[JSON_SCAN_BLK_SZ];
+  size_t i = 0, n = 0;
+
+  for(i=0;i+JSON_SCAN_BLK_SZ<=size;i+=JSON_SCAN_BLK_SZ) {
+    json_scan_classify_scalar(buffer+i, &masks);
+    n += json_scan_flatten(json_scan_block(scanner, &masks, JSON_SCAN_BLK_SZ), (uint32_t)i, indices+n);
+  }
+  if(i < size) {
+    json_scan_pad(buffer+i, size-i, block);
+    json_scan_classify_scalar(block, &masks);
+    n += json_scan_flatten(json_scan_block(scanner, &masks, (unsigned int)(size-i)), (uint32_t)i, indices+n);
+  }
+  return n;
+}
+
+#ifdef JSON_SCAN_X86
+
+__attribute__((target("sse2")))
+void json_scan_classify_sse2(const char *block, struct json_scan_masks *masks) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i open = _mm_set1_epi8('{'); /* '[' | 0x20 == '{' */
+  const __m128i close = _mm_set1_epi8('}'); /* ']' | 0x20 == '}' */
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  __m128i v, folded, s, w;
+  uint64_t bits;
+  int i;
+
+  masks->quote = masks->backslash = masks->structural = masks->whitespace = 0;
+  for(i=0;i<4;i++) {
+    v = _mm_loadu_si128((const __m128i*)(block + 16*i));
+    folded = _mm_or_si128(v, case_bit);
+    s = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+		     _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+    w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+		     _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+    bits = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+    masks->quote |= bits << (16*i);
+    bits = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash));
+    masks->backslash |= bits << (16*i);
+    bits = (uint64_t)(uint16_t)_mm_movemask_epi8(s);
+    masks->structural |= bits << (16*i);
+    bits = (uint64_t)(uint16_t)_mm_movemask_epi8(w);
+    masks->whitespace |= bits << (16*i);
+  }
+}
+
+__attribute__((target("sse2")))
+size_t json_scan_structurals_sse2(struct json_scanner *scanner, const char *buffer,
+				  size_t size, uint32_t *indices) {
+  struct json_scan_masks masks;
+  char block[JSON_SCAN_BLK_SZ];
+  size_t i = 0, n = 0;
+
+  for(i=0;i+JSON_SCAN_BLK_SZ<=size;i+=JSON_SCAN_BLK_SZ) {
+    json_scan_classify_sse2(buffer+i, &masks);
+    n += json_scan_flatten(json_scan_block(scanner, &masks, JSON_SCAN_BLK_SZ), (uint32_t)i, indices+n);
+  }
+  if(i < size) {
+    json_scan_pad(buffer+i, size-i, block);
+    json_scan_classify_sse2(block, &masks);
+    n += json_scan_flatten(json_scan_block(scanner, &masks, (unsigned int)(size-i)), (uint32_t)i, indices+n);
+  }
+  return n;
+}
+
+__attribute__((target("avx2")))
+void json_scan_classify_avx2(const char *block, struct json_scan_masks *masks) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i open = _mm256_set1_epi8('{');
+  const __m256i close = _mm256_set1_epi8('}');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i comma = _mm256_set1_epi8(',');
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  __m256i v, folded, s, w;
+  uint64_t bits;
+  int i;
+
+  masks->quote = masks->backslash = masks->structural = masks->whitespace = 0;
+  for(i=0;i<2;i++) {
+    v = _mm256_loadu_si256((const __m256i*)(block + 32*i));
+    folded = _mm256_or_si256(v, case_bit);
+    s = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, open),
+					_mm256_cmpeq_epi8(folded, close)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+    w = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, cr)));
+    bits = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote));
+    masks->quote |= bits << (32*i);
+    bits = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash));
+    masks->backslash |= bits << (32*i);
+    bits = (uint64_t)(uint32_t)_mm256_movemask_epi8(s);
+    masks->structural |= bits << (32*i);
+    bits = (uint64_t)(uint32_t)_mm256_movemask_epi8(w);
+    masks->whitespace |= bits << (32*i);
+  }
+}
+
+/* The prefix xor can be computed with a single carry-less
+   multiplication by all ones. */
+__attribute__((target("avx2,pclmul")))
+static inline uint64_t json_prefix_xor_clmul(uint64_t bits) {
+  __m128i v = _mm_set_epi64x(0, (long long)bits);
+  __m128i ones = _mm_set1_epi8((char)0xFF);
+  return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(v, ones, 0));
+}
+
+__attribute__((target("avx2,pclmul")))
+static inline uint64_t json_scan_block_avx2(struct json_scanner *scanner,
+					    const struct json_scan_masks *masks, unsigned int n) {
+  uint64_t quote = masks->quote & ~json_scan_escaped(scanner, masks->backslash, n);
+  return json_scan_bits(scanner, masks, quote, json_prefix_xor_clmul(quote), n);
+}
+
+__attribute__((target("avx2,pclmul")))
+size_t json_scan_structurals_avx2(struct json_scanner *scanner, const char *buffer,
+				  size_t size, uint32_t *indices) {
+  struct json_scan_masks masks;
+  char block[JSON_SCAN_BLK_SZ];
+  size_t i = 0, n = 0;
+
+  for(i=0;i+JSON_SCAN_BLK_SZ<=size;i+=JSON_SCAN_BLK_SZ) {
+    json_scan_classify_avx2(buffer+i, &masks);
+    n += json_scan_flatten(json_scan_block_avx2(scanner, &masks, JSON_SCAN_BLK_SZ), (uint32_t)i, indices+n);
+  }
+  if(i < size) {
+    json_scan_pad(buffer+i, size-i, block);
+    json_scan_classify_avx2(block, &masks);
+    n += json_scan_flatten(json_scan_block_avx2(scanner, &masks, (unsigned int)(size-i)), (uint32_t)i, indices+n);
+  }
+  return n;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of characters that are classified at a time. */
+#define JSON_SCAN_BLK_SZ 64
+
+/* The state that is carried from one block of characters to the next,
+   such that strings, escapes and scalars can span blocks. */
+struct json_scanner {
+  uint64_t prev_escaped; /* 1 if the first character of the next block is escaped */
+  uint64_t prev_in_string; /* All ones if the next block starts within a string */
+  uint64_t prev_scalar; /* 1 if the previous block ended within a scalar */
+};
+
+/* The classification of one block of characters.  Bit i of each mask
+   corresponds to character i of the block. */
+struct json_scan_masks {
+  uint64_t quote; /* '"' */
+  uint64_t backslash; /* '\\' */
+  uint64_t structural; /* '{', '}', '[', ']', ':' and ',' */
+  uint64_t whitespace; /* ' ', '\t', '\n' and '\r' */
+};
+
+/* Zero all variables. */
+void json_scanner_clear(struct json_scanner *scanner);
+
+/* Classify one block of JSON_SCAN_BLK_SZ characters, using the
+   implementation selected for this machine. */
+void json_scan_classify(const char *block, struct json_scan_masks *masks);
+
+/* Find the structural characters in a buffer.  The arguments are
+   (scanner, buffer, number of characters, index array).  The offsets
+   of the structural characters outside of strings, of the opening and
+   closing quotes of every string and of the first character of every
+   number, true, false or null are written to the index array in
+   order.  The index array must have room for one offset per
+   character.  The scanner state is updated, such that the next call
+   continues where this one stopped.  The number of characters need
+   not be a multiple of JSON_SCAN_BLK_SZ: the last, partial block is
+   padded with white space, and the escape, string and scalar state
+   after its last character is carried to the next call, such that a
+   document can be scanned in chunks of any length.  Returns the
+   number of offsets written. */
+size_t json_scan_structurals(struct json_scanner *scanner, const char *buffer, size_t size,
+			     uint32_t *indices);
+
+/* Returns the name of the implementation in use: "avx2", "sse2" or
+   "scalar".  The implementation is chosen the first time the scanner
+   is used, from the instruction sets that the CPU supports. */
+const char* json_scan_implementation(void);
+
+/* Force a particular implementation, by name.  Returns zero on
+   success, or non-zero if the implementation is not available on this
+   machine. */
+int json_scan_set_implementation(const char *name);
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "json_ascii_utils.h"
+#include "json_sink.h"
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_sink_init(struct json_sink *sink);
+int json_sink_grow(struct json_sink *sink, size_t n);
+int json_sink_write_out(struct json_sink *sink, const char *str, size_t n);
+
+int json_sink_init_buffer(struct json_sink *sink, struct char_buffer *buffer) {
+  sink->buffer = buffer->buffer;
+  sink->position = buffer->position;
+  sink->size = buffer->size;
+  sink->memory = buffer;
+  sink->fptr = 0;
+  sink->fd = -1;
+  sink->start = buffer->position;
+  sink->n_out = 0;
+  sink->status = 0;
+  return 0;
+}
+
+int json_sink_init_file(struct json_sink *sink, FILE *fptr) {
+  if(json_sink_init(sink)) return 1;
+  sink->fptr = fptr;
+  return 0;
+}
+
+int json_sink_init_fd(struct json_sink *sink, int fd) {
+  if(json_sink_init(sink)) return 1;
+  sink->fd = fd;
+  return 0;
+}
+
+int json_sink_write(struct json_sink *sink, const char *str, size_t n) {
+  if(sink->size - sink->position < n && json_sink_grow(sink, n)) {
+    return sink->status;
+  }
+
+  /* A large block of characters is written out directly, rather than
+     being copied through the buffer. */
+  if(n > sink->size - sink->position) {
+    json_sink_write_out(sink, str, n);
+    return sink->status;
+  }
+
+  memcpy(sink->buffer + sink->position, str, n);
+  sink->position += n;
+  return 0;
+}
+
+int json_sink_putc(struct json_sink *sink, char c) {
+  if(sink->position == sink->size && json_sink_grow(sink, 1)) return sink->status;
+  sink->buffer[sink->position++] = c;
+  return 0;
+}
+
+char* json_sink_reserve(struct json_sink *sink, size_t n) {
+  if(sink->size - sink->position < n) {
+    if(json_sink_grow(sink, n)) return 0;
+    if(sink->size - sink->position < n) return 0;
+  }
+  return sink->buffer + sink->position;
+}
+
+size_t json_sink_tell(const struct json_sink *sink) {
+  if(sink->memory) return sink->position - sink->start;
+  return sink->n_out + sink->position;
+}
+
+int json_sink_flush(struct json_sink *sink) {
+  if(sink->memory || sink->status) return sink->status;
+  json_sink_write_out(sink, sink->buffer, sink->position);
+  sink->position = 0;
+  if(sink->fptr && !sink->status && fflush(sink->fptr)) {
+    fprintf(stderr, "Error: could not write to the file.\n");
+    sink->status = 1;
+  }
+  return sink->status;
+}
+
+int json_sink_finish(struct json_sink *sink) {
+  if(sink->memory) {
+    sink->memory->position = sink->position;
+  }
+  else {
+    json_sink_flush(sink);
+    free(sink->buffer);
+  }
+  sink->buffer = 0;
+  sink->position = 0;
+  sink->size = 0;
+  return sink->status;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to allocate the buffer of a sink that writes to a file or
+   a file descriptor. */
+int json_sink_init(struct json_sink *sink) {
+  sink->buffer = (char*)malloc(JSON_SINK_BLK_SZ);
+  sink->position = 0;
+  sink->size = JSON_SINK_BLK_SZ;
+  sink->memory = 0;
+  sink->fptr = 0;
+  sink->fd = -1;
+  sink->start = 0;
+  sink->n_out = 0;
+  sink->status = 0;
+  if(!sink->buffer) {
+    fprintf(stderr, "Error: could not allocate memory for the output buffer.\n");
+    sink->size = 0;
+    sink->status = 1;
+    return 1;
+  }
+  return 0;
+}
+
+/* A function to make room for n more characters.  A char_buffer is
+   enlarged, while a file sink writes out what it has collected.
+   Returns non-zero after an error. */
+int json_sink_grow(struct json_sink *sink, size_t n) {
+  if(sink->status) return sink->status;
+
+  if(sink->memory) {
+    if(char_buffer_reserve(sink->memory, sink->position + n)) {
+      sink->status = 1;
+      return sink->status;
+    }
+    sink->buffer = sink->memory->buffer;
+    sink->size = sink->memory->size;
+    return 0;
+  }
+
+  json_sink_write_out(sink, sink->buffer, sink->position);
+  sink->position = 0;
+  return sink->status;
+}
+
+/* A function to write characters to the file or file descriptor. */
+int json_sink_write_out(struct json_sink *sink, const char *str, size_t n) {
+  ssize_t written = 0;
+
+  if(sink->status || !n) return sink->status;
+  sink->n_out += n;
+
+  if(sink->fptr) {
+    if(fwrite(str, 1, n, sink->fptr) != n) {
+      fprintf(stderr, "Error: could not write to the file.\n");
+      sink->status = 1;
+    }
+    return sink->status;
+  }
+
+  /* write(2) may write fewer characters than were asked for. */
+  while(n) {
+    written = write(sink->fd, str, n);
+    if(written < 0) {
+      if(errno == EINTR) continue;
+      fprintf(stderr, "Error: could not write to file descriptor %d.\n", sink->fd);
+      sink->status = 1;
+      break;
+    }
+    str += written;
+    n -= (size_t)written;
+  }
+  return sink->status;
+}
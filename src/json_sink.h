@@ -0,0 +1,74 @@
+#ifndef JSON_SINK_H
+#define JSON_SINK_H
+
+#include <stdio.h>
+
+#include "json.h"
+
+/* The number of characters that are collected before they are written
+   to a file or a file descriptor. */
+#define JSON_SINK_BLK_SZ 65536
+
+/* The destination of a writer.  Characters are collected in a buffer
+   and written in large blocks, such that the writer does not make one
+   library call per token.  When the destination is a char_buffer, the
+   characters are written straight into its memory, which grows as
+   needed. */
+struct json_sink {
+  char *buffer; /* The characters that have not been written yet */
+  size_t position; /* The number of characters in the buffer */
+  size_t size; /* The number of characters allocated */
+
+  struct char_buffer *memory; /* Either null or the destination in memory */
+  FILE *fptr; /* Either null or the destination file */
+  int fd; /* Either -1 or the destination file descriptor */
+  size_t start; /* The position of the char_buffer when the sink was prepared */
+  size_t n_out; /* The number of characters written to the file so far */
+
+  int status; /* Non-zero after an error, when further writes are ignored */
+};
+
+/* Prepare a sink that appends to a char_buffer.  The arguments are
+   (sink, char_buffer).  The position of the char_buffer is updated by
+   json_sink_finish.  Returns zero on success. */
+int json_sink_init_buffer(struct json_sink *sink, struct char_buffer *buffer);
+
+/* Prepare a sink that writes to an open file.  Returns zero on
+   success. */
+int json_sink_init_file(struct json_sink *sink, FILE *fptr);
+
+/* Prepare a sink that writes to a file descriptor, with write(2).
+   Returns zero on success. */
+int json_sink_init_fd(struct json_sink *sink, int fd);
+
+/* Write characters to the sink.  The arguments are (sink, characters,
+   number of characters).  Returns the status of the sink. */
+int json_sink_write(struct json_sink *sink, const char *str, size_t n);
+
+/* Write one character to the sink.  Returns the status of the sink. */
+int json_sink_putc(struct json_sink *sink, char c);
+
+/* Make room for n characters, which the caller then writes at
+   buffer + position, before adding the number written to position.
+   This lets numbers be formatted in place.  Returns a pointer to the
+   free space, or null after an error. */
+char* json_sink_reserve(struct json_sink *sink, size_t n);
+
+/* The number of characters written to the sink since it was
+   prepared, whether or not they have been flushed. */
+size_t json_sink_tell(const struct json_sink *sink);
+
+/* Write the characters that have been collected to the file or file
+   descriptor.  Returns the status of the sink. */
+int json_sink_flush(struct json_sink *sink);
+
+/* Flush the sink and free its memory.  Returns the status of the
+   sink, which is zero if all of the characters were written. */
+int json_sink_finish(struct json_sink *sink);
+
+/* A function to write the json_data to a sink, which is not flushed.
+   The arguments are (sink, mode, json_data), where the mode is as for
+   json_write.  Returns the number of json_values written. */
+size_t json_write_sink(struct json_sink *sink, const char *mode, const struct json_data *json);
+
+#endif
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json.h"
+#include "json_stats.h"
+
+void json_stats_clear(struct json_stats *stats) {
+  memset(stats, 0, sizeof(struct json_stats));
+}
+
+int json_data_use_stats(struct json_data *json, struct json_stats *stats) {
+#ifdef JSON_STATS
+  json->stats = stats;
+  return 0;
+#else
+  (void)json;
+  (void)stats;
+  fprintf(stderr, "Error: the library was built without statistics.\n");
+  return 1;
+#endif
+}
+
+void json_stats_print(FILE *fptr, const struct json_stats *stats) {
+  unsigned int i;
+
+  fprintf(fptr, "{\"nodes\":{");
+  for(i=0;i<JSON_STATS_N_TYPES;i++) {
+    fprintf(fptr, "%s\"%s\":%lu", i ? "," : "", json_type_to_string(i), (unsigned long)stats->nodes[i]);
+  }
+  fprintf(fptr, "},\"bytes_scanned\":%lu,\"bytes_written\":%lu,\"allocations\":%lu,"
+	  "\"bytes_allocated\":%lu,\"reallocations\":%lu,\"max_depth\":%lu,"
+	  "\"scan_seconds\":%.6f,\"number_seconds\":%.6f,\"build_seconds\":%.6f,\"write_seconds\":%.6f}\n",
+	  (unsigned long)stats->bytes_scanned, (unsigned long)stats->bytes_written,
+	  (unsigned long)stats->allocations, (unsigned long)stats->bytes_allocated,
+	  (unsigned long)stats->reallocations, (unsigned long)stats->max_depth,
+	  stats->scan_seconds, stats->number_seconds, stats->build_seconds, stats->write_seconds);
+}
+
+double json_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + 1e-9*(double)now.tv_nsec;
+}
@@ -0,0 +1,66 @@
+#ifndef JSON_STATS_H
+#define JSON_STATS_H
+
+#include <stddef.h>
+
+#include "json.h"
+
+/* The number of json_types that are counted, from JSON_NDEF to
+   JSON_PACKED_FLOAT. */
+#define JSON_STATS_N_TYPES 11
+
+/* Counters of the work done by the readers and writers of a json_data,
+   for profiling and for sizing arenas.  The counters are only filled
+   in if the library was built with JSON_STATS defined, which
+   ./configure --enable-stats does.  Otherwise the code that fills them
+   in is not compiled at all.  The counters accumulate over every read
+   and write, until they are cleared. */
+struct json_stats {
+  size_t nodes[JSON_STATS_N_TYPES]; /* The json_values read, by json_type */
+  size_t bytes_scanned; /* The characters fed to the parser */
+  size_t bytes_written; /* The characters or bytes written */
+  size_t allocations; /* The allocations for json_values, strings and children */
+  size_t bytes_allocated; /* The bytes of those allocations */
+  size_t reallocations; /* The arrays of children and json_values that were grown */
+  size_t max_depth; /* The deepest nesting of objects and arrays read */
+
+  /* The wall time of each phase, in seconds.  The scan finds the
+     structural characters, and the build is the rest of the parse,
+     other than converting numbers, true, false and null. */
+  double scan_seconds;
+  double number_seconds;
+  double build_seconds;
+  double write_seconds;
+};
+
+/* Zero all of the counters. */
+void json_stats_clear(struct json_stats *stats);
+
+/* Collect statistics on the reads and writes of a json_data.  The
+   counters are updated by json_read_ascii_buffer,
+   json_read_ascii_buffer_insitu, json_read_ascii_file,
+   json_parser_init and the writers of a json_data, and the
+   allocations also by json_read_ascii_buffer_lazy.  Timing every
+   number adds some overhead of its own.  json_read_ascii_buffer_parallel
+   reads serially, such that the counters are only updated from one
+   thread.  The stats struct must outlive its use by the json_data,
+   and may be shared by json_data structs that are used from one
+   thread.  The arguments are (json_data, stats).  Returns zero on
+   success, or non-zero if the library was built without JSON_STATS. */
+int json_data_use_stats(struct json_data *json, struct json_stats *stats);
+
+/* Print the counters, as one line of json, to a file. */
+void json_stats_print(FILE *fptr, const struct json_stats *stats);
+
+/* The time in seconds from an arbitrary start, for timing the phases. */
+double json_stats_now(void);
+
+/* Add to a counter, if statistics are collected.  This compiles to
+   nothing without JSON_STATS. */
+#ifdef JSON_STATS
+#define JSON_STATS_ADD(stats, counter, n) do { if(stats) (stats)->counter += (n); } while(0)
+#else
+#define JSON_STATS_ADD(stats, counter, n) do {} while(0)
+#endif
+
+#endif
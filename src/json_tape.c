@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json_arena.h"
+#include "json_lazy.h"
+#include "json_parser.h"
+#include "json_tape.h"
+
+/* The depth of nesting that is handled without allocating, when a
+   tree is copied to or from a tape. */
+#define JSON_TAPE_STACK_SZ 64
+
+/* An object, array or pair whose children are being copied.  For a
+   tree, the next child is an index into its children, and for a tape
+   it is the entry after the last child. */
+struct json_tape_frame {
+  struct json_value *jv;
+  size_t next; /* The next child, or the end of the children on a tape */
+  size_t i; /* The index of the entry of the object or array */
+};
+
+/* The state of a tape that is being read from the events of the
+   parser.  The stack holds the indices of the open objects and
+   arrays. */
+struct json_tape_builder {
+  struct json_tape *tape;
+  size_t *stack;
+  size_t depth;
+  size_t size_of_stack;
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+int json_tape_push(struct json_tape *tape, uint32_t json_type, size_t *i);
+int json_tape_push_string(struct json_tape *tape, uint32_t json_type, const char *str, size_t n);
+int json_tape_push_value(struct json_tape *tape, const struct json_value *jv);
+int json_tape_grow_stack(struct json_tape_frame **stack, struct json_tape_frame *stack_buffer,
+			 size_t *size_of_stack);
+int json_tape_build_count(struct json_tape_builder *builder, int key);
+int json_tape_build_begin(struct json_tape_builder *builder, uint32_t json_type);
+int json_tape_build_object_begin(void *ctx);
+int json_tape_build_array_begin(void *ctx);
+int json_tape_build_end(void *ctx);
+int json_tape_build_key(void *ctx, const char *str, size_t n);
+int json_tape_build_string(void *ctx, const char *str, size_t n);
+int json_tape_build_int(void *ctx, long l);
+int json_tape_build_float(void *ctx, double d);
+int json_tape_build_bool(void *ctx, int b);
+int json_tape_build_null(void *ctx);
+struct json_value* json_string_value(struct json_data *json, const char *str, size_t str_len);
+struct json_value* json_key_value(struct json_data *json, const char *str, size_t str_len);
+int json_append_value(struct json_data *json, struct json_value *json_value);
+struct json_value* json_add_structure(struct json_data *json, int json_type);
+int json_add_element(struct json_data *json, struct json_value *jv_parent, struct json_value *jv);
+
+/* The tape is built from the events of the parser. */
+static const struct json_callbacks json_tape_callbacks = {
+  json_tape_build_object_begin,
+  json_tape_build_end,
+  json_tape_build_array_begin,
+  json_tape_build_end,
+  json_tape_build_key,
+  json_tape_build_string,
+  json_tape_build_int,
+  json_tape_build_float,
+  json_tape_build_bool,
+  json_tape_build_null
+};
+
+void json_tape_clear(struct json_tape *tape) {
+  tape->entries = 0;
+  tape->n_entries = 0;
+  tape->entries_alloc = 0;
+  tape->strings = 0;
+  tape->strings_size = 0;
+  tape->strings_alloc = 0;
+}
+
+void json_tape_free(struct json_tape *tape) {
+  if(tape->entries) free(tape->entries);
+  if(tape->strings) free(tape->strings);
+  json_tape_clear(tape);
+}
+
+size_t json_read_ascii_buffer_tape(struct json_tape *tape, const struct char_buffer *buffer) {
+  struct json_tape_builder builder;
+  size_t n_entries = tape->n_entries;
+  size_t strings_size = tape->strings_size;
+  int status = 0;
+
+  builder.tape = tape;
+  builder.stack = 0;
+  builder.depth = 0;
+  builder.size_of_stack = 0;
+
+  status = json_read_ascii_events(buffer, &json_tape_callbacks, &builder);
+  if(builder.stack) free(builder.stack);
+
+  /* The entries of a document that is not valid are removed, as its
+     open objects and arrays have no end. */
+  if(status) {
+    tape->n_entries = n_entries;
+    tape->strings_size = strings_size;
+    return 0;
+  }
+
+  /* Return the number of entries read */
+  return tape->n_entries - n_entries;
+}
+
+int json_tape_from_data(struct json_tape *tape, const struct json_data *json) {
+  size_t n_entries = tape->n_entries;
+  size_t strings_size = tape->strings_size;
+  unsigned int i;
+
+  /* Only the json_values that do not have a parent start a tree. */
+  for(i=0;i<json->n_json_values;i++) {
+    if(!json->json_values[i] || json->json_values[i]->parent) continue;
+    if(json_tape_from_value(tape, json->json_values[i])) {
+      tape->n_entries = n_entries;
+      tape->strings_size = strings_size;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int json_tape_from_value(struct json_tape *tape, const struct json_value *jv) {
+  struct json_tape_frame stack_buffer[JSON_TAPE_STACK_SZ];
+  struct json_tape_frame *stack = stack_buffer;
+  struct json_tape_frame *top = 0;
+  size_t depth = 0, size_of_stack = JSON_TAPE_STACK_SZ;
+  struct json_value *child = (struct json_value*)jv;
+  size_t n_entries = tape->n_entries;
+  size_t strings_size = tape->strings_size;
+  int status = 0;
+
+  /* The values are copied in document order.  An object or array is
+     given its end once all of its children have been copied. */
+  while(!status) {
+    if(child) {
+      status = json_tape_push_value(tape, child);
+      if(status) break;
+      if(!child->nchildren) {
+	child = 0;
+	continue;
+      }
+      if(depth == size_of_stack && json_tape_grow_stack(&stack, stack_buffer, &size_of_stack)) {
+	status = 2;
+	break;
+      }
+      stack[depth].jv = child;
+      stack[depth].next = 0;
+      stack[depth].i = tape->n_entries - 1;
+      depth++;
+      child = 0;
+    }
+
+    if(!depth) break;
+    top = &stack[depth-1];
+    if(top->next == top->jv->nchildren) {
+      if(top->jv->json_type != JSON_PAIR) tape->entries[top->i].value.end = tape->n_entries;
+      depth--;
+      continue;
+    }
+    child = top->jv->children[top->next++];
+  }
+
+  if(stack != stack_buffer) free(stack);
+
+  /* A tree that could not be copied whole is removed. */
+  if(status) {
+    tape->n_entries = n_entries;
+    tape->strings_size = strings_size;
+  }
+  return status;
+}
+
+size_t json_tape_to_data(const struct json_tape *tape, struct json_data *json) {
+  struct json_tape_frame stack_buffer[JSON_TAPE_STACK_SZ];
+  struct json_tape_frame *stack = stack_buffer;
+  size_t depth = 0, size_of_stack = JSON_TAPE_STACK_SZ, i;
+  const struct json_tape_entry *entry = 0;
+  struct json_value *jv = 0, *parent = 0;
+  int status = 0;
+
+  if(json->insitu) {
+    fprintf(stderr, "Error: a json_data that was read in situ can only be read in situ.\n");
+    return 0;
+  }
+
+  for(i=0;i<tape->n_entries && !status;i++) {
+    /* The objects, arrays and pairs that end before this entry are
+       complete. */
+    while(depth && i >= stack[depth-1].next) depth--;
+    parent = depth ? stack[depth-1].jv : 0;
+    entry = &tape->entries[i];
+
+    switch(entry->json_type) {
+    case JSON_STRING: case JSON_PAIR:
+      if(entry->json_type == JSON_PAIR) jv = json_key_value(json, tape->strings + entry->value.offset, entry->n);
+      else jv = json_string_value(json, tape->strings + entry->value.offset, entry->n);
+      if(!jv || json_append_value(json, jv)) {
+	status = 1;
+	continue;
+      }
+      break;
+
+    default:
+      jv = json_add_structure(json, entry->json_type);
+      if(!jv) {
+	status = 1;
+	continue;
+      }
+      if(entry->json_type == JSON_INT) jv->value.l_value = entry->value.l_value;
+      else if(entry->json_type == JSON_FLOAT) jv->value.d_value = entry->value.d_value;
+      else if(entry->json_type == JSON_BOOLEAN) jv->value.b_value = entry->value.b_value;
+
+      /* The children are allocated from the count. */
+      if((entry->json_type == JSON_OBJECT || entry->json_type == JSON_ARRAY) && entry->n) {
+	jv->children = (struct json_value**)json_data_alloc(json, entry->n*sizeof(struct json_value*));
+	if(!jv->children) {
+	  fprintf(stderr, "Error: could not allocate memory to store a pointer to the json element");
+	  status = 2;
+	  continue;
+	}
+	jv->nchildren_alloc = entry->n;
+      }
+    }
+
+    if(json_add_element(json, parent, jv)) {
+      status = 3;
+      continue;
+    }
+
+    /* The entries that follow an object or array with children, or a
+       key, belong to it. */
+    if(entry->json_type == JSON_PAIR || ((entry->json_type == JSON_OBJECT || entry->json_type == JSON_ARRAY) && entry->n)) {
+      if(depth == size_of_stack && json_tape_grow_stack(&stack, stack_buffer, &size_of_stack)) {
+	status = 4;
+	continue;
+      }
+      stack[depth].jv = jv;
+      stack[depth].next = json_tape_skip(tape, i);
+      stack[depth].i = i;
+      depth++;
+    }
+  }
+
+  if(stack != stack_buffer) free(stack);
+  if(status) return 0;
+
+  /* Return the number of json_values read */
+  return json->n_json_values;
+}
+
+size_t json_tape_skip(const struct json_tape *tape, size_t i) {
+  switch(tape->entries[i].json_type) {
+  case JSON_OBJECT: case JSON_ARRAY:
+    return tape->entries[i].value.end;
+  case JSON_PAIR:
+    if(i + 1 == tape->n_entries) return i + 1;
+    return json_tape_skip(tape, i + 1);
+  default:
+    return i + 1;
+  }
+}
+
+const char* json_tape_string(const struct json_tape *tape, size_t i) {
+  const struct json_tape_entry *entry = &tape->entries[i];
+  if(entry->json_type != JSON_STRING && entry->json_type != JSON_PAIR) return 0;
+  return tape->strings + entry->value.offset;
+}
+
+size_t json_tape_find(const struct json_tape *tape, size_t i, const char *key, size_t n) {
+  const struct json_tape_entry *entry = 0;
+  struct json_tape_iter iter;
+  size_t j;
+
+  if(tape->entries[i].json_type != JSON_OBJECT) return 0;
+  json_tape_iter_init(&iter, tape, i);
+  while(json_tape_iter_next(&iter, &j)) {
+    entry = &tape->entries[j];
+    if(entry->n == n && !memcmp(tape->strings + entry->value.offset, key, n)) return j + 1;
+  }
+  return 0;
+}
+
+size_t json_tape_element(const struct json_tape *tape, size_t i, size_t k) {
+  size_t j = i + 1;
+
+  if(tape->entries[i].json_type != JSON_ARRAY || k >= tape->entries[i].n) return 0;
+  while(k--) j = json_tape_skip(tape, j);
+  return j;
+}
+
+void json_tape_iter_init(struct json_tape_iter *iter, const struct json_tape *tape, size_t i) {
+  iter->tape = tape;
+  iter->next = 0;
+  iter->end = 0;
+  if(i == JSON_TAPE_ROOT) {
+    iter->end = tape->n_entries;
+  }
+  else if(tape->entries[i].json_type == JSON_OBJECT || tape->entries[i].json_type == JSON_ARRAY) {
+    iter->next = i + 1;
+    iter->end = tape->entries[i].value.end;
+  }
+}
+
+int json_tape_iter_next(struct json_tape_iter *iter, size_t *i) {
+  if(iter->next >= iter->end) return 0;
+  *i = iter->next;
+  iter->next = json_tape_skip(iter->tape, iter->next);
+  return 1;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A function to append an entry to a tape.  The array of entries is
+   doubled in size when it is full.  The arguments are (tape,
+   json_type, pointer to the index of the entry).  Returns zero on
+   success. */
+int json_tape_push(struct json_tape *tape, uint32_t json_type, size_t *i) {
+  struct json_tape_entry *realloc_entries = 0;
+  size_t entries_alloc = 0;
+
+  if(tape->n_entries == tape->entries_alloc) {
+    entries_alloc = tape->entries_alloc ? 2*tape->entries_alloc : 64;
+    realloc_entries = (struct json_tape_entry*)realloc(tape->entries,
+						       entries_alloc*sizeof(struct json_tape_entry));
+    if(!realloc_entries) {
+      fprintf(stderr, "Error: could not allocate memory for the entries of a tape.\n");
+      return 1;
+    }
+    tape->entries = realloc_entries;
+    tape->entries_alloc = entries_alloc;
+  }
+
+  *i = tape->n_entries++;
+  tape->entries[*i].json_type = json_type;
+  tape->entries[*i].n = 0;
+  memset(&tape->entries[*i].value, 0, sizeof(tape->entries[*i].value));
+  return 0;
+}
+
+/* A function to append a string or a key to a tape, with its
+   characters copied to the end of the string buffer and terminated.
+   Returns zero on success. */
+int json_tape_push_string(struct json_tape *tape, uint32_t json_type, const char *str, size_t n) {
+  char *realloc_strings = 0;
+  size_t strings_alloc = 0, i;
+
+  if(n > UINT32_MAX) {
+    fprintf(stderr, "Error: a string is too long to be stored in a tape.\n");
+    return 1;
+  }
+  if(tape->strings_size + n + 1 > tape->strings_alloc) {
+    strings_alloc = tape->strings_alloc ? 2*tape->strings_alloc : 1024;
+    while(strings_alloc < tape->strings_size + n + 1) strings_alloc *= 2;
+    realloc_strings = (char*)realloc(tape->strings, strings_alloc);
+    if(!realloc_strings) {
+      fprintf(stderr, "Error: could not allocate memory for the strings of a tape.\n");
+      return 2;
+    }
+    tape->strings = realloc_strings;
+    tape->strings_alloc = strings_alloc;
+  }
+  if(json_tape_push(tape, json_type, &i)) return 3;
+
+  tape->entries[i].n = (uint32_t)n;
+  tape->entries[i].value.offset = tape->strings_size;
+  memcpy(tape->strings + tape->strings_size, str, n);
+  tape->strings[tape->strings_size + n] = '\0';
+  tape->strings_size += n + 1;
+  return 0;
+}
+
+/* A function to append the entry of one json_value to a tape.  A
+   packed array is appended whole, and a pair without a value is given
+   null, such that the tape stays valid.  An object or array that is
+   read on demand must have been read.  Returns zero on success. */
+int json_tape_push_value(struct json_tape *tape, const struct json_value *jv) {
+  unsigned int k;
+  size_t i;
+
+  if(json_lazy_pending(jv)) {
+    fprintf(stderr, "Error: an object or array that is read on demand must be read with json_lazy_expand_all before it is copied to a tape.\n");
+    return 1;
+  }
+
+  switch(jv->json_type) {
+  case JSON_STRING: case JSON_PAIR:
+    if(json_tape_push_string(tape, jv->json_type, jv->value.str_value, jv->str_len)) return 2;
+    if(jv->json_type == JSON_PAIR && !jv->nchildren) return json_tape_push(tape, JSON_NULL, &i);
+    return 0;
+
+  case JSON_PACKED_INT: case JSON_PACKED_FLOAT:
+    if(json_tape_push(tape, JSON_ARRAY, &i)) return 3;
+    tape->entries[i].n = jv->str_len;
+    for(k=0;k<jv->str_len;k++) {
+      if(json_tape_push(tape, jv->json_type == JSON_PACKED_INT ? JSON_INT : JSON_FLOAT, &i)) return 3;
+      if(jv->json_type == JSON_PACKED_INT) tape->entries[i].value.l_value = jv->value.l_values[k];
+      else tape->entries[i].value.d_value = jv->value.d_values[k];
+    }
+    tape->entries[i - jv->str_len].value.end = tape->n_entries;
+    return 0;
+
+  default:
+    if(json_tape_push(tape, jv->json_type, &i)) return 3;
+    tape->entries[i].n = jv->nchildren;
+    if(jv->json_type == JSON_INT) tape->entries[i].value.l_value = jv->value.l_value;
+    else if(jv->json_type == JSON_FLOAT) tape->entries[i].value.d_value = jv->value.d_value;
+    else if(jv->json_type == JSON_BOOLEAN) tape->entries[i].value.b_value = jv->value.b_value;
+    else tape->entries[i].value.end = i + 1;
+    return 0;
+  }
+}
+
+/* A function to double the size of a stack of frames.  The first
+   stack is the buffer on the stack of the caller, which is copied
+   rather than reallocated.  Returns zero on success. */
+int json_tape_grow_stack(struct json_tape_frame **stack, struct json_tape_frame *stack_buffer,
+			 size_t *size_of_stack) {
+  struct json_tape_frame *realloc_stack = 0;
+
+  if(*stack == stack_buffer) {
+    realloc_stack = (struct json_tape_frame*)malloc(2*(*size_of_stack)*sizeof(struct json_tape_frame));
+    if(realloc_stack) memcpy(realloc_stack, *stack, (*size_of_stack)*sizeof(struct json_tape_frame));
+  }
+  else {
+    realloc_stack = (struct json_tape_frame*)realloc(*stack, 2*(*size_of_stack)*sizeof(struct json_tape_frame));
+  }
+  if(!realloc_stack) {
+    fprintf(stderr, "Error: could not allocate memory for the stack of a tape.\n");
+    return 1;
+  }
+  *stack = realloc_stack;
+  *size_of_stack *= 2;
+  return 0;
+}
+
+/* A function to count a value as a child of the open object or array.
+   The children of an object are its keys, so the values of an object
+   are not counted.  The arguments are (builder, non-zero for a key).
+   Returns zero on success. */
+int json_tape_build_count(struct json_tape_builder *builder, int key) {
+  struct json_tape_entry *entry = 0;
+
+  if(!builder->depth) return 0;
+  entry = &builder->tape->entries[builder->stack[builder->depth-1]];
+  if(key || entry->json_type == JSON_ARRAY) {
+    if(entry->n == UINT32_MAX) {
+      fprintf(stderr, "Error: an object or array has too many children to be stored in a tape.\n");
+      return 1;
+    }
+    entry->n++;
+  }
+  return 0;
+}
+
+/* A function to open an object or an array.  Returns zero on
+   success. */
+int json_tape_build_begin(struct json_tape_builder *builder, uint32_t json_type) {
+  size_t *realloc_stack = 0;
+  size_t size_of_stack = 0, i;
+
+  if(json_tape_build_count(builder, 0) || json_tape_push(builder->tape, json_type, &i)) return 1;
+
+  if(builder->depth == builder->size_of_stack) {
+    size_of_stack = builder->size_of_stack ? 2*builder->size_of_stack : JSON_TAPE_STACK_SZ;
+    realloc_stack = (size_t*)realloc(builder->stack, size_of_stack*sizeof(size_t));
+    if(!realloc_stack) {
+      fprintf(stderr, "Error: could not allocate memory for the stack of a tape.\n");
+      return 2;
+    }
+    builder->stack = realloc_stack;
+    builder->size_of_stack = size_of_stack;
+  }
+  builder->stack[builder->depth++] = i;
+  return 0;
+}
+
+/* Functions that build the tape from the events of the parser.  The
+   context pointer is the builder. */
+int json_tape_build_object_begin(void *ctx) {
+  return json_tape_build_begin((struct json_tape_builder*)ctx, JSON_OBJECT);
+}
+
+int json_tape_build_array_begin(void *ctx) {
+  return json_tape_build_begin((struct json_tape_builder*)ctx, JSON_ARRAY);
+}
+
+int json_tape_build_end(void *ctx) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  builder->depth--;
+  builder->tape->entries[builder->stack[builder->depth]].value.end = builder->tape->n_entries;
+  return 0;
+}
+
+int json_tape_build_key(void *ctx, const char *str, size_t n) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  if(json_tape_build_count(builder, 1)) return 1;
+  return json_tape_push_string(builder->tape, JSON_PAIR, str, n);
+}
+
+int json_tape_build_string(void *ctx, const char *str, size_t n) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  if(json_tape_build_count(builder, 0)) return 1;
+  return json_tape_push_string(builder->tape, JSON_STRING, str, n);
+}
+
+int json_tape_build_int(void *ctx, long l) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  size_t i;
+  if(json_tape_build_count(builder, 0) || json_tape_push(builder->tape, JSON_INT, &i)) return 1;
+  builder->tape->entries[i].value.l_value = l;
+  return 0;
+}
+
+int json_tape_build_float(void *ctx, double d) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  size_t i;
+  if(json_tape_build_count(builder, 0) || json_tape_push(builder->tape, JSON_FLOAT, &i)) return 1;
+  builder->tape->entries[i].value.d_value = d;
+  return 0;
+}
+
+int json_tape_build_bool(void *ctx, int b) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  size_t i;
+  if(json_tape_build_count(builder, 0) || json_tape_push(builder->tape, JSON_BOOLEAN, &i)) return 1;
+  builder->tape->entries[i].value.b_value = b;
+  return 0;
+}
+
+int json_tape_build_null(void *ctx) {
+  struct json_tape_builder *builder = (struct json_tape_builder*)ctx;
+  size_t i;
+  if(json_tape_build_count(builder, 0)) return 1;
+  return json_tape_push(builder->tape, JSON_NULL, &i);
+}
@@ -0,0 +1,119 @@
+#ifndef JSON_TAPE_H
+#define JSON_TAPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+/* The index that stands for the top level of a tape, whose values are
+   not in a container. */
+#define JSON_TAPE_ROOT ((size_t)-1)
+
+/* One value of a tape.  The type is one of the json_types of a
+   json_value, where a JSON_PAIR entry is a key that is followed by
+   the entries of its value.  An object or array is followed by the
+   entries of its children, in document order. */
+struct json_tape_entry {
+  uint32_t json_type;
+
+  /* Objects and arrays: the number of children, where the children of
+     an object are its keys.  Strings and keys: the number of
+     characters, without the terminator. */
+  uint32_t n;
+
+  union {
+    int b_value;
+    long l_value;
+    double d_value;
+    size_t offset; /* Strings and keys: the offset of the characters in the string buffer */
+    size_t end; /* Objects and arrays: the index of the entry after the last child */
+  } value;
+};
+
+/* A document stored as one flat array of entries, rather than as a
+   tree of json_values that point at each other.  The strings are kept
+   in one buffer, as they appear in the document, with any escape
+   sequences, and each is terminated.  A tape may hold several
+   top-level values one after the other. */
+struct json_tape {
+  struct json_tape_entry *entries;
+  size_t n_entries;
+  size_t entries_alloc; /* The number of entries allocated */
+
+  char *strings;
+  size_t strings_size; /* The number of characters used */
+  size_t strings_alloc; /* The number of characters allocated */
+};
+
+/* An iterator over the children of an object or an array, or over the
+   top-level values of a tape. */
+struct json_tape_iter {
+  const struct json_tape *tape;
+  size_t next; /* The index of the next child */
+  size_t end; /* The index of the entry after the last child */
+};
+
+/* Zero all variables, and free the memory that belongs to a tape. */
+void json_tape_clear(struct json_tape *tape);
+void json_tape_free(struct json_tape *tape);
+
+/* A function to read a buffer that contains json straight into a
+   tape, without building a tree.  The entries are appended to those
+   already in the tape.  The arguments are (tape, buffer).  The
+   function returns the number of entries read, or zero if the buffer
+   is not valid json, when the tape is left as it was. */
+size_t json_read_ascii_buffer_tape(struct json_tape *tape, const struct char_buffer *buffer);
+
+/* A function to append the trees of a json_data to a tape.  Packed
+   arrays become arrays of numbers.  A json_data that was read with
+   json_read_ascii_buffer_lazy must first be read with
+   json_lazy_expand_all.  The arguments are (tape, json_data).
+   Returns zero on success. */
+int json_tape_from_data(struct json_tape *tape, const struct json_data *json);
+
+/* A function to append one json_value, and its children, to a tape.
+   Returns zero on success. */
+int json_tape_from_value(struct json_tape *tape, const struct json_value *jv);
+
+/* A function to build the trees of a tape in a json_data, as
+   json_read_ascii_buffer would build them from the document.  The
+   arguments are (tape, json_data).  The function returns the number
+   of json_values in the json_data, or zero if they could not be
+   allocated. */
+size_t json_tape_to_data(const struct json_tape *tape, struct json_data *json);
+
+/* The index of the entry after a value and all of its children.  For
+   a key, this is the entry after its value, which is the next key of
+   the object. */
+size_t json_tape_skip(const struct json_tape *tape, size_t i);
+
+/* The characters of a string or a key, which are terminated.  Returns
+   null for any other entry. */
+const char* json_tape_string(const struct json_tape *tape, size_t i);
+
+/* Find the value of a key in the object at an index.  The arguments
+   are (tape, index of the object, key, number of characters in the
+   key).  The key is compared with the keys as they appear in the
+   document.  Returns the index of the value, or zero if the key is not
+   found or the entry is not an object. */
+size_t json_tape_find(const struct json_tape *tape, size_t i, const char *key, size_t n);
+
+/* Find the element of the array at an index.  The arguments are (tape,
+   index of the array, index of the element).  Returns the index of
+   the element, or zero if it is out of range or the entry is not an
+   array. */
+size_t json_tape_element(const struct json_tape *tape, size_t i, size_t k);
+
+/* Prepare an iterator over the children of the object or array at an
+   index, or over the top-level values if the index is JSON_TAPE_ROOT.
+   Any other entry has no children. */
+void json_tape_iter_init(struct json_tape_iter *iter, const struct json_tape *tape, size_t i);
+
+/* Move an iterator to the next child.  The index of the child is
+   stored in *i, and for an object this is the key, whose value is the
+   entry after it.  Returns zero once all of the children have been
+   visited. */
+int json_tape_iter_next(struct json_tape_iter *iter, size_t *i);
+
+#endif
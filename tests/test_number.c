@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include "json.h"
+#include "json_number.h"
+
+/* The number of random numbers that are parsed and formatted, unless
+   another is given on the command line. */
+#define TEST_NUMBER_COUNT 200000
+
+/* The longest number that is generated. */
+#define TEST_NUMBER_MAX_SZ 512
+
+/* The number of mismatches that are printed before giving up. */
+#define TEST_NUMBER_MAX_ERRORS 10
+
+/* Text that is not a json number, or is too large for a double. */
+static const char *test_number_invalid[] = {
+  "", "-", "+1", "01", "-01", "00", "1.", ".5", "-.5", "1.e5", "1e", "1e+", "1e-", "e5",
+  "1.5e", "0x10", "1 ", " 1", "1,", "--1", "1e5.5", "1.2.3", "Infinity", "-Infinity", "NaN",
+  "nan", "inf", "1e400", "-1e400", "1.8e308", "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792",
+  0
+};
+
+/* Numbers that are hard to round: halfway cases, subnormals, the
+   largest and smallest doubles and integers at the edges of a long
+   and of the digits that a uint64_t can hold. */
+static const char *test_number_hard[] = {
+  "0", "-0", "0.0", "-0.0", "0e0", "0e-400", "0e400", "1e0", "1E+2", "1e-2",
+  "9007199254740993", "9007199254740993.0", "9007199254740992.5",
+  "9223372036854775807", "-9223372036854775808", "9223372036854775808", "-9223372036854775809",
+  "18446744073709551615", "18446744073709551616", "99999999999999999999",
+  "0.500000000000000166533453693773481063544750213623046875",
+  "3.518437208883201171875e13", "62.5364939768271845828", "8.10109172351e-10",
+  "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308",
+  "2.2250738585072011e-308", "2.2250738585072012e-308", "2.2250738585072014e-308",
+  "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+  "1e-400", "-1e-400", "1e-324", "3e-324",
+  "7.2057594037927933e16", "1.00000000000000011102230246251565404236316680908203125",
+  "1.00000000000000011102230246251565404236316680908203124",
+  "1.00000000000000011102230246251565404236316680908203126",
+  "123456789012345678901234567890e-30", "0.000000000000000000000000000000000000001e39",
+  "4503599627370496.5", "4503599627370497.5", "45035996.273704985", "1448997445238699",
+  0
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+uint64_t test_number_random(uint64_t *state);
+double test_number_random_double(uint64_t *state);
+size_t test_number_random_text(uint64_t *state, char *str);
+size_t test_number_halfway_text(uint64_t *state, char *str);
+int test_number_check_parse(const char *str, size_t n);
+int test_number_check_format(double d);
+int test_number_check_int(long l);
+int test_number_significant(const char *str);
+
+/* A differential test of json_parse_number against strtod and
+   strtol, and of json_format_double against the shortest %e text
+   that reads back as the same double.  The argument is the number of
+   random numbers.  Returns zero if every number agrees. */
+int main(int argc, char **argv) {
+  static char str[TEST_NUMBER_MAX_SZ];
+  struct json_value jv;
+  unsigned long count = argc > 1 ? strtoul(argv[1], 0, 10) : TEST_NUMBER_COUNT;
+  unsigned long i;
+  uint64_t state = 0x6e756d62U;
+  size_t n;
+  int errors = 0;
+
+  for(i=0;test_number_invalid[i];i++) {
+    if(!json_parse_number(test_number_invalid[i], strlen(test_number_invalid[i]), &jv)) {
+      fprintf(stderr, "'%s' is read as a number.\n", test_number_invalid[i]);
+      errors++;
+    }
+  }
+
+  for(i=0;test_number_hard[i];i++) {
+    errors += test_number_check_parse(test_number_hard[i], strlen(test_number_hard[i]));
+    errors += test_number_check_format(strtod(test_number_hard[i], 0));
+  }
+
+  errors += test_number_check_format(NAN);
+  errors += test_number_check_format(INFINITY);
+  errors += test_number_check_format(-INFINITY);
+  errors += test_number_check_int(0);
+  errors += test_number_check_int(-1);
+  errors += test_number_check_int(LONG_MAX);
+  errors += test_number_check_int(LONG_MIN);
+
+  for(i=0;i<count && errors < TEST_NUMBER_MAX_ERRORS;i++) {
+    n = test_number_random_text(&state, str);
+    errors += test_number_check_parse(str, n);
+    n = test_number_halfway_text(&state, str);
+    errors += test_number_check_parse(str, n);
+    errors += test_number_check_format(test_number_random_double(&state));
+    errors += test_number_check_int((long)test_number_random(&state) >> (test_number_random(&state) % 64));
+  }
+
+  printf("%lu random numbers checked, %d mismatches.\n", i, errors);
+  return errors ? 1 : 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A xorshift64* generator, such that the test is the same on every
+   run. */
+uint64_t test_number_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/* A finite double: either any bit pattern, or one with few digits,
+   which Grisu2 finds short digits for. */
+double test_number_random_double(uint64_t *state) {
+  static const double pow10[] = {1, 10, 100, 1e3, 1e4, 1e5, 1e6, 1e7};
+  uint64_t bits = test_number_random(state);
+  double d;
+
+  switch(bits % 4) {
+  case 0:
+    return (double)(long)(bits >> 40) / pow10[(bits >> 8) % 8];
+  case 1:
+    return ldexp((double)(bits >> 11), (int)(bits % 2000) - 1100);
+  default:
+    memcpy(&d, &bits, sizeof(double));
+    return isfinite(d) ? d : 0.1;
+  }
+}
+
+/* Random json text: an integer part of up to twenty digits, which
+   is sometimes long, an optional fraction and an optional exponent,
+   which is negative after a long integer part, such that few numbers
+   are too large.  Returns the number of characters. */
+size_t test_number_random_text(uint64_t *state, char *str) {
+  uint64_t r = test_number_random(state);
+  size_t n = 0, k, digits;
+
+  if(r & 1) str[n++] = '-';
+  digits = (r >> 1) % 4 ? 1 + (r >> 3) % 20 : 1 + (r >> 3) % 300;
+  str[n++] = (r >> 12) % 8 ? '1' + (char)((r >> 15) % 9) : '0';
+  if(str[n-1] != '0') {
+    for(k=1;k<digits;k++) str[n++] = '0' + (char)(test_number_random(state) % 10);
+  }
+
+  r = test_number_random(state);
+  if(r % 2) {
+    str[n++] = '.';
+    for(k=(r >> 1) % 20;k<20;k++) str[n++] = '0' + (char)(test_number_random(state) % 10);
+  }
+  if((r >> 6) % 2) {
+    str[n++] = (r >> 7) % 2 ? 'e' : 'E';
+    if(digits > 20 || (r >> 8) % 3 == 2) str[n++] = '-';
+    else if((r >> 8) % 3 == 1) str[n++] = '+';
+    n += (size_t)sprintf(str + n, "%d", (int)((r >> 12) % 300));
+  }
+  return n;
+}
+
+/* Text near the halfway point between two adjacent doubles, where
+   the rounding is hardest.  The halfway point is exact in a long
+   double, and is written with up to forty digits.  Returns the number
+   of characters. */
+size_t test_number_halfway_text(uint64_t *state, char *str) {
+  double d = fabs(test_number_random_double(state));
+  long double mid = ((long double)d + (long double)nextafter(d, INFINITY)) / 2;
+  int precision = 15 + (int)(test_number_random(state) % 26);
+
+  if(!isfinite((double)mid)) mid = d;
+  return (size_t)sprintf(str, "%.*Le", precision, mid);
+}
+
+/* Parse the text, and compare the value with strtol, if the text is
+   an integer that fits in a long, or else with strtod.  Returns one
+   if they differ, or zero otherwise. */
+int test_number_check_parse(const char *str, size_t n) {
+  char terminated[TEST_NUMBER_MAX_SZ+1];
+  struct json_value jv;
+  double expected;
+  long l;
+  int status;
+
+  memcpy(terminated, str, n);
+  terminated[n] = '\0';
+  status = json_parse_number(str, n, &jv);
+
+  if(!strpbrk(terminated, ".eE")) {
+    errno = 0;
+    l = strtol(terminated, 0, 10);
+    if(!errno) {
+      if(status || jv.json_type != JSON_INT || jv.value.l_value != l) {
+	fprintf(stderr, "'%s' is not read as the integer %ld.\n", terminated, l);
+	return 1;
+      }
+      return 0;
+    }
+  }
+
+  expected = strtod(terminated, 0);
+  if(isinf(expected)) {
+    if(!status) {
+      fprintf(stderr, "'%s' is read although it is too large.\n", terminated);
+      return 1;
+    }
+    return 0;
+  }
+  if(status || jv.json_type != JSON_FLOAT || memcmp(&jv.value.d_value, &expected, sizeof(double))) {
+    fprintf(stderr, "'%s' is read as %.17g instead of %.17g.\n", terminated,
+	    status || jv.json_type != JSON_FLOAT ? 0.0 : jv.value.d_value, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/* Format the double, and check that the text is a json float that
+   reads back as the same double, with as few digits as the shortest
+   %e text that does.  Returns one if not, or zero otherwise. */
+int test_number_check_format(double d) {
+  char str[JSON_NUMBER_MAX_SZ+1], shortest[JSON_NUMBER_MAX_SZ];
+  struct json_value jv;
+  int precision;
+  size_t n;
+
+  n = json_format_double(d, str);
+  str[n] = '\0';
+
+  if(!isfinite(d)) {
+    if(strcmp(str, "null")) {
+      fprintf(stderr, "%g is written as '%s' instead of null.\n", d, str);
+      return 1;
+    }
+    return 0;
+  }
+
+  if(json_parse_number(str, n, &jv) || jv.json_type != JSON_FLOAT
+     || memcmp(&jv.value.d_value, &d, sizeof(double))) {
+    fprintf(stderr, "%.17g is written as '%s', which does not read back.\n", d, str);
+    return 1;
+  }
+
+  if(d == 0) return 0;
+  for(precision=0;precision<17;precision++) {
+    sprintf(shortest, "%.*e", precision, d);
+    if(strtod(shortest, 0) == d) break;
+  }
+  if(test_number_significant(str) != test_number_significant(shortest)) {
+    fprintf(stderr, "%.17g is written as '%s', but '%s' is shorter.\n", d, str, shortest);
+    return 1;
+  }
+  return 0;
+}
+
+/* Format the long, and compare the text with printf.  Returns one if
+   they differ, or zero otherwise. */
+int test_number_check_int(long l) {
+  char str[JSON_NUMBER_MAX_SZ+1], expected[JSON_NUMBER_MAX_SZ];
+  size_t n;
+
+  n = json_format_int(l, str);
+  str[n] = '\0';
+  sprintf(expected, "%ld", l);
+  if(strcmp(str, expected)) {
+    fprintf(stderr, "%s is written as '%s'.\n", expected, str);
+    return 1;
+  }
+  return 0;
+}
+
+/* The number of significant digits in a number, without the leading
+   and trailing zeros. */
+int test_number_significant(const char *str) {
+  int first = -1, last = -1, k = 0;
+
+  for(;*str && *str != 'e' && *str != 'E';str++) {
+    if(*str < '0' || *str > '9') continue;
+    if(*str != '0') {
+      if(first < 0) first = k;
+      last = k;
+    }
+    k++;
+  }
+  return first < 0 ? 0 : last - first + 1;
+}
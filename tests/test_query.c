@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "json.h"
+#include "json_ascii_utils.h"
+#include "json_object.h"
+#include "json_query.h"
+
+/* The number of random documents, and of random paths that are
+   evaluated on each, unless another number of documents is given on
+   the command line. */
+#define TEST_QUERY_DOCUMENTS 1000
+#define TEST_QUERY_PATHS 20
+
+/* The deepest nesting of a random document, the largest number of
+   children of an object or array, and the longest path. */
+#define TEST_QUERY_MAX_DEPTH 4
+#define TEST_QUERY_MAX_CHILDREN 24
+#define TEST_QUERY_MAX_STEPS 4
+
+/* The most results that are kept for one path. */
+#define TEST_QUERY_MAX_RESULTS 4096
+
+/* The number of mismatches that are printed before giving up. */
+#define TEST_QUERY_MAX_ERRORS 10
+
+/* The keys of the random documents, as they appear in the document,
+   and the same keys as reference tokens of a path.  A few keys are
+   repeated, such that objects often have the same key twice. */
+static const char *test_query_keys[] = {"a", "b", "id", "0", "1", "", "~", "a/b", "q\\\"", "x~1"};
+static const char *test_query_tokens[] = {"a", "b", "id", "0", "1", "", "~0", "a~1b", "q\"", "x~01"};
+#define TEST_QUERY_N_KEYS 10
+
+/* Paths that must not compile. */
+static const char *test_query_invalid[] = {"a", "/~", "/~2", "/a~", "/[1:2:0]", "/[1:2:-1]", "/[x:]",
+					   "/[:y]", "/[1:2:z]", "/[--1:]", 0};
+
+/* A path that has been split into reference tokens, for the reference
+   evaluator. */
+struct test_query_path {
+  char tokens[TEST_QUERY_MAX_STEPS][16];
+  size_t n_steps;
+};
+
+/* Functions that are used in this file, but are not declared in the header files. */
+uint64_t test_query_random(uint64_t *state);
+int test_query_value(uint64_t *state, struct char_buffer *doc, int depth);
+void test_query_path(uint64_t *state, struct test_query_path *path, char *str);
+size_t test_query_reference(const struct test_query_path *path, size_t i, struct json_value *jv,
+			    struct json_value **results, size_t count);
+int test_query_key_matches(const struct json_value *pair, const char *token);
+int test_query_index(const char *token, long *index);
+int test_query_slice(const char *token, long n, long *start, long *end, long *step);
+
+/* A test of json_query_eval against a simple evaluator that follows
+   the tree one step at a time.  Random documents, with small
+   alphabets of keys, are read, and the keys of half of them are
+   indexed.  Random paths of keys, indices, wildcards and slices are
+   then evaluated on each, with a random maximum number of results.
+   The argument is the number of documents.  Returns zero if every
+   query agrees. */
+int main(int argc, char **argv) {
+  static struct json_value *results[TEST_QUERY_MAX_RESULTS], *expected[TEST_QUERY_MAX_RESULTS];
+  struct test_query_path path;
+  struct json_query query;
+  struct char_buffer text, doc;
+  struct json_data json;
+  unsigned long n_documents = argc > 1 ? strtoul(argv[1], 0, 10) : TEST_QUERY_DOCUMENTS;
+  unsigned long d;
+  uint64_t state = 0x71756572U;
+  size_t n, n_expected, max_results, i;
+  unsigned int p;
+  char str[TEST_QUERY_MAX_STEPS*18 + 1];
+  int errors = 0;
+
+  for(i=0;test_query_invalid[i];i++) {
+    if(!json_query_compile(&query, test_query_invalid[i])) {
+      fprintf(stderr, "'%s' is compiled as a path.\n", test_query_invalid[i]);
+      json_query_free(&query);
+      errors++;
+    }
+  }
+
+  char_buffer_clear(&text);
+  for(d=0;d<n_documents && errors < TEST_QUERY_MAX_ERRORS;d++) {
+    text.position = 0;
+    if(test_query_value(&state, &text, 0)) {
+      fprintf(stderr, "Error: could not generate a document.\n");
+      errors++;
+      break;
+    }
+    doc = text;
+    doc.size = text.position;
+    json_data_clear(&json);
+    if(!json_read_ascii_buffer(&json, &doc)) {
+      fprintf(stderr, "Error: could not read document %lu.\n", d);
+      errors++;
+      break;
+    }
+    if(d % 2) {
+      for(p=0;p<json.n_json_values;p++) {
+	if(json.json_values[p]->json_type == JSON_OBJECT) json_object_index(&json, json.json_values[p]);
+      }
+    }
+
+    for(p=0;p<TEST_QUERY_PATHS && errors < TEST_QUERY_MAX_ERRORS;p++) {
+      test_query_path(&state, &path, str);
+      if(json_query_compile(&query, str)) {
+	fprintf(stderr, "'%s' is not compiled.\n", str);
+	errors++;
+	continue;
+      }
+      max_results = test_query_random(&state) % 4 ? TEST_QUERY_MAX_RESULTS : test_query_random(&state) % 4;
+      n = json_query_eval(&query, json.json_values[0], results, max_results);
+      n_expected = test_query_reference(&path, 0, json.json_values[0], expected, 0);
+      for(i=0;i<n && i<n_expected && i<max_results;i++) {
+	if(results[i] != expected[i]) break;
+      }
+      if(n != n_expected || (i < n && i < max_results)) {
+	fprintf(stderr, "'%s': %lu results instead of %lu, differing from result %lu, in %.*s\n", str,
+		(unsigned long)n, (unsigned long)n_expected, (unsigned long)i, (int)doc.size, doc.buffer);
+	errors++;
+      }
+      json_query_free(&query);
+    }
+    json_free_value_array(&json);
+  }
+  char_buffer_free(&text);
+
+  printf("%lu documents queried, %d mismatches.\n", d, errors);
+  return errors ? 1 : 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A xorshift64* generator, such that the test is the same on every
+   run. */
+uint64_t test_query_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/* Append a random value.  The root is always an object or an array,
+   and objects are often large enough to be indexed.  Returns zero on
+   success. */
+int test_query_value(uint64_t *state, struct char_buffer *doc, int depth) {
+  const char *key = 0;
+  char number[32];
+  unsigned int i, n;
+  int object;
+  uint64_t r = test_query_random(state);
+
+  if(!depth || (depth < TEST_QUERY_MAX_DEPTH && r % 3 == 0)) {
+    object = (r >> 8) % 2;
+    n = (unsigned int)((r >> 16) % (TEST_QUERY_MAX_CHILDREN + 1));
+    if(char_buffer_append(doc, object ? '{' : '[')) return 1;
+    for(i=0;i<n;i++) {
+      if(i && char_buffer_append(doc, ',')) return 1;
+      if(object) {
+	key = test_query_keys[test_query_random(state) % TEST_QUERY_N_KEYS];
+	if(char_buffer_append(doc, '"') || char_buffer_append_n(doc, key, strlen(key)) ||
+	   char_buffer_append_n(doc, "\":", 2)) return 1;
+      }
+      if(test_query_value(state, doc, depth+1)) return 1;
+    }
+    return char_buffer_append(doc, object ? '}' : ']');
+  }
+
+  n = (unsigned int)sprintf(number, "%lu", (unsigned long)(r >> 40));
+  return char_buffer_append_n(doc, number, n);
+}
+
+/* Make a random path, both as reference tokens and as the text of a
+   json pointer. */
+void test_query_path(uint64_t *state, struct test_query_path *path, char *str) {
+  static const char *indices[] = {"0", "1", "2", "5", "00", "01", "-1", "+1"};
+  char bound[3][4];
+  uint64_t r;
+  size_t i, k;
+
+  path->n_steps = (size_t)(test_query_random(state) % (TEST_QUERY_MAX_STEPS + 1));
+  str[0] = '\0';
+  for(i=0;i<path->n_steps;i++) {
+    r = test_query_random(state);
+    if(r % 5 == 0) {
+      strcpy(path->tokens[i], "*");
+    }
+    else if(r % 5 == 1) {
+      /* Each bound is left out, or is a small number, which may be
+	 negative.  The step is positive. */
+      for(k=0;k<3;k++) {
+	r >>= 8;
+	if(r % 3 == 0) bound[k][0] = '\0';
+	else if(k < 2) sprintf(bound[k], "%d", (int)((r >> 2) % 13) - 6);
+	else sprintf(bound[k], "%d", (int)((r >> 2) % 3) + 1);
+      }
+      if(r % 2) sprintf(path->tokens[i], "[%s:%s]", bound[0], bound[1]);
+      else sprintf(path->tokens[i], "[%s:%s:%s]", bound[0], bound[1], bound[2]);
+    }
+    else if(r % 5 == 2) {
+      strcpy(path->tokens[i], indices[(r >> 8) % (sizeof(indices)/sizeof(indices[0]))]);
+    }
+    else {
+      strcpy(path->tokens[i], test_query_tokens[(r >> 8) % TEST_QUERY_N_KEYS]);
+    }
+    strcat(str, "/");
+    strcat(str, path->tokens[i]);
+  }
+}
+
+/* Follow the path from a json_value, one step at a time.  The
+   arguments are (path, step, json_value, results, number of results so
+   far).  Returns the number of results. */
+size_t test_query_reference(const struct test_query_path *path, size_t i, struct json_value *jv,
+			    struct json_value **results, size_t count) {
+  const char *token = path->tokens[i];
+  long index, start, end, step, k;
+  unsigned int j;
+
+  if(i == path->n_steps) {
+    if(count < TEST_QUERY_MAX_RESULTS) results[count] = jv;
+    return count + 1;
+  }
+
+  if(!strcmp(token, "*")) {
+    for(j=0;j<jv->nchildren;j++) {
+      if(jv->json_type == JSON_OBJECT) count = test_query_reference(path, i+1, jv->children[j]->children[0], results, count);
+      else if(jv->json_type == JSON_ARRAY) count = test_query_reference(path, i+1, jv->children[j], results, count);
+    }
+  }
+  else if(token[0] == '[') {
+    if(jv->json_type != JSON_ARRAY || test_query_slice(token, (long)jv->nchildren, &start, &end, &step)) return count;
+    for(k=start;k<end;k+=step) count = test_query_reference(path, i+1, jv->children[k], results, count);
+  }
+  else if(jv->json_type == JSON_OBJECT) {
+    /* The first pair with the key is followed. */
+    for(j=0;j<jv->nchildren;j++) {
+      if(test_query_key_matches(jv->children[j], token)) {
+	return test_query_reference(path, i+1, jv->children[j]->children[0], results, count);
+      }
+    }
+  }
+  else if(jv->json_type == JSON_ARRAY && test_query_index(token, &index) && index < (long)jv->nchildren) {
+    count = test_query_reference(path, i+1, jv->children[index], results, count);
+  }
+  return count;
+}
+
+/* Returns non-zero if the key of a pair, as it appears in the
+   document, is the reference token once "~1" and "~0" are replaced
+   and the token is escaped. */
+int test_query_key_matches(const struct json_value *pair, const char *token) {
+  char unescaped[16], escaped[96];
+  size_t n = 0, i;
+
+  for(i=0;token[i];i++) {
+    if(token[i] == '~') {
+      unescaped[n++] = token[i+1] == '1' ? '/' : '~';
+      i++;
+    }
+    else {
+      unescaped[n++] = token[i];
+    }
+  }
+  n = json_escape(unescaped, n, escaped);
+  return pair->str_len == n && !memcmp(pair->value.str_value, escaped, n);
+}
+
+/* Returns non-zero if the token is an array index: "0", or digits that
+   do not start with '0'. */
+int test_query_index(const char *token, long *index) {
+  size_t i;
+  if(!token[0] || (token[0] == '0' && token[1])) return 0;
+  for(i=0;token[i];i++) {
+    if(token[i] < '0' || token[i] > '9') return 0;
+  }
+  *index = strtol(token, 0, 10);
+  return 1;
+}
+
+/* Find the elements that a slice selects, as a python slice with a
+   positive step would.  The arguments are (token, number of elements,
+   first, end, step).  Returns zero on success. */
+int test_query_slice(const char *token, long n, long *start, long *end, long *step) {
+  char parts[3][8] = {"", "", ""};
+  size_t k = 0, len = 0;
+
+  for(token++;*token != ']';token++) {
+    if(*token == ':') {
+      if(++k == 3) return 1;
+      len = 0;
+    }
+    else if(len < 7) {
+      parts[k][len++] = *token;
+      parts[k][len] = '\0';
+    }
+  }
+  if(!k) return 1;
+
+  *start = parts[0][0] ? strtol(parts[0], 0, 10) : 0;
+  *end = parts[1][0] ? strtol(parts[1], 0, 10) : n;
+  *step = parts[2][0] ? strtol(parts[2], 0, 10) : 1;
+  if(*start < 0) *start = *start + n < 0 ? 0 : *start + n;
+  if(*end < 0) *end = *end + n < 0 ? 0 : *end + n;
+  if(*start > n) *start = n;
+  if(*end > n) *end = n;
+  return 0;
+}
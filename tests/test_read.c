@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "json.h"
+#include "json_ascii_utils.h"
+#include "json_binary.h"
+#include "json_lazy.h"
+#include "json_parser.h"
+#include "json_parallel.h"
+#include "json_tape.h"
+
+/* The number of random documents that are read, unless another is
+   given on the command line. */
+#define TEST_READ_DOCUMENTS 2000
+
+/* The deepest nesting of a random document, and the largest number of
+   children of an object or array. */
+#define TEST_READ_MAX_DEPTH 6
+#define TEST_READ_MAX_CHILDREN 8
+
+/* One document in this many is a top-level array that is large enough
+   to be read on several threads, and the number of threads. */
+#define TEST_READ_LARGE_EVERY 250
+#define TEST_READ_THREADS 4
+
+/* The number of mismatches that are printed before giving up. */
+#define TEST_READ_MAX_ERRORS 10
+
+/* Functions that are used in this file, but are not declared in the header files. */
+uint64_t test_read_random(uint64_t *state);
+int test_read_document(uint64_t *state, struct char_buffer *doc);
+int test_read_large_document(uint64_t *state, struct char_buffer *doc);
+int test_read_value(uint64_t *state, struct char_buffer *doc, int depth);
+int test_read_string(uint64_t *state, struct char_buffer *doc);
+int test_read_space(uint64_t *state, struct char_buffer *doc);
+void test_read_mutate(uint64_t *state, struct char_buffer *doc);
+int test_read_compare(const char *what, const struct char_buffer *doc, const struct char_buffer *expected,
+		      size_t n, const struct json_data *json);
+int test_read_chunked(uint64_t *state, const struct char_buffer *doc, const struct char_buffer *expected);
+int test_read_parallel(const struct char_buffer *doc, const struct char_buffer *expected,
+		       const struct json_data *serial);
+int test_read_lazy(uint64_t *state, const struct char_buffer *doc, const struct char_buffer *expected);
+int test_read_tape(const struct char_buffer *doc, const struct char_buffer *expected,
+		   const struct json_data *serial);
+int test_read_ubjson(const struct char_buffer *doc, const struct json_data *serial, int insitu);
+
+/* A differential test of the ways of reading a document.  Random
+   documents, some of which have been broken, are read with
+   json_read_ascii_buffer, and then in other ways, which must accept
+   the same documents and build trees that are written as the same
+   text.  The trees are also written as UBJSON and read back.  The
+   argument is the number of documents.  Returns zero if every reader
+   agrees. */
+int main(int argc, char **argv) {
+  struct char_buffer text, doc, expected;
+  struct json_data json;
+  unsigned long n_documents = argc > 1 ? strtoul(argv[1], 0, 10) : TEST_READ_DOCUMENTS;
+  unsigned long d;
+  uint64_t state = 0x72656164U;
+  size_t n;
+  int errors = 0;
+
+  char_buffer_clear(&text);
+  char_buffer_clear(&expected);
+  for(d=0;d<n_documents && errors < TEST_READ_MAX_ERRORS;d++) {
+    text.position = 0;
+    if(d % TEST_READ_LARGE_EVERY ? test_read_document(&state, &text) :
+       test_read_large_document(&state, &text)) {
+      fprintf(stderr, "Error: could not generate a document.\n");
+      errors++;
+      break;
+    }
+    if(test_read_random(&state) % 4 == 0) test_read_mutate(&state, &text);
+
+    /* The readers take the size of the buffer as that of the
+       document. */
+    doc = text;
+    doc.size = text.position;
+
+    /* The text of the tree from json_read_ascii_buffer, or nothing if
+       the document is not valid. */
+    expected.position = 0;
+    json_data_clear(&json);
+    n = json_read_ascii_buffer(&json, &doc);
+    if(n && !json_write_to_buffer(&expected, "c", &json)) {
+      fprintf(stderr, "Error: could not write document %lu.\n", d);
+      errors++;
+    }
+    if(!n) expected.position = 0;
+
+    errors += test_read_chunked(&state, &doc, &expected);
+    errors += test_read_parallel(&doc, &expected, &json);
+    errors += test_read_lazy(&state, &doc, &expected);
+    errors += test_read_tape(&doc, &expected, &json);
+    if(n) {
+      errors += test_read_ubjson(&doc, &json, 0);
+      errors += test_read_ubjson(&doc, &json, 1);
+    }
+    json_free_value_array(&json);
+  }
+  char_buffer_free(&text);
+  char_buffer_free(&expected);
+
+  printf("%lu documents read, %d mismatches.\n", d, errors);
+  return errors ? 1 : 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A xorshift64* generator, such that the test is the same on every
+   run. */
+uint64_t test_read_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/* Append a random document, which is one or more values.  Returns
+   zero on success. */
+int test_read_document(uint64_t *state, struct char_buffer *doc) {
+  int status = test_read_value(state, doc, 0);
+  while(!status && test_read_random(state) % 8 == 0) {
+    status = char_buffer_append(doc, '\n') || test_read_value(state, doc, 0);
+  }
+  return status;
+}
+
+/* Append a top-level array that is larger than JSON_PARALLEL_MIN_SZ.
+   Returns zero on success. */
+int test_read_large_document(uint64_t *state, struct char_buffer *doc) {
+  if(char_buffer_append(doc, '[')) return 1;
+  while(doc->position < JSON_PARALLEL_MIN_SZ + JSON_PARALLEL_MIN_SZ/4) {
+    if(doc->position > 1 && char_buffer_append(doc, ',')) return 1;
+    if(test_read_value(state, doc, 1)) return 1;
+  }
+  return char_buffer_append(doc, ']');
+}
+
+/* Append a random value, with white space around its parts.  The
+   arguments are (state, document, depth).  Returns zero on success. */
+int test_read_value(uint64_t *state, struct char_buffer *doc, int depth) {
+  static const char *scalars[] = {
+    "0", "-0", "1", "-17", "123456789", "9223372036854775807", "-9223372036854775808",
+    "9223372036854775808", "0.5", "-2.25e-3", "1e10", "6.02214076E+23", "1.7976931348623157e308",
+    "4.9e-324", "3.141592653589793", "true", "false", "null"
+  };
+  char number[32];
+  unsigned int i, n;
+  int object;
+  uint64_t r = test_read_random(state);
+
+  if(test_read_space(state, doc)) return 1;
+
+  if(depth < TEST_READ_MAX_DEPTH && r % 4 == 0) {
+    object = (r >> 8) % 2;
+    n = (unsigned int)((r >> 16) % (TEST_READ_MAX_CHILDREN + 1));
+    if(char_buffer_append(doc, object ? '{' : '[')) return 1;
+    for(i=0;i<n;i++) {
+      if(i && char_buffer_append(doc, ',')) return 1;
+      if(object) {
+	if(test_read_space(state, doc) || test_read_string(state, doc) ||
+	   test_read_space(state, doc) || char_buffer_append(doc, ':')) return 1;
+      }
+      if(test_read_value(state, doc, depth+1)) return 1;
+    }
+    if(test_read_space(state, doc) || char_buffer_append(doc, object ? '}' : ']')) return 1;
+  }
+  else if(r % 4 == 1) {
+    if(test_read_string(state, doc)) return 1;
+  }
+  else if(r % 4 == 2) {
+    n = (unsigned int)sprintf(number, "%ld", (long)(test_read_random(state) >> (r >> 8) % 64));
+    if(char_buffer_append_n(doc, number, n)) return 1;
+  }
+  else {
+    n = (unsigned int)((r >> 8) % (sizeof(scalars)/sizeof(scalars[0])));
+    if(char_buffer_append_n(doc, scalars[n], strlen(scalars[n]))) return 1;
+  }
+
+  return test_read_space(state, doc);
+}
+
+/* Append a random string, with its quotes.  Escapes, and quotes and
+   backslashes among them, are common. */
+int test_read_string(uint64_t *state, struct char_buffer *doc) {
+  static const char *parts[] = {
+    "a", "key", "value", " ", "\\\"", "\\\\", "\\/", "\\n", "\\t", "\\u00e9", "\\ud83d\\ude00",
+    "\xc3\xa9", "{", "}", "[", "]", ":", ",", "0", "true"
+  };
+  unsigned int i, n = (unsigned int)(test_read_random(state) % 6), k;
+
+  if(char_buffer_append(doc, '"')) return 1;
+  for(i=0;i<n;i++) {
+    k = (unsigned int)(test_read_random(state) % (sizeof(parts)/sizeof(parts[0])));
+    if(char_buffer_append_n(doc, parts[k], strlen(parts[k]))) return 1;
+  }
+  return char_buffer_append(doc, '"');
+}
+
+/* Append nothing, or a little white space. */
+int test_read_space(uint64_t *state, struct char_buffer *doc) {
+  static const char space[] = " \t\n\r";
+  uint64_t r = test_read_random(state);
+  if(r % 4) return 0;
+  return char_buffer_append(doc, space[(r >> 8) % 4]);
+}
+
+/* Break a document, by changing, removing or adding one character. */
+void test_read_mutate(uint64_t *state, struct char_buffer *doc) {
+  static const char common[] = "{}[]:,\"\\ 0e-.xtn";
+  uint64_t r = test_read_random(state);
+  size_t i;
+  char c = common[(r >> 8) % (sizeof(common) - 1)];
+
+  if(!doc->position) return;
+  i = (size_t)((r >> 16) % doc->position);
+  if(r % 3 == 0) {
+    doc->buffer[i] = c;
+  }
+  else if(r % 3 == 1) {
+    memmove(doc->buffer + i, doc->buffer + i + 1, doc->position - i - 1);
+    doc->position--;
+  }
+  else if(!char_buffer_append(doc, c)) {
+    memmove(doc->buffer + i + 1, doc->buffer + i, doc->position - i - 1);
+    doc->buffer[i] = c;
+  }
+}
+
+/* Compare a tree with the text of the tree from json_read_ascii_buffer.
+   The arguments are (name of the reader, document, expected text,
+   value returned by the reader, tree).  Returns one if they differ, or
+   zero otherwise. */
+int test_read_compare(const char *what, const struct char_buffer *doc, const struct char_buffer *expected,
+		      size_t n, const struct json_data *json) {
+  struct char_buffer text;
+  int differ = 0;
+
+  if(!n != !expected->position) {
+    fprintf(stderr, "%s: the document is %s, but json_read_ascii_buffer %s it: %.*s\n", what,
+	    n ? "read" : "not read", n ? "does not read" : "reads", (int)doc->size, doc->buffer);
+    return 1;
+  }
+  if(!n) return 0;
+
+  char_buffer_clear(&text);
+  if(!json_write_to_buffer(&text, "c", json) || text.position != expected->position ||
+     memcmp(text.buffer, expected->buffer, text.position)) {
+    fprintf(stderr, "%s: the tree differs from that of json_read_ascii_buffer: %.*s\n", what,
+	    (int)doc->size, doc->buffer);
+    differ = 1;
+  }
+  char_buffer_free(&text);
+  return differ;
+}
+
+/* Feed the document to a parser in random chunks, which split strings,
+   escapes and numbers between calls. */
+int test_read_chunked(uint64_t *state, const struct char_buffer *doc, const struct char_buffer *expected) {
+  struct json_parser parser;
+  struct json_data json;
+  size_t i = 0, chunk, n;
+  int differ = 0;
+
+  json_data_clear(&json);
+  if(json_parser_init(&parser, &json)) {
+    fprintf(stderr, "Error: could not prepare a parser.\n");
+    return 1;
+  }
+  while(i < doc->size) {
+    chunk = 1 + (size_t)(test_read_random(state) >> 40) % 32;
+    if(chunk > doc->size - i) chunk = doc->size - i;
+    if(json_parser_feed(&parser, doc->buffer + i, chunk)) break;
+    i += chunk;
+  }
+  n = json_parser_finish(&parser);
+  differ = test_read_compare("chunked", doc, expected, n, &json);
+  json_parser_free(&parser);
+  json_free_value_array(&json);
+  return differ;
+}
+
+/* Read the document on several threads, which must build the same
+   json_values, in the same order, as json_read_ascii_buffer.  The
+   arguments are (document, expected text, tree from
+   json_read_ascii_buffer). */
+int test_read_parallel(const struct char_buffer *doc, const struct char_buffer *expected,
+		       const struct json_data *serial) {
+  struct json_data json;
+  size_t n;
+  unsigned int i;
+  int differ = 0;
+
+  json_data_clear(&json);
+  n = json_read_ascii_buffer_parallel(&json, doc, TEST_READ_THREADS);
+  differ = test_read_compare("parallel", doc, expected, n, &json);
+  if(!differ && n) {
+    for(i=0;i<json.n_json_values && i<serial->n_json_values;i++) {
+      if(json.json_values[i]->json_type != serial->json_values[i]->json_type) break;
+    }
+    if(json.n_json_values != serial->n_json_values || i < json.n_json_values) {
+      fprintf(stderr, "parallel: %u json_values instead of %u, differing from json_value %u.\n",
+	      json.n_json_values, serial->n_json_values, i);
+      differ = 1;
+    }
+  }
+  json_free_value_array(&json);
+  return differ;
+}
+
+/* Read the document on demand.  Some containers are read first, along
+   a random path, as an application would reach them, and then the rest
+   of the tree is read before it is written. */
+int test_read_lazy(uint64_t *state, const struct char_buffer *doc, const struct char_buffer *expected) {
+  struct json_data json;
+  struct json_value *jv = 0;
+  unsigned int nchildren;
+  size_t n;
+  int differ = 0;
+
+  json_data_clear(&json);
+  n = json_read_ascii_buffer_lazy(&json, doc);
+  if(n) {
+    jv = json.json_values[0];
+    while(jv && (nchildren = json_value_nchildren(jv))) {
+      jv = json_value_child(jv, (unsigned int)(test_read_random(state) % nchildren));
+    }
+    if(json_lazy_expand_all(&json)) {
+      fprintf(stderr, "Error: could not read the whole of a lazy tree.\n");
+      differ = 1;
+    }
+  }
+  if(!differ) differ = test_read_compare("lazy", doc, expected, n, &json);
+  json_free_value_array(&json);
+  return differ;
+}
+
+/* Read the document into a tape, and copy the tree from
+   json_read_ascii_buffer into another.  The two tapes must hold the
+   same entries, and the trees built from the tape must be written as
+   the same text. */
+int test_read_tape(const struct char_buffer *doc, const struct char_buffer *expected,
+		   const struct json_data *serial) {
+  struct json_tape tape, copy;
+  struct json_data json;
+  size_t n, i;
+  int differ = 0;
+
+  json_tape_clear(&tape);
+  json_tape_clear(&copy);
+  json_data_clear(&json);
+  n = json_read_ascii_buffer_tape(&tape, doc);
+  if(n && !json_tape_to_data(&tape, &json)) {
+    fprintf(stderr, "Error: could not build the tree of a tape.\n");
+    differ = 1;
+  }
+  if(!differ) differ = test_read_compare("tape", doc, expected, n, &json);
+
+  if(!differ && n) {
+    if(json_tape_from_data(&copy, serial)) {
+      fprintf(stderr, "Error: could not copy a tree to a tape.\n");
+      differ = 1;
+    }
+    for(i=0;!differ && i<tape.n_entries && i<copy.n_entries;i++) {
+      if(tape.entries[i].json_type != copy.entries[i].json_type ||
+	 tape.entries[i].n != copy.entries[i].n) break;
+    }
+    if(!differ && (tape.n_entries != copy.n_entries || i < tape.n_entries ||
+		   tape.strings_size != copy.strings_size ||
+		   (tape.strings_size && memcmp(tape.strings, copy.strings, tape.strings_size)))) {
+      fprintf(stderr, "tape: %lu entries instead of %lu when copied from the tree, differing from entry %lu: %.*s\n",
+	      (unsigned long)copy.n_entries, (unsigned long)tape.n_entries, (unsigned long)i,
+	      (int)doc->size, doc->buffer);
+      differ = 1;
+    }
+  }
+
+  json_tape_free(&tape);
+  json_tape_free(&copy);
+  json_free_value_array(&json);
+  return differ;
+}
+
+/* Write the tree from json_read_ascii_buffer as UBJSON, read it back,
+   copying the strings or in situ, and write it again.  The strings of
+   UBJSON are not escaped, so the text of the tree read back may differ
+   from the document, as a "\/" in the document becomes "/", but the
+   two UBJSON buffers must be the same. */
+int test_read_ubjson(const struct char_buffer *doc, const struct json_data *serial, int insitu) {
+  struct char_buffer ubjson, copy, again;
+  struct json_data json;
+  size_t n = 0;
+  int differ = 0;
+
+  char_buffer_clear(&ubjson);
+  char_buffer_clear(&copy);
+  char_buffer_clear(&again);
+  json_data_clear(&json);
+  if(!json_write_to_buffer(&ubjson, "u", serial) || char_buffer_append_n(&copy, ubjson.buffer, ubjson.position)) {
+    fprintf(stderr, "Error: could not write a tree as UBJSON.\n");
+    differ = 1;
+  }
+
+  if(!differ) {
+    copy.size = copy.position;
+    if(insitu) n = json_read_ubjson_buffer_insitu(&json, &copy);
+    else n = json_read_ubjson_buffer(&json, &copy);
+    if(n != serial->n_json_values || !json_write_to_buffer(&again, "u", &json) ||
+       again.position != ubjson.position || memcmp(again.buffer, ubjson.buffer, ubjson.position)) {
+      fprintf(stderr, "ubjson%s: %lu json_values instead of %u, or the UBJSON written again differs: %.*s\n",
+	      insitu ? " in situ" : "", (unsigned long)n, serial->n_json_values, (int)doc->size, doc->buffer);
+      differ = 1;
+    }
+  }
+
+  json_free_value_array(&json);
+  char_buffer_free(&ubjson);
+  char_buffer_free(&copy);
+  char_buffer_free(&again);
+  return differ;
+}
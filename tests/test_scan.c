@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "json_scan.h"
+
+/* The number of random buffers that are scanned, unless another is
+   given on the command line, and the longest buffer. */
+#define TEST_SCAN_BUFFERS 4000
+#define TEST_SCAN_MAX_SZ 2048
+
+/* The number of mismatches that are printed before giving up. */
+#define TEST_SCAN_MAX_ERRORS 10
+
+/* The implementations that are compared.  Those that the CPU does not
+   support are skipped. */
+static const char *test_scan_names[] = {"scalar", "sse2", "avx2"};
+#define TEST_SCAN_N_IMPL 3
+
+/* Functions that are used in this file, but are not declared in the header files. */
+uint64_t test_scan_random(uint64_t *state);
+size_t test_scan_fill(uint64_t *state, char *buffer);
+void test_scan_classify_reference(const char *block, struct json_scan_masks *masks);
+size_t test_scan_reference(const char *buffer, size_t size, uint32_t *indices);
+size_t test_scan_chunked(uint64_t *state, const char *buffer, size_t size, uint32_t *indices);
+int test_scan_compare(const char *what, const char *name, const char *buffer, size_t size,
+		      const uint32_t *expected, size_t n_expected, const uint32_t *indices, size_t n);
+
+/* A differential test of the structural scanners.  Random buffers,
+   which are mostly quotes, backslashes, structural characters and
+   white space, are scanned by every implementation, whole and in
+   chunks, and the indices are compared with a scanner that reads one
+   character at a time.  The classification of each block is compared
+   too.  The argument is the number of buffers.  Returns zero if every
+   implementation agrees. */
+int main(int argc, char **argv) {
+  static char buffer[TEST_SCAN_MAX_SZ];
+  static uint32_t expected[TEST_SCAN_MAX_SZ], indices[TEST_SCAN_MAX_SZ];
+  struct json_scan_masks masks, reference;
+  struct json_scanner scanner;
+  unsigned long n_buffers = argc > 1 ? strtoul(argv[1], 0, 10) : TEST_SCAN_BUFFERS;
+  unsigned long b;
+  uint64_t state = 0x7363616eU;
+  size_t size, n_expected, n, i;
+  int impl, n_impl = 0, errors = 0;
+
+  for(b=0;b<n_buffers && errors < TEST_SCAN_MAX_ERRORS;b++) {
+    size = test_scan_fill(&state, buffer);
+    n_expected = test_scan_reference(buffer, size, expected);
+
+    for(impl=0;impl<TEST_SCAN_N_IMPL;impl++) {
+      if(json_scan_set_implementation(test_scan_names[impl])) continue;
+      if(!b) n_impl++;
+
+      for(i=0;i+JSON_SCAN_BLK_SZ<=size;i+=JSON_SCAN_BLK_SZ) {
+	json_scan_classify(buffer+i, &masks);
+	test_scan_classify_reference(buffer+i, &reference);
+	if(memcmp(&masks, &reference, sizeof(masks))) {
+	  fprintf(stderr, "%s: the classification of buffer %lu differs at block %lu.\n",
+		  test_scan_names[impl], b, (unsigned long)(i/JSON_SCAN_BLK_SZ));
+	  errors++;
+	}
+      }
+
+      json_scanner_clear(&scanner);
+      n = json_scan_structurals(&scanner, buffer, size, indices);
+      errors += test_scan_compare("whole", test_scan_names[impl], buffer, size,
+				  expected, n_expected, indices, n);
+
+      n = test_scan_chunked(&state, buffer, size, indices);
+      errors += test_scan_compare("chunked", test_scan_names[impl], buffer, size,
+				  expected, n_expected, indices, n);
+    }
+  }
+
+  printf("%lu buffers scanned by %d implementations, %d mismatches.\n", b, n_impl, errors);
+  return errors ? 1 : 0;
+}
+
+/*======================================================*/
+/* Functions that are not declared in the header files. */
+
+/* A xorshift64* generator, such that the test is the same on every
+   run. */
+uint64_t test_scan_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/* Fill the buffer with random characters.  Runs of backslashes and
+   quotes are common, as the escapes are the hardest part to get right.
+   Returns the number of characters. */
+size_t test_scan_fill(uint64_t *state, char *buffer) {
+  static const char common[] = "\"\"\"\\\\\\{}[]:,  \t\n\r0123456789-.eEtrufalsn";
+  size_t size = (size_t)(test_scan_random(state) >> 33) % TEST_SCAN_MAX_SZ;
+  size_t i;
+  unsigned int r;
+
+  for(i=0;i<size;i++) {
+    r = (unsigned int)(test_scan_random(state) >> 40);
+    if(r % 16 == 0) buffer[i] = (char)(r >> 8); /* Any byte at all */
+    else buffer[i] = common[(r >> 8) % (sizeof(common) - 1)];
+  }
+  return size;
+}
+
+void test_scan_classify_reference(const char *block, struct json_scan_masks *masks) {
+  unsigned int i;
+  uint64_t bit;
+
+  memset(masks, 0, sizeof(struct json_scan_masks));
+  for(i=0;i<JSON_SCAN_BLK_SZ;i++) {
+    bit = (uint64_t)1 << i;
+    switch(block[i]) {
+    case '"': masks->quote |= bit; break;
+    case '\\': masks->backslash |= bit; break;
+    case '{': case '}': case '[': case ']': case ':': case ',': masks->structural |= bit; break;
+    case ' ': case '\t': case '\n': case '\r': masks->whitespace |= bit; break;
+    default: break;
+    }
+  }
+}
+
+/* The scanner, one character at a time.  A backslash escapes the next
+   character, both within and outside of strings.  Outside of strings,
+   the structural characters, the quotes and the first character of
+   each run of other characters that are not white space are
+   recorded. */
+size_t test_scan_reference(const char *buffer, size_t size, uint32_t *indices) {
+  int in_string = 0, escaped = 0, in_scalar = 0, quote;
+  size_t i, n = 0;
+  char c;
+
+  for(i=0;i<size;i++) {
+    c = buffer[i];
+    quote = c == '"' && !escaped;
+    escaped = c == '\\' && !escaped;
+
+    if(in_string) {
+      if(quote) {
+	indices[n++] = (uint32_t)i;
+	in_string = 0;
+      }
+      continue;
+    }
+
+    if(quote) {
+      indices[n++] = (uint32_t)i;
+      in_string = 1;
+      in_scalar = 0;
+    }
+    else if(c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+      indices[n++] = (uint32_t)i;
+      in_scalar = 0;
+    }
+    else if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      in_scalar = 0;
+    }
+    else {
+      if(!in_scalar) indices[n++] = (uint32_t)i;
+      in_scalar = 1;
+    }
+  }
+  return n;
+}
+
+/* Scan the buffer in random chunks of any length, as json_parser_feed
+   is given them. */
+size_t test_scan_chunked(uint64_t *state, const char *buffer, size_t size, uint32_t *indices) {
+  struct json_scanner scanner;
+  size_t i = 0, chunk, k, n = 0, n_chunk;
+
+  json_scanner_clear(&scanner);
+  while(i < size) {
+    chunk = 1 + (size_t)(test_scan_random(state) >> 40) % (4*JSON_SCAN_BLK_SZ);
+    if(chunk > size - i) chunk = size - i;
+    n_chunk = json_scan_structurals(&scanner, buffer+i, chunk, indices+n);
+    for(k=n;k<n+n_chunk;k++) indices[k] += (uint32_t)i;
+    n += n_chunk;
+    i += chunk;
+  }
+  return n;
+}
+
+/* Report the first index that differs.  Returns one if the indices
+   differ, or zero otherwise. */
+int test_scan_compare(const char *what, const char *name, const char *buffer, size_t size,
+		      const uint32_t *expected, size_t n_expected, const uint32_t *indices, size_t n) {
+  size_t i;
+
+  for(i=0;i<n && i<n_expected;i++) {
+    if(indices[i] != expected[i]) break;
+  }
+  if(i == n && n == n_expected) return 0;
+
+  fprintf(stderr, "%s (%s): %lu indices instead of %lu, differing from index %lu (offset %lu",
+	  name, what, (unsigned long)n, (unsigned long)n_expected, (unsigned long)i,
+	  i < n_expected ? (unsigned long)expected[i] : (unsigned long)size);
+  if(i < n_expected && expected[i] < size) fprintf(stderr, ", character 0x%02x", (unsigned char)buffer[expected[i]]);
+  fprintf(stderr, ") in a buffer of %lu characters.\n", (unsigned long)size);
+  return 1;
+}